@@ -1,10 +1,20 @@
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#else
+#include <fcntl.h>
+#endif
 
 #include "xf_shell.h"
 #include "xf_shell_options.h"
@@ -13,6 +23,9 @@
 static bool s_termios_enabled = false;
 static struct termios s_termios_old;
 static volatile sig_atomic_t s_should_exit = 0;
+static bool s_input_closed = false;
+static int s_wake_rd = -1;
+static int s_wake_wr = -1;
 
 static void handle_exit_signal(int signo) {
     (void)signo;
@@ -20,6 +33,7 @@ static void handle_exit_signal(int signo) {
     putc('\r', stdout);
 }
 
+// The terminal sends no SIGINT in raw mode, Ctrl-C reaches the shell as 0x03
 static void setup_signal_handlers(void) {
     struct sigaction sa;
     memset(&sa, 0, sizeof(sa));
@@ -33,6 +47,9 @@ static void setup_signal_handlers(void) {
 
 static void restore_terminal_mode(void) {
     if (s_termios_enabled) {
+        // The shell turned on bracketed paste, hand the terminal back without it
+        fputs("\x1b[?2004l", stdout);
+        fflush(stdout);
         (void)tcsetattr(STDIN_FILENO, TCSAFLUSH, &s_termios_old);
         s_termios_enabled = false;
     }
@@ -51,7 +68,7 @@ static void enable_terminal_char_mode(void) {
     raw = s_termios_old;
     raw.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON);
     raw.c_oflag &= ~OPOST;
-    raw.c_lflag &= ~(ECHO | ECHONL | ICANON | IEXTEN);
+    raw.c_lflag &= ~(ECHO | ECHONL | ICANON | IEXTEN | ISIG);
     raw.c_cflag &= ~(CSIZE | PARENB);
     raw.c_cflag |= CS8;
     raw.c_cc[VMIN] = 1;
@@ -65,28 +82,121 @@ static void enable_terminal_char_mode(void) {
     atexit(restore_terminal_mode);
 }
 
-static char getch(void) {
-    char ch = '\0';
-    if (s_termios_enabled) {
-        if (read(STDIN_FILENO, &ch, 1) == 1) {
-            return ch;
+static bool setup_wakeup(void) {
+#ifdef __linux__
+    s_wake_rd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    s_wake_wr = s_wake_rd;
+    return s_wake_rd >= 0;
+#else
+    int fds[2];
+
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    (void)fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    (void)fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    s_wake_rd = fds[0];
+    s_wake_wr = fds[1];
+    return true;
+#endif
+}
+
+// Called by the shell whenever work is queued, possibly from another thread
+static void notify_wakeup(void* data) {
+    uint64_t one = 1;
+    (void)data;
+    // A full pipe/counter already guarantees a wakeup, so errors are ignored
+    (void)!write(s_wake_wr, &one, sizeof(one));
+}
+
+static void drain_wakeup(void) {
+    uint64_t buf[8];
+    while (read(s_wake_rd, buf, sizeof(buf)) > 0) {
+    }
+}
+
+// The ring is empty after processing, so one read always fits; behind a
+// pending command it fills a byte per tick, like a UART would
+static void read_input(bool busy) {
+    char buf[XF_SHELL_RX_RING_SIZE];
+    ssize_t n = read(STDIN_FILENO, buf, busy ? 1 : sizeof(buf));
+    const char* eof = NULL;
+
+    // Without ICANON the terminal passes Ctrl-D on, it ends the input as EOF would
+    if (n > 0 && s_termios_enabled) {
+        eof = memchr(buf, 0x04, (size_t)n);
+    }
+    if (eof != NULL) {
+        n = eof - buf;
+    }
+    if (n > 0) {
+        (void)xf_shell_rx_write(buf, (size_t)n);
+    }
+    if (n == 0 || eof != NULL) {
+        // A script may end without a newline, its last line still runs
+        if (xf_shell_get_mode() == XF_SHELL_MODE_PIPE) {
+            (void)xf_shell_rx_write("\n", 1);
+        }
+        s_input_closed = true;
+        s_should_exit = 1;
+    }
+}
+
+// Feed the shell clock with the milliseconds passed since the last call
+static void tick_shell(void) {
+    static struct timespec s_last;
+    struct timespec now;
+    int64_t ms;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (s_last.tv_sec == 0 && s_last.tv_nsec == 0) {
+        s_last = now;
+    }
+    ms = (int64_t)(now.tv_sec - s_last.tv_sec) * 1000 + (now.tv_nsec - s_last.tv_nsec) / 1000000;
+    if (ms > 0) {
+        s_last.tv_nsec += (long)(ms % 1000) * 1000000L;
+        s_last.tv_sec += (time_t)(ms / 1000);
+        if (s_last.tv_nsec >= 1000000000L) {
+            s_last.tv_nsec -= 1000000000L;
+            s_last.tv_sec++;
         }
-        return '\0';
+        xf_shell_tick((uint32_t)ms);
     }
+}
 
-    int c = getc(stdin);
-    if (c == EOF) {
-        return '\0';
+// Sleep in poll() until stdin or the wakeup fd is readable, until the next
+// timed run (watch), or for one tick while a command is pending
+static void wait_for_work(bool busy) {
+    struct pollfd fds[2] = {
+        { .fd = STDIN_FILENO, .events = POLLIN },
+        { .fd = s_wake_rd, .events = POLLIN },
+    };
+    uint32_t next = xf_shell_next_timeout();
+    int timeout = (next > (uint32_t)INT_MAX) ? -1 : (int)next;
+
+    if (busy) {
+        timeout = 1;
+    }
+    if (poll(fds, 2, timeout) < 0) {
+        if (errno != EINTR) {
+            s_should_exit = 1;
+        }
+        return;
+    }
+    tick_shell();
+    if (fds[1].revents & POLLIN) {
+        drain_wakeup();
+    }
+    if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+        read_input(busy);
     }
-    return (char)c;
 }
 
-static void putch(void* data, char ch, bool is_last) {
+static void write_out(void* data, const char* buf, size_t len) {
     (void)data;
-    putc(ch, stdout);
-    if (is_last) {
-        fflush(stdout);
-    }
+    // One fwrite + fflush per burst
+    fwrite(buf, 1, len, stdout);
+    fflush(stdout);
 }
 
 /****************设置指令回调*******************/
@@ -104,10 +214,11 @@ static int test(const xf_cmd_args_t* cmd) {
     res = xf_shell_cmd_get_int(cmd, "number", &number);
     res = xf_shell_cmd_get_bool(cmd, "bool", &bool_val);
 
-    printf("input: %s" XF_SHELL_NEWLINE, input);
-    printf("file: %s" XF_SHELL_NEWLINE, file);
-    printf("num: %d" XF_SHELL_NEWLINE, number);
-    printf("bool: %d" XF_SHELL_NEWLINE, bool_val);
+    // Text at the terminal, JSON in pipe mode, see main()
+    xf_shell_emit_kv_str("input", input);
+    xf_shell_emit_kv_str("file", file);
+    xf_shell_emit_kv_int("number", number);
+    xf_shell_emit_kv_bool("bool", bool_val);
     return 0;
 }
 
@@ -210,12 +321,161 @@ static xf_shell_cmd_t s_test_cmd = {
     ._args = s_test_args,
 };
 
+static int source(const xf_cmd_args_t* cmd) {
+    const char* file = NULL;
+    uint32_t line = 0;
+    char text[40];
+    int res;
+
+    (void)xf_shell_cmd_get_string(cmd, "file", &file);
+
+    res = xf_shell_exec_file(file, true, &line);
+    if (res == XF_CMD_OK) {
+        return 0;
+    }
+    // Through the shell, so a capture or frame gets it as well
+    xf_shell_puts(file);
+    if (line > 0) {
+        snprintf(text, sizeof(text), ":%u: failed (%d)" XF_SHELL_NEWLINE, (unsigned)line, res);
+        xf_shell_puts(text);
+    } else {
+        xf_shell_puts(": cannot read script" XF_SHELL_NEWLINE);
+    }
+    return -1;
+}
+
+static xf_arg_t s_arg_source_file = {
+    .name = "file",
+    .description = "Script to run, one command per line, # for comments",
+    .type = XF_OPTION_TYPE_STRING,
+    .require = true,
+};
+
+static xf_arg_t* s_source_args[] = {
+    &s_arg_source_file,
+};
+
+static xf_shell_cmd_t s_source_cmd = {
+    .command = "source",
+    .func = source,
+    .help = "Run a script file",
+    ._arg_count = XF_SHELL_COUNT_OF(s_source_args),
+    ._args = s_source_args,
+};
+
+// Simulated flash erase, one sector per step so the console stays responsive
+static int erase(const xf_cmd_args_t* cmd) {
+    static int32_t s_left;
+    static struct timespec s_due;
+    struct timespec now;
+    char text[48];
+
+    if (xf_shell_cmd_cancelled()) {
+        snprintf(text, sizeof(text), XF_SHELL_NEWLINE "erase aborted, %d sectors left" XF_SHELL_NEWLINE,
+                 (int)s_left);
+        xf_shell_puts(text);
+        return 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (!xf_shell_cmd_resumed()) {
+        (void)xf_shell_cmd_get_int(cmd, "sectors", &s_left);
+        s_due = now;
+    }
+    if (now.tv_sec < s_due.tv_sec ||
+        (now.tv_sec == s_due.tv_sec && now.tv_nsec < s_due.tv_nsec)) {
+        return XF_CMD_PENDING;
+    }
+    if (s_left-- > 0) {
+        // Each sector takes 200 ms
+        s_due.tv_nsec += 200000000L;
+        if (s_due.tv_nsec >= 1000000000L) {
+            s_due.tv_nsec -= 1000000000L;
+            s_due.tv_sec++;
+        }
+        xf_shell_puts(".");
+        return XF_CMD_PENDING;
+    }
+    xf_shell_puts(XF_SHELL_NEWLINE "erase done" XF_SHELL_NEWLINE);
+    return 0;
+}
+
+static xf_opt_arg_t s_opt_sectors = {
+    .long_opt = "sectors",
+    .short_opt = 'n',
+    .description = "Sectors to erase",
+    .type = XF_OPTION_TYPE_INT,
+    .require = false,
+    .has_default = true,
+    .validator = validate_number_range,
+    .default_integer = 25,
+};
+
+static xf_opt_arg_t* s_erase_opts[] = {
+    &s_opt_sectors,
+};
+
+static xf_shell_cmd_t s_erase_cmd = {
+    .command = "erase",
+    .func = erase,
+    .help = "Erase flash in the background, Ctrl-C to abort",
+    ._opt_count = XF_SHELL_COUNT_OF(s_erase_opts),
+    ._opts = s_erase_opts,
+};
+
+// Thread-safe, so it can also run in the background: tick -n 3 &
+static int tick(const xf_cmd_args_t* cmd) {
+    int32_t n = 0;
+    int32_t i;
+    char line[32];
+    const struct timespec period = {1, 0};
+
+    (void)xf_shell_cmd_get_int(cmd, "count", &n);
+    for (i = 1; i <= n; i++) {
+        nanosleep(&period, NULL);
+        if (xf_shell_cmd_cancelled()) {
+            return XF_CMD_INTERRUPTED;
+        }
+        snprintf(line, sizeof(line), "tick %d" XF_SHELL_NEWLINE, (int)i);
+        xf_shell_puts(line);
+    }
+    return XF_CMD_OK;
+}
+
+static xf_opt_arg_t s_opt_ticks = {
+    .long_opt = "count",
+    .short_opt = 'n',
+    .description = "Ticks to print, one per second",
+    .type = XF_OPTION_TYPE_INT,
+    .require = false,
+    .has_default = true,
+    .validator = validate_number_range,
+    .default_integer = 5,
+};
+
+static xf_opt_arg_t* s_tick_opts[] = {
+    &s_opt_ticks,
+};
+
+static xf_shell_cmd_t s_tick_cmd = {
+    .command = "tick",
+    .func = tick,
+    .help = "Print a line every second, append & to run it in the background",
+    ._opt_count = XF_SHELL_COUNT_OF(s_tick_opts),
+    ._opts = s_tick_opts,
+};
+
 static xf_shell_cmd_t* s_cmd_table[] = {
     &s_test_cmd,
+    &s_source_cmd,
+    &s_erase_cmd,
+    &s_tick_cmd,
 };
 
 
-int main(void) {
+int main(int argc, char **argv) {
+    // Started by a host program such as tools/xf_frame_host.c
+    bool frame = (argc > 1 && strcmp(argv[1], "--frame") == 0);
+
     setup_signal_handlers();
     enable_terminal_char_mode();
 
@@ -228,11 +488,31 @@ int main(void) {
 
     /****************初始化及调用*******************/
 
-    xf_shell_cmd_init("XF_SHELL > ", putch, NULL);
+    if (!setup_wakeup()) {
+        perror("wakeup fd");
+        return 1;
+    }
+    xf_shell_set_notify(notify_wakeup, NULL);
+    // Driven by a host script through a pipe: no echo, colors or prompt, and
+    // structured output as JSON
+    if (frame) {
+        xf_shell_set_mode(XF_SHELL_MODE_FRAME);
+        xf_shell_set_format(XF_SHELL_FORMAT_JSON);
+    } else if (isatty(STDIN_FILENO)) {
+        xf_shell_set_mode(XF_SHELL_MODE_INTERACTIVE);
+    } else {
+        xf_shell_set_mode(XF_SHELL_MODE_PIPE);
+        xf_shell_set_format(XF_SHELL_FORMAT_JSON);
+    }
+    xf_shell_cmd_init_write("XF_SHELL > ", write_out, NULL);
 
     while (!s_should_exit) {
-        xf_shell_cmd_handle(getch);
+        xf_shell_cmd_process();
+        wait_for_work(xf_shell_has_pending_work());
+    }
+    while (s_input_closed && xf_shell_has_pending_work()) {
+        xf_shell_cmd_process();
     }
 
-    return 130;
+    return s_input_closed ? 0 : 130;
 }
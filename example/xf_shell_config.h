@@ -11,5 +11,14 @@
  */
 
  #define XF_SHELL_PROFILE_MIN_SIZE 1
+ #define XF_SHELL_RX_RING_SIZE 128
+ #define XF_SHELL_PIPE_MODE 1
+ #define XF_SHELL_ASYNC_CMD 1
+ #define XF_SHELL_BG_JOBS 4
+ #define XF_SHELL_WATCH_SIZE 512
+ #define XF_SHELL_SCHED_ENTRIES 8
+ #define XF_SHELL_SUBMIT_SLOTS 4
+ #define XF_SHELL_EMIT_DEPTH 4
+ #define XF_SHELL_FRAME_SIZE 256
 
 #endif  // __XF_SHELL_CONFIG_H__
@@ -14,35 +14,186 @@
 #include "xf_shell.h"
 #include "xf_shell_cli.h"
 #include "xf_shell_completion.h"
+#include "xf_shell_job.h"
 #include "xf_shell_parser.h"
+#include "xf_shell_rx.h"
+#include "xf_shell_sched.h"
+#include "xf_shell_submit.h"
+#include "xf_shell_emit.h"
+#include "xf_shell_frame.h"
+#include "xf_shell_tx.h"
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 
+/* ==================== [Defines] =========================================== */
+
+#if XF_SHELL_RX_RING_SIZE
+#define SHELL_INTERRUPTED() xf_shell_interrupted()
+#else
+#define SHELL_INTERRUPTED() false
+#endif
+
+#if XF_SHELL_PIPE_MODE
+#define SHELL_PIPE() s_pipe
+#else
+#define SHELL_PIPE() false
+#endif
+
+#if XF_SHELL_ASYNC_CMD
+#define SHELL_PENDING() (s_async != NULL)
+#else
+#define SHELL_PENDING() false
+#endif
+
+#if XF_SHELL_TIMERS
+#define SHELL_SLEEPING() (s_sleeping && xf_shell_next_timeout() > 0U)
+#else
+#define SHELL_SLEEPING() false
+#endif
+
+#if XF_SHELL_BG_JOBS
+#define SHELL_JOBS_REPORT() shell_jobs_report(false)
+#else
+#define SHELL_JOBS_REPORT() do { } while (0)
+#endif
+
+#if XF_SHELL_SCHED_ENTRIES
+#define SHELL_SCHED_RUN() shell_sched_run()
+#else
+#define SHELL_SCHED_RUN() do { } while (0)
+#endif
+
+#if XF_SHELL_SUBMIT_SLOTS
+#define SHELL_SUBMIT_RUN() shell_submit_run()
+#else
+#define SHELL_SUBMIT_RUN() do { } while (0)
+#endif
+
+/* Built-ins taking a command and its own words as their last argument */
+#define SHELL_TAIL_CMDS (XF_SHELL_WATCH_SIZE > 0 || XF_SHELL_SCHED_ENTRIES > 0)
+
 /* ==================== [Typedefs] ========================================== */
 
 typedef xf_shell_cmd_t cmd_item_t;
 typedef xf_opt_arg_t cmd_opt_t;
 typedef xf_arg_t cmd_arg_t;
 
+/* A line of chained commands, resumable after a command left pending */
+typedef struct {
+    const char **argv;
+    int argc;
+    int start;  /* first word of the next command */
+    uint8_t op; /* operator in front of it */
+    int ret;    /* status of the last command that ran */
+    bool top;   /* typed or piped in, not run from code */
+} shell_chain_t;
+
+#if XF_SHELL_WATCH_SIZE
+/* The command `watch` runs, parsed once, and the last two frames of its output */
+typedef struct {
+    cmd_item_t *item;  /* NULL while not watching */
+    const char **argv; /* its words, in the line being run */
+    int argc;
+    uint32_t period;   /* milliseconds between runs */
+    uint32_t due;      /* next run, on the xf_shell_tick() clock */
+    uint16_t rows;     /* terminal rows in use, the cursor sits below them */
+    uint8_t shown;     /* frame[] index of the frame on the terminal */
+    bool pending;      /* the command returned XF_CMD_PENDING, resume it */
+    size_t len[2];
+    char frame[2][XF_SHELL_WATCH_SIZE];
+} shell_watch_t;
+#endif
+
 /* ==================== [Static Prototypes] ================================= */
 
 static void xf_shell_register_help_cmd(void);
 #if XF_CLI_HISTORY_LEN
 static void xf_shell_register_history_cmd(void);
 #endif
+#if XF_SHELL_BG_JOBS
+static void xf_shell_register_job_cmds(void);
+#endif
+#if XF_SHELL_WATCH_SIZE
+static void xf_shell_register_watch_cmd(void);
+#endif
+#if XF_SHELL_SCHED_ENTRIES
+static void xf_shell_register_sched_cmds(void);
+#endif
 static int append_command_to_registry(cmd_item_t *cmd);
 static bool is_valid_command_descriptor(const cmd_item_t *cmd);
 static int find_command_index_by_name(const char *name);
 static cmd_item_t *find_command_by_name(const char *name);
 static int import_static_command_table(void);
 static bool is_whitespace_char(char ch);
+static void shell_handle_char(char ch);
+static int shell_chain_begin(shell_chain_t *ch, int argc, const char **argv, bool top);
+static int shell_chain_run(shell_chain_t *ch);
+static const char *shell_chain_error(int argc, const char **argv);
+static void shell_line_done(int ret);
+static int shell_async_call(cmd_item_t *item);
+#if XF_SHELL_ASYNC_CMD
+static bool shell_async_step(void);
+#endif
+static size_t shell_feed(const char *buf, size_t len);
+static bool shell_job_step(void);
+static void shell_settle(void);
+static bool shell_take_interrupt(void);
+static void shell_start(void);
+static void shell_prompt(void);
 static bool are_completion_candidates_valid(const char *const *candidates, uint16_t count);
 static int help_command(const xf_cmd_args_t *cmd);
+static bool help_job(struct xf_cli *cli, void *ctx, uint16_t step);
 static void cli_puts_adapter(void *ctx, const char *s);
-static void cli_putchar(struct xf_cli *cli, char ch, bool is_last);
-static void cli_puts(struct xf_cli *cli, const char *s);
 #if XF_CLI_HISTORY_LEN
 static int history_command(const xf_cmd_args_t *cmd);
+static bool history_job(struct xf_cli *cli, void *ctx, uint16_t step);
+#endif
+#if XF_SHELL_BG_JOBS
+static int shell_job_launch(int argc, const char **argv);
+static bool shell_is_builtin(const cmd_item_t *item);
+static void shell_jobs_report(bool in_command);
+static void shell_job_line(int id, const xf_shell_job_info_t *info);
+static void shell_no_such_job(int32_t id);
+static int jobs_command(const xf_cmd_args_t *cmd);
+static int wait_command(const xf_cmd_args_t *cmd);
+static int kill_command(const xf_cmd_args_t *cmd);
+#endif
+#if SHELL_TAIL_CMDS
+static bool shell_takes_command(const cmd_item_t *item);
+static int shell_tail_words(const cmd_item_t *item, int argc, const char **argv);
+#endif
+#if XF_SHELL_TIMERS
+static void shell_timers_arm(void);
+#endif
+#if XF_SHELL_WATCH_SIZE
+static int shell_watch_start(const xf_cmd_args_t *cmd);
+static int shell_watch_call(shell_watch_t *w);
+static void shell_watch_header(const shell_watch_t *w);
+static void shell_watch_draw(shell_watch_t *w);
+static size_t shell_frame_line(const char *buf, size_t len, size_t *pos, const char **line);
+static bool watch_interval_valid(const xf_opt_arg_t *opt, const char **error_msg, bool *append_help);
+static int watch_command(const xf_cmd_args_t *cmd);
+#endif
+#if XF_SHELL_SCHED_ENTRIES
+static void shell_sched_run(void);
+static bool shell_sched_due(void);
+static bool shell_parse_ms(const char *s, uint32_t *ms);
+static bool sched_time_valid(const xf_arg_t *arg, const char **error_msg, bool *append_help);
+static int shell_sched_add(const xf_cmd_args_t *cmd, const char *name, bool every);
+static int every_command(const xf_cmd_args_t *cmd);
+static int at_command(const xf_cmd_args_t *cmd);
+static int sched_command(const xf_cmd_args_t *cmd);
+#endif
+#if XF_SHELL_SUBMIT_SLOTS
+static void shell_submit_run(void);
+#endif
+#if XF_SHELL_FRAME_SIZE
+static size_t shell_frame_feed(const char *buf, size_t len);
+static void shell_frame_call(void);
+static void shell_frame_out(void *data, const char *buf, size_t len);
+static void shell_frame_data(void);
+static void shell_frame_write(void *data, const char *buf, size_t len);
 #endif
 
 /* ==================== [Static Variables] ================================== */
@@ -55,53 +206,417 @@ static uint16_t s_user_cmd_count = 0;
 #if XF_SHELL_COMPLETION_ENABLE
 static char s_matches[XF_SHELL_MAX_MATCHES][XF_CLI_MAX_LINE];
 #endif
+#if XF_SHELL_TX_RING_SIZE
+static xf_shell_tx_t s_tx;
+#endif
+static xf_shell_notify_t s_notify = NULL;
+static void *s_notify_data = NULL;
+static bool s_budgeted = false;       /* inside xf_shell_cmd_poll(), jobs are stepped there */
+static bool s_defer_job = false;      /* the next command's job may outlive xf_shell_cmd_run() */
+static bool s_prompt_pending = false; /* the prompt waits for the command's job */
+static char *s_line_argv[XF_CLI_MAX_ARGC];
+static shell_chain_t s_line;          /* the line typed or piped in */
+static bool s_resumed = false;        /* the running handler returned XF_CMD_PENDING before */
+static bool s_cancelled = false;      /* Ctrl-C, the pending handler gets one last call */
+#if XF_SHELL_ASYNC_CMD
+static cmd_item_t *s_async = NULL;    /* left pending by the line, stepped by later calls */
+static bool s_may_pend = false;       /* the next command may stay pending past xf_shell_cmd_run() */
+static bool s_pend_top = false;       /* the running command may stay pending, s_may_pend of its call */
+#if !XF_SHELL_RX_RING_SIZE
+static bool s_feed_inline = false;    /* inside xf_shell_cmd_feed(), no command may stay pending */
+#endif
+#endif
+#if XF_SHELL_PIPE_MODE
+static bool s_pipe = false;           /* XF_SHELL_MODE_PIPE */
+static bool s_started = false;        /* shell_start() has run */
+static int s_last_rc = 0;             /* return code for the pipe end marker */
+#endif
+#if XF_SHELL_FRAME_SIZE
+static bool s_frame = false;          /* XF_SHELL_MODE_FRAME */
+static xf_shell_frame_rx_t s_frame_rx;
+static char s_frame_buf[XF_SHELL_FRAME_SIZE]; /* output of the running request, not yet sent */
+static size_t s_frame_len = 0;
+static uint8_t s_frame_seq = 0;       /* sequence number of the running request */
+#endif
+#if XF_SHELL_TIMERS
+static volatile uint32_t s_now = 0;   /* milliseconds counted by xf_shell_tick() */
+static volatile uint32_t s_due = 0;   /* the next deadline, while s_armed */
+static volatile bool s_armed = false;
+static bool s_sleeping = false;       /* the pending command waits for s_due only */
+#endif
+#if SHELL_TAIL_CMDS
+static const char **s_tail_argv = NULL; /* the command after watch's, every's or at's own words */
+static int s_tail_argc = 0;
+#endif
+#if XF_SHELL_WATCH_SIZE
+static shell_watch_t s_watch;
+#endif
+#if XF_SHELL_SCHED_ENTRIES
+static xf_shell_sched_t s_sched;
+#endif
+#if XF_SHELL_SUBMIT_SLOTS
+static char s_submit_out[XF_SHELL_SUBMIT_OUT_SIZE + 1]; /* the running submission's output */
+#endif
+#if XF_SHELL_EMIT_DEPTH
+static xf_shell_emit_t s_emit;        /* the running command's structured output */
+#endif
 
 /* ==================== [Global Functions] ================================== */
 
 void xf_shell_cmd_init(const char *prompt, xf_putc_t putc, void *user_data)
 {
     xf_cli_init(&s_cli, prompt, putc, user_data);
+    shell_start();
+}
 
-    s_cmd_count = 0;
-    xf_shell_register_help_cmd();
-#if XF_CLI_HISTORY_LEN
-    xf_shell_register_history_cmd();
-#endif
-    (void)import_static_command_table();
+void xf_shell_cmd_init_write(const char *prompt, xf_write_t write, void *user_data)
+{
+    xf_cli_init_write(&s_cli, prompt, write, user_data);
+    shell_start();
+}
 
-    xf_cli_prompt(&s_cli);
+#if XF_SHELL_TX_RING_SIZE
+void xf_shell_cmd_init_tx(const char *prompt, xf_tx_write_t write, void *user_data,
+                          xf_shell_tx_policy_t policy)
+{
+    xf_shell_tx_init(&s_tx, write, user_data, policy);
+    xf_cli_init_write(&s_cli, prompt, xf_shell_tx_write, &s_tx);
+    shell_start();
+}
+
+size_t xf_shell_tx_pump(void)
+{
+    xf_cli_flush(&s_cli);
+    return xf_shell_tx_drain(&s_tx);
+}
+
+uint32_t xf_shell_tx_dropped(void)
+{
+    return s_tx.dropped;
 }
+#endif
 
 void xf_shell_cmd_handle(xf_getc_t getc)
 {
-    int cli_argc;
-    char **cli_argv;
-    char ch = getc();
+#if XF_SHELL_RX_RING_SIZE
+    if (getc == NULL) {
+        xf_shell_cmd_process();
+        return;
+    }
+#endif
+    shell_settle();
+    SHELL_JOBS_REPORT();
+    SHELL_SCHED_RUN();
+    SHELL_SUBMIT_RUN();
+#if XF_SHELL_ASYNC_CMD
+    if (s_async != NULL) {
+        // A key has nowhere to wait meanwhile, only Ctrl-C counts
+        if (getc() == '\x03') {
+            s_cancelled = true;
+        }
+        (void)shell_async_step();
+        xf_cli_flush(&s_cli);
+        return;
+    }
+#endif
+    shell_handle_char(getc());
+    (void)shell_take_interrupt();
+    xf_cli_flush(&s_cli);
+}
 
-    if (ch == '\t') {
-#if XF_SHELL_COMPLETION_ENABLE
-        if (xf_shell_completion_handle_tab(&s_cli, s_cmd_table, (int)s_cmd_count,
-                                           s_matches, XF_SHELL_MAX_MATCHES)) {
-            return;
+#if XF_SHELL_RX_RING_SIZE
+void xf_shell_cmd_process(void)
+{
+    size_t budget = XF_SHELL_RX_RING_SIZE;
+    const char *data;
+    size_t n;
+
+    shell_settle();
+    SHELL_JOBS_REPORT();
+    SHELL_SCHED_RUN();
+    SHELL_SUBMIT_RUN();
+#if XF_SHELL_ASYNC_CMD
+    // Type-ahead waits in the ring until the pending command has finished
+    if (shell_async_step()) {
+        xf_cli_flush(&s_cli);
+        return;
+    }
+#endif
+    // At most one lap, so a busy producer cannot keep us here forever
+    while (budget > 0 && !SHELL_PENDING() && (n = xf_shell_rx_peek(&data)) > 0) {
+        if (n > budget) {
+            n = budget;
+        }
+        n = shell_feed(data, n);
+        if (!shell_take_interrupt()) {
+            xf_shell_rx_consume(n);
+        }
+        budget -= n;
+    }
+    // Output queued outside of feed (xf_shell_puts) is pending work as well
+    xf_cli_flush(&s_cli);
+}
+
+bool xf_shell_cmd_poll(uint32_t budget)
+{
+#ifdef XF_SHELL_POLL_CLOCK
+    uint32_t start = (uint32_t)XF_SHELL_POLL_CLOCK();
+#else
+    uint32_t used = 0;
+#endif
+    const char *data;
+    size_t n;
+
+    s_budgeted = true;
+    SHELL_JOBS_REPORT();
+    SHELL_SCHED_RUN();
+    SHELL_SUBMIT_RUN();
+    // Always make some progress, even with a zero budget
+    do {
+        if (s_cli.job != NULL) {
+            (void)shell_job_step();
+#ifndef XF_SHELL_POLL_CLOCK
+            used++;
+#endif
+            continue;
+        }
+#if XF_SHELL_ASYNC_CMD
+        if (s_async != NULL) {
+            (void)shell_async_step();
+#ifndef XF_SHELL_POLL_CLOCK
+            used++;
+#endif
+            continue;
+        }
+#endif
+        n = xf_shell_rx_peek(&data);
+        if (n == 0) {
+            break;
+        }
+#ifndef XF_SHELL_POLL_CLOCK
+        if (used < budget && n > budget - used) {
+            n = budget - used;
+        } else if (used >= budget) {
+            n = 1;
+        }
+#endif
+        n = shell_feed(data, n);
+        if (!shell_take_interrupt()) {
+            xf_shell_rx_consume(n);
         }
+#ifndef XF_SHELL_POLL_CLOCK
+        used += (uint32_t)n;
+    } while (used < budget);
 #else
+    } while ((uint32_t)((uint32_t)XF_SHELL_POLL_CLOCK() - start) < budget);
+#endif
+    s_budgeted = false;
+
+    xf_cli_flush(&s_cli);
+    return xf_shell_has_pending_work();
+}
+#endif
+
+void xf_shell_cmd_feed(const char *buf, size_t len)
+{
+    size_t n;
+
+    if (buf == NULL) {
+        return;
+    }
+
+#if XF_SHELL_ASYNC_CMD && XF_SHELL_RX_RING_SIZE
+    // Input behind a pending command waits in the ring, as if it had arrived there
+    if (s_async != NULL || xf_shell_rx_available()) {
+        (void)xf_shell_rx_write(buf, len);
+        xf_shell_cmd_process();
+        return;
+    }
+#endif
+    shell_settle();
+    SHELL_JOBS_REPORT();
+    SHELL_SCHED_RUN();
+    SHELL_SUBMIT_RUN();
+#if XF_SHELL_ASYNC_CMD && !XF_SHELL_RX_RING_SIZE
+    // Left pending by xf_shell_cmd_handle(), the input has nowhere to wait meanwhile
+    if (s_async != NULL) {
+        if (memchr(buf, '\x03', len) != NULL) {
+            s_cancelled = true;
+        }
+        (void)shell_async_step();
+        xf_cli_flush(&s_cli);
         return;
+    }
+    // Nor has the rest of buf, so the commands in it run to their end in place
+    s_feed_inline = true;
 #endif
+    n = shell_feed(buf, len);
+#if XF_SHELL_ASYNC_CMD && !XF_SHELL_RX_RING_SIZE
+    s_feed_inline = false;
+#endif
+#if XF_SHELL_ASYNC_CMD && XF_SHELL_RX_RING_SIZE
+    if (!shell_take_interrupt() && n < len) {
+        (void)xf_shell_rx_write(&buf[n], len - n);
     }
+#else
+    (void)n;
+    (void)shell_take_interrupt();
+#endif
+    xf_cli_flush(&s_cli);
+}
 
-    if (xf_cli_insert_char(&s_cli, ch)) {
-        cli_argc = xf_cli_argc(&s_cli, &cli_argv);
-        if (xf_shell_cmd_run(cli_argc, (const char **)cli_argv)
-            == XF_CMD_NOT_SUPPORTED && cli_argv[0] != NULL) {
-            cli_puts(&s_cli, "command not found: ");
-            cli_puts(&s_cli, cli_argv[0]);
-            cli_puts(&s_cli, XF_SHELL_NEWLINE);
+/*
+ * Feed input until it runs out, a byte leaves an output job or a command
+ * pending, or a command was interrupted (the rest of the input is
+ * type-ahead to drop)
+ */
+static size_t shell_feed(const char *buf, size_t len)
+{
+    size_t i = 0;
+
+#if XF_SHELL_FRAME_SIZE
+    if (s_frame) {
+        return shell_frame_feed(buf, len);
+    }
+#endif
+    while (i < len && s_cli.job == NULL && !SHELL_PENDING() && !SHELL_INTERRUPTED()) {
+        size_t run;
+        int used = 0;
+
+        // Printable text is inserted and echoed as one run
+        run = (size_t)xf_cli_scan_run(&s_cli, &buf[i],
+                                      (int)(len - i > INT_MAX ? INT_MAX : len - i));
+        if (run > 0) {
+            used = xf_cli_insert_run(&s_cli, &buf[i], (int)run);
         }
+        if (used == 0) {
+            shell_handle_char(buf[i]);
+            used = 1;
+        }
+        i += (size_t)used;
+    }
+    return i;
+}
+
+void xf_shell_set_notify(xf_shell_notify_t notify, void *user_data)
+{
+    s_notify_data = user_data;
+    s_notify = notify;
+}
+
+void xf_shell_wakeup(void)
+{
+    xf_shell_notify_t notify = s_notify;
+
+    if (notify != NULL) {
+        notify(s_notify_data);
+    }
+}
+
+#if XF_SHELL_TIMERS
+void xf_shell_tick(uint32_t ms)
+{
+    uint32_t now = s_now + ms;
+
+    s_now = now;
+    if (s_armed && (int32_t)(now - s_due) >= 0) {
+        xf_shell_wakeup();
+    }
+}
+
+uint32_t xf_shell_next_timeout(void)
+{
+    int32_t left;
 
+    if (!s_armed) {
+        return UINT32_MAX;
+    }
+    left = (int32_t)(s_due - s_now);
+    return left > 0 ? (uint32_t)left : 0U;
+}
+#endif
+
+#if XF_SHELL_PIPE_MODE
+void xf_shell_set_mode(xf_shell_mode_t mode)
+{
+    bool pipe = (mode != XF_SHELL_MODE_INTERACTIVE);
+#if XF_SHELL_FRAME_SIZE
+    bool frame = (mode == XF_SHELL_MODE_FRAME);
+
+    if (frame != s_frame) {
+        s_frame = frame;
+        // A frame cut short by the switch is not picked up again later
+        s_frame_rx.fill = 0;
+        s_frame_rx.ready = false;
+#if XF_SHELL_RX_RING_SIZE
+        xf_shell_rx_set_binary(frame);
+#endif
+    }
+#endif
+    if (pipe == s_pipe) {
+        return;
+    }
+    s_pipe = pipe;
+    xf_cli_set_raw(&s_cli, pipe);
+    // Back on a terminal, the editor needs its prompt again
+    if (s_started && !pipe) {
+        xf_cli_enable_paste(&s_cli);
         xf_cli_prompt(&s_cli);
     }
 }
 
+xf_shell_mode_t xf_shell_get_mode(void)
+{
+#if XF_SHELL_FRAME_SIZE
+    if (s_frame) {
+        return XF_SHELL_MODE_FRAME;
+    }
+#endif
+    return s_pipe ? XF_SHELL_MODE_PIPE : XF_SHELL_MODE_INTERACTIVE;
+}
+
+#if XF_SHELL_FRAME_SIZE
+uint32_t xf_shell_frame_dropped(void)
+{
+    return s_frame_rx.dropped;
+}
+#endif
+#endif
+
+bool xf_shell_has_pending_work(void)
+{
+    // A command waiting for its next run leaves the task asleep until then
+    if (s_cli.job != NULL || s_prompt_pending || (SHELL_PENDING() && !SHELL_SLEEPING())) {
+        return true;
+    }
+#if XF_SHELL_BG_JOBS
+    if (xf_shell_job_pending()) {
+        return true;
+    }
+#endif
+#if XF_SHELL_SCHED_ENTRIES
+    if (shell_sched_due()) {
+        return true;
+    }
+#endif
+#if XF_SHELL_SUBMIT_SLOTS
+    if (!SHELL_PENDING() && xf_shell_submit_peek() != NULL) {
+        return true;
+    }
+#endif
+#if XF_SHELL_RX_RING_SIZE
+    if (xf_shell_rx_available()) {
+        return true;
+    }
+#endif
+#if XF_SHELL_TX_RING_SIZE
+    if (s_tx.count > 0) {
+        return true;
+    }
+#endif
+    return s_cli.out_len > 0;
+}
+
 int xf_shell_cmd_set_table(xf_shell_cmd_t *const *cmd_table, uint16_t cmd_count)
 {
     if (cmd_count > 0U && cmd_table == NULL) {
@@ -140,10 +655,77 @@ int xf_shell_cmd_set_arg_candidates(xf_arg_t *arg,
     return XF_CMD_OK;
 }
 
+int xf_shell_exec_line(const char *line, size_t len)
+{
+    char text[XF_CLI_MAX_LINE];
+    char *argv[XF_CLI_MAX_ARGC];
+    shell_chain_t chain;
+    int argc;
+    int ret;
+
+#if XF_SHELL_BG_JOBS
+    if (xf_shell_job_self()) {
+        return XF_CMD_NOT_SUPPORTED;
+    }
+#endif
+    if (line == NULL && len > 0) {
+        return XF_CMD_NO_INVALID_ARG;
+    }
+    if (len >= sizeof(text)) {
+        xf_cli_puts(&s_cli, "line too long" XF_SHELL_NEWLINE);
+        xf_cli_flush(&s_cli);
+        return XF_CMD_NO_MEM;
+    }
+    // The caller's line stays intact, argv needs nul terminated words
+    memcpy(text, line, len);
+    text[len] = '\0';
+
+    argc = xf_shell_tokenize(text, (int)len, argv, XF_CLI_MAX_ARGC);
+    if (argc == 0) {
+        return XF_CMD_OK;
+    }
+    if (argc < 0) {
+        xf_cli_puts(&s_cli, "too many words" XF_SHELL_NEWLINE);
+        xf_cli_flush(&s_cli);
+        return XF_CMD_NO_INVALID_ARG;
+    }
+    ret = shell_chain_begin(&chain, argc, (const char **)argv, false);
+    // The caller may report the result with its own output
+    xf_cli_flush(&s_cli);
+    return ret;
+}
+
 int xf_shell_cmd_run(int argc, const char **argv)
 {
     cmd_item_t *item;
+    int ret;
+    bool defer;
+#if XF_SHELL_ASYNC_CMD
+    bool may_pend;
+#endif
+    bool resumed;
+#if XF_SHELL_EMIT_DEPTH
+    xf_shell_emit_t emit;
+#endif
+
+#if XF_SHELL_BG_JOBS
+    // The shell state belongs to the shell task, not to a worker
+    if (xf_shell_job_self()) {
+        return XF_CMD_NOT_SUPPORTED;
+    }
+#endif
+    // Only the line being polled may leave its output job to later calls
+    defer = s_defer_job;
+#if XF_SHELL_ASYNC_CMD
+    may_pend = s_may_pend;
+#endif
+    // Run from a resumed handler, this command still starts afresh
+    resumed = s_resumed;
 
+    s_defer_job = false;
+#if XF_SHELL_ASYNC_CMD
+    s_may_pend = false;
+#endif
     if (argc <= 0 || argv == NULL || argv[0] == NULL) {
         return XF_CMD_NOT_SUPPORTED;
     }
@@ -152,32 +734,213 @@ int xf_shell_cmd_run(int argc, const char **argv)
     if (item == NULL) {
         return XF_CMD_NOT_SUPPORTED;
     }
+#if SHELL_TAIL_CMDS
+    // These parse their own words only, the command after them is theirs
+    if (shell_takes_command(item)) {
+        argc = shell_tail_words(item, argc, argv);
+    }
+#endif
 
-    return xf_shell_parser_run(item, argc, argv, cli_puts_adapter, &s_cli);
+    // Shell output must reach the terminal before the command's own output,
+    // which may bypass the shell
+    xf_cli_flush(&s_cli);
+#if XF_SHELL_RX_RING_SIZE
+    xf_shell_rx_command_begin();
+#endif
+    s_resumed = false;
+#if XF_SHELL_EMIT_DEPTH
+    // Run from a handler, this command's output is a document of its own
+    emit = s_emit;
+    xf_shell_emit_reset(&s_emit, (uint8_t)xf_shell_get_format());
+#endif
+#if XF_SHELL_ASYNC_CMD
+    s_pend_top = may_pend;
+#endif
+    ret = xf_shell_parser_run(item, argc, argv, cli_puts_adapter, &s_cli);
+#if XF_SHELL_ASYNC_CMD
+    if (ret == XF_CMD_PENDING && may_pend) {
+        // Ctrl-C stays out of band until the last step, see shell_async_step()
+        s_async = item;
+        xf_cli_flush(&s_cli);
+        return XF_CMD_PENDING;
+    }
+#endif
+    // Run from code, a pending command is stepped to its end right here
+    while (ret == XF_CMD_PENDING) {
+        xf_cli_flush(&s_cli);
+        ret = shell_async_call(item);
+    }
+#if XF_SHELL_EMIT_DEPTH
+    xf_shell_emit_finish(&s_emit);
+    s_emit = emit;
+#endif
+    s_resumed = resumed;
+#if XF_SHELL_RX_RING_SIZE
+    xf_shell_rx_command_end();
+#endif
+    if (!defer) {
+        while (xf_cli_job_step(&s_cli)) {
+        }
+    }
+    xf_cli_flush(&s_cli);
+    return ret;
 }
 
-int xf_shell_cmd_get_int(const xf_cmd_args_t *cmd, const char *long_opt,
-                         int32_t *value)
+#if XF_CLI_CAPTURE
+int xf_shell_cmd_run_capture(int argc, const char **argv, char *buf, size_t cap, size_t *len)
 {
-    return xf_shell_parser_get_int(cmd, long_opt, value);
+    struct xf_cli_capture outer;
+    char none;
+    size_t n;
+    int ret;
+
+#if XF_SHELL_BG_JOBS
+    if (xf_shell_job_self()) {
+        return XF_CMD_NOT_SUPPORTED;
+    }
+#endif
+    if (buf == NULL && cap > 0) {
+        return XF_CMD_NO_INVALID_ARG;
+    }
+    // An output job still going to the terminal must not end up in buf
+    while (xf_cli_job_step(&s_cli)) {
+    }
+    outer = s_cli.cap;
+    xf_cli_capture_begin(&s_cli, cap > 0 ? buf : &none, cap > 0 ? cap - 1 : 0);
+    ret = xf_shell_cmd_run(argc, argv);
+    n = xf_cli_capture_end(&s_cli);
+    s_cli.cap = outer;
+    if (cap > 0) {
+        buf[n] = '\0';
+    }
+    if (len != NULL) {
+        *len = n;
+    }
+    return ret;
 }
 
-int xf_shell_cmd_get_bool(const xf_cmd_args_t *cmd, const char *long_opt,
-                          bool *value)
+int xf_shell_cmd_run_stream(int argc, const char **argv, xf_write_t write, void *user_data)
 {
-    return xf_shell_parser_get_bool(cmd, long_opt, value);
+    struct xf_cli_capture outer;
+    int ret;
+
+#if XF_SHELL_BG_JOBS
+    if (xf_shell_job_self()) {
+        return XF_CMD_NOT_SUPPORTED;
+    }
+#endif
+    if (write == NULL) {
+        return XF_CMD_NO_INVALID_ARG;
+    }
+    while (xf_cli_job_step(&s_cli)) {
+    }
+    outer = s_cli.cap;
+    xf_cli_capture_stream(&s_cli, write, user_data);
+    ret = xf_shell_cmd_run(argc, argv);
+    (void)xf_cli_capture_end(&s_cli);
+    s_cli.cap = outer;
+    return ret;
 }
+#endif
 
-int xf_shell_cmd_get_float(const xf_cmd_args_t *cmd, const char *long_opt,
-                           float *value)
+void xf_shell_write(const char *data, size_t len)
 {
-    return xf_shell_parser_get_float(cmd, long_opt, value);
+    if (data == NULL) {
+        return;
+    }
+#if XF_SHELL_BG_JOBS
+    // From a background job the output goes out a tagged line at a time
+    if (xf_shell_job_write(data, len)) {
+        return;
+    }
+#endif
+    xf_cli_write(&s_cli, data, len);
 }
 
-int xf_shell_cmd_get_string(const xf_cmd_args_t *cmd,
-                            const char *long_opt, const char **value)
+#if XF_SHELL_EMIT_DEPTH
+xf_shell_emit_t *xf_shell_emit_state(void)
 {
-    return xf_shell_parser_get_string(cmd, long_opt, value);
+#if XF_SHELL_BG_JOBS
+    xf_shell_emit_t *job = xf_shell_job_emit();
+
+    if (job != NULL) {
+        return job;
+    }
+#endif
+    return &s_emit;
+}
+
+void xf_shell_emit_write(const char *data, size_t len)
+{
+#if XF_SHELL_BG_JOBS
+    if (xf_shell_job_write(data, len)) {
+        return;
+    }
+#endif
+    xf_cli_write_raw(&s_cli, data, len);
+}
+#endif
+
+void xf_shell_puts(const char *s)
+{
+    if (s != NULL) {
+        xf_shell_write(s, strlen(s));
+    }
+}
+
+void xf_shell_flush(void)
+{
+#if XF_SHELL_BG_JOBS
+    if (xf_shell_job_self()) {
+        return;
+    }
+#endif
+    xf_cli_flush(&s_cli);
+}
+
+int xf_shell_cmd_get_int(const xf_cmd_args_t *cmd, const char *long_opt,
+                         int32_t *value)
+{
+    return xf_shell_parser_get_int(cmd, long_opt, value);
+}
+
+int xf_shell_cmd_get_bool(const xf_cmd_args_t *cmd, const char *long_opt,
+                          bool *value)
+{
+    return xf_shell_parser_get_bool(cmd, long_opt, value);
+}
+
+int xf_shell_cmd_get_float(const xf_cmd_args_t *cmd, const char *long_opt,
+                           float *value)
+{
+    return xf_shell_parser_get_float(cmd, long_opt, value);
+}
+
+int xf_shell_cmd_get_string(const xf_cmd_args_t *cmd,
+                            const char *long_opt, const char **value)
+{
+    return xf_shell_parser_get_string(cmd, long_opt, value);
+}
+
+bool xf_shell_cmd_resumed(void)
+{
+#if XF_SHELL_BG_JOBS
+    if (xf_shell_job_self()) {
+        return xf_shell_job_resumed();
+    }
+#endif
+    return s_resumed;
+}
+
+bool xf_shell_cmd_cancelled(void)
+{
+#if XF_SHELL_BG_JOBS
+    // A background job is cancelled by kill, from then on
+    if (xf_shell_job_self()) {
+        return xf_shell_job_killed();
+    }
+#endif
+    return s_cancelled;
 }
 
 /* ==================== [Static Functions] ================================== */
@@ -206,6 +969,146 @@ static void xf_shell_register_history_cmd(void)
 }
 #endif
 
+#if XF_SHELL_BG_JOBS
+static void xf_shell_register_job_cmds(void)
+{
+    static xf_arg_t s_wait_job = {
+        .name = "job",
+        .description = "Job number, all jobs if omitted",
+        .type = XF_OPTION_TYPE_INT,
+        .has_default = true,
+        .default_integer = 0,
+    };
+    static xf_arg_t s_kill_job = {
+        .name = "job",
+        .description = "Job number",
+        .type = XF_OPTION_TYPE_INT,
+        .require = true,
+    };
+    static xf_arg_t *s_wait_args[] = { &s_wait_job };
+    static xf_arg_t *s_kill_args[] = { &s_kill_job };
+    static xf_shell_cmd_t s_jobs_cmd = {
+        .command = "jobs",
+        .help = "List background jobs",
+        .func = jobs_command,
+    };
+    static xf_shell_cmd_t s_wait_cmd = {
+        .command = "wait",
+        .help = "Wait for a background job, or all of them",
+        .func = wait_command,
+        ._arg_count = XF_SHELL_COUNT_OF(s_wait_args),
+        ._args = s_wait_args,
+    };
+    static xf_shell_cmd_t s_kill_cmd = {
+        .command = "kill",
+        .help = "Stop a background job",
+        .func = kill_command,
+        ._arg_count = XF_SHELL_COUNT_OF(s_kill_args),
+        ._args = s_kill_args,
+    };
+
+    (void)append_command_to_registry(&s_jobs_cmd);
+    (void)append_command_to_registry(&s_wait_cmd);
+    (void)append_command_to_registry(&s_kill_cmd);
+}
+#endif
+
+#if XF_SHELL_WATCH_SIZE
+static void xf_shell_register_watch_cmd(void)
+{
+    static xf_opt_arg_t s_watch_interval = {
+        .long_opt = "interval",
+        .short_opt = 'n',
+        .description = "Milliseconds between runs",
+        .type = XF_OPTION_TYPE_INT,
+        .has_default = true,
+        .validator = watch_interval_valid,
+        .default_integer = 1000,
+    };
+    static xf_arg_t s_watch_command = {
+        .name = "command",
+        .description = "Command to run, followed by its own arguments",
+        .type = XF_OPTION_TYPE_STRING,
+        .require = true,
+    };
+    static xf_opt_arg_t *s_watch_opts[] = { &s_watch_interval };
+    static xf_arg_t *s_watch_args[] = { &s_watch_command };
+    static xf_shell_cmd_t s_watch_cmd = {
+        .command = "watch",
+        .help = "Run a command periodically, showing the lines that change",
+        .func = watch_command,
+        ._opt_count = XF_SHELL_COUNT_OF(s_watch_opts),
+        ._arg_count = XF_SHELL_COUNT_OF(s_watch_args),
+        ._opts = s_watch_opts,
+        ._args = s_watch_args,
+    };
+
+    (void)append_command_to_registry(&s_watch_cmd);
+}
+#endif
+
+#if XF_SHELL_SCHED_ENTRIES
+static void xf_shell_register_sched_cmds(void)
+{
+    static xf_arg_t s_every_period = {
+        .name = "period",
+        .description = "Time between runs, e.g. 500ms, 10s, 5m or 1h",
+        .type = XF_OPTION_TYPE_STRING,
+        .require = true,
+        .validator = sched_time_valid,
+    };
+    static xf_arg_t s_at_delay = {
+        .name = "delay",
+        .description = "Time until the run, e.g. +10s",
+        .type = XF_OPTION_TYPE_STRING,
+        .require = true,
+        .validator = sched_time_valid,
+    };
+    static xf_arg_t s_sched_command = {
+        .name = "command",
+        .description = "Command to run, followed by its own arguments",
+        .type = XF_OPTION_TYPE_STRING,
+        .require = true,
+    };
+    static xf_opt_arg_t s_sched_delete = {
+        .long_opt = "delete",
+        .short_opt = 'd',
+        .description = "Remove the entry with this number",
+        .type = XF_OPTION_TYPE_INT,
+        .has_default = true,
+        .default_integer = 0,
+    };
+    static xf_arg_t *s_every_args[] = { &s_every_period, &s_sched_command };
+    static xf_arg_t *s_at_args[] = { &s_at_delay, &s_sched_command };
+    static xf_opt_arg_t *s_sched_opts[] = { &s_sched_delete };
+    static xf_shell_cmd_t s_every_cmd = {
+        .command = "every",
+        .help = "Run a command periodically from the shell task",
+        .func = every_command,
+        ._arg_count = XF_SHELL_COUNT_OF(s_every_args),
+        ._args = s_every_args,
+    };
+    static xf_shell_cmd_t s_at_cmd = {
+        .command = "at",
+        .help = "Run a command once after a delay",
+        .func = at_command,
+        ._arg_count = XF_SHELL_COUNT_OF(s_at_args),
+        ._args = s_at_args,
+    };
+    static xf_shell_cmd_t s_sched_cmd = {
+        .command = "sched",
+        .help = "List scheduled commands, or remove one",
+        .func = sched_command,
+        ._opt_count = XF_SHELL_COUNT_OF(s_sched_opts),
+        ._opts = s_sched_opts,
+    };
+
+    (void)append_command_to_registry(&s_every_cmd);
+    (void)append_command_to_registry(&s_at_cmd);
+    (void)append_command_to_registry(&s_sched_cmd);
+}
+#endif
+
 static int import_static_command_table(void)
 {
     uint16_t i;
@@ -296,6 +1199,322 @@ static bool is_whitespace_char(char ch)
     return (ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r');
 }
 
+static void shell_start(void)
+{
+    s_cmd_count = 0;
+    xf_shell_register_help_cmd();
+#if XF_CLI_HISTORY_LEN
+    xf_shell_register_history_cmd();
+#endif
+#if XF_SHELL_BG_JOBS
+    xf_shell_register_job_cmds();
+#endif
+#if XF_SHELL_WATCH_SIZE
+    xf_shell_register_watch_cmd();
+#endif
+#if XF_SHELL_SCHED_ENTRIES
+    xf_shell_register_sched_cmds();
+#endif
+    (void)import_static_command_table();
+
+#if XF_SHELL_PIPE_MODE
+    s_started = true;
+    xf_cli_set_raw(&s_cli, s_pipe);
+    if (s_pipe) {
+        return;
+    }
+#endif
+    xf_cli_enable_paste(&s_cli);
+    xf_cli_prompt(&s_cli);
+}
+
+static void shell_handle_char(char ch)
+{
+    int cli_argc;
+    int ret;
+
+#if XF_SHELL_FRAME_SIZE
+    if (s_frame) {
+        (void)shell_frame_feed(&ch, 1);
+        return;
+    }
+#endif
+    if (ch == '\t' && !SHELL_PIPE()) {
+#if XF_SHELL_COMPLETION_ENABLE
+        if (xf_shell_completion_handle_tab(&s_cli, s_cmd_table, (int)s_cmd_count,
+                                           s_matches, XF_SHELL_MAX_MATCHES)) {
+            shell_settle();
+            return;
+        }
+#else
+        return;
+#endif
+    }
+
+    if (xf_cli_insert_char(&s_cli, ch)) {
+        cli_argc = xf_cli_argc(&s_cli, s_line_argv);
+        // A pipe gets no prompt, so a blank line produces no output at all
+        if (SHELL_PIPE() && cli_argc == 0) {
+            return;
+        }
+        if (cli_argc < 0) {
+#if XF_SHELL_PIPE_MODE
+            if (s_cli.overflow) {
+                xf_cli_puts(&s_cli, "line too long" XF_SHELL_NEWLINE);
+                ret = XF_CMD_NO_MEM;
+            } else
+#endif
+            {
+                xf_cli_puts(&s_cli, "too many words" XF_SHELL_NEWLINE);
+                ret = XF_CMD_NO_INVALID_ARG;
+            }
+        } else {
+            ret = shell_chain_begin(&s_line, cli_argc, (const char **)s_line_argv, true);
+            // The line goes on, and the prompt follows, once the command is done
+            if (ret == XF_CMD_PENDING) {
+                return;
+            }
+        }
+        shell_line_done(ret);
+    }
+}
+
+/* Report a Ctrl-C, then the prompt or end marker once the output is out */
+static void shell_line_done(int ret)
+{
+    if (ret == XF_CMD_INTERRUPTED || SHELL_INTERRUPTED()) {
+        xf_cli_puts(&s_cli, "^C" XF_SHELL_NEWLINE);
+    }
+#if XF_SHELL_PIPE_MODE
+    s_last_rc = ret;
+#endif
+    s_prompt_pending = true;
+    shell_settle();
+}
+
+/* Check a line of chained commands and run it, a malformed line runs nothing */
+static int shell_chain_begin(shell_chain_t *ch, int argc, const char **argv, bool top)
+{
+    const char *bad = shell_chain_error(argc, argv);
+
+    if (bad != NULL) {
+        xf_cli_puts(&s_cli, "syntax error near: ");
+        xf_cli_puts(&s_cli, bad);
+        xf_cli_puts(&s_cli, XF_SHELL_NEWLINE);
+        return XF_CMD_NO_INVALID_ARG;
+    }
+    ch->argv = argv;
+    ch->argc = argc;
+    ch->start = 0;
+    ch->op = XF_SHELL_CHAIN_SEQ;
+    ch->ret = XF_CMD_OK;
+    ch->top = top;
+#if XF_SHELL_RX_RING_SIZE
+    // A Ctrl-C between two commands still stops the rest of the line
+    xf_shell_rx_command_begin();
+#endif
+    return shell_chain_run(ch);
+}
+
+/*
+ * Run the commands of a line joined by ';', '&&' and '||'. As in a POSIX
+ * and-or list, '&&' goes on after a success, '||' after a failure and ';'
+ * always; a skipped command keeps the status of the last one that ran.
+ * A typed line stops at a pending command and goes on once it is done.
+ */
+static int shell_chain_run(shell_chain_t *ch)
+{
+    int i;
+
+    for (i = ch->start;
+         i <= ch->argc && ch->ret != XF_CMD_INTERRUPTED && !SHELL_INTERRUPTED(); i++) {
+        uint8_t next = (i < ch->argc) ? xf_shell_chain_op(ch->argv[i]) : XF_SHELL_CHAIN_SEQ;
+        int start = ch->start;
+        bool run;
+
+        if (next == XF_SHELL_CHAIN_NONE) {
+            continue;
+        }
+        run = i > start && (ch->op == XF_SHELL_CHAIN_SEQ ||
+                            (ch->op == XF_SHELL_CHAIN_AND) == (ch->ret == XF_CMD_OK));
+        // Whatever follows a background command runs, as after ';'
+        ch->op = (next == XF_SHELL_CHAIN_BG) ? XF_SHELL_CHAIN_SEQ : next;
+        ch->start = i + 1;
+        if (!run) {
+            continue;
+        }
+
+        ch->argv[i] = NULL;
+#if XF_SHELL_BG_JOBS
+        if (next == XF_SHELL_CHAIN_BG) {
+            ch->ret = shell_job_launch(i - start, &ch->argv[start]);
+        } else
+#endif
+        {
+            // Only the last command may leave its output job to later polls
+            s_defer_job = ch->top && s_budgeted && i == ch->argc;
+#if XF_SHELL_ASYNC_CMD
+#if XF_SHELL_RX_RING_SIZE
+            s_may_pend = ch->top;
+#else
+            s_may_pend = ch->top && !s_feed_inline;
+#endif
+#endif
+            ch->ret = xf_shell_cmd_run(i - start, &ch->argv[start]);
+        }
+        if (ch->ret == XF_CMD_PENDING) {
+            return XF_CMD_PENDING;
+        }
+        if (ch->ret == XF_CMD_NOT_SUPPORTED) {
+            xf_cli_puts(&s_cli, "command not found: ");
+            xf_cli_puts(&s_cli, ch->argv[start]);
+            xf_cli_puts(&s_cli, XF_SHELL_NEWLINE);
+        }
+    }
+#if XF_SHELL_RX_RING_SIZE
+    xf_shell_rx_command_end();
+#endif
+    return ch->ret;
+}
+
+/*
+ * The operator a line cannot run with, e.g. "&& a" or "a ||", else NULL.
+ * Only a whole command goes to the background, so "a && b &" is refused
+ * rather than run differently from a POSIX shell.
+ */
+static const char *shell_chain_error(int argc, const char **argv)
+{
+    bool empty = true;
+    bool first = true; /* the command starts an and-or list */
+    uint8_t op = XF_SHELL_CHAIN_NONE;
+    int i;
+
+    for (i = 0; i < argc; i++) {
+        op = xf_shell_chain_op(argv[i]);
+        if (op == XF_SHELL_CHAIN_NONE) {
+            empty = false;
+            continue;
+        }
+        if (empty || (op == XF_SHELL_CHAIN_BG && (!first || !XF_SHELL_BG_JOBS))) {
+            return argv[i];
+        }
+        first = (op == XF_SHELL_CHAIN_SEQ || op == XF_SHELL_CHAIN_BG);
+        empty = true;
+    }
+    // Only ';' may end a line
+    if (op == XF_SHELL_CHAIN_AND || op == XF_SHELL_CHAIN_OR) {
+        return argv[argc - 1];
+    }
+    return NULL;
+}
+
+/* Call a handler that returned XF_CMD_PENDING once more */
+static int shell_async_call(cmd_item_t *item)
+{
+    int ret;
+
+    s_cancelled = s_cancelled || SHELL_INTERRUPTED();
+    s_resumed = true;
+#if XF_SHELL_TIMERS
+    s_sleeping = false;
+#endif
+    ret = item->func((const xf_cmd_args_t *)item);
+    // A cancelled command is done whatever it returns
+    if (s_cancelled) {
+        s_cancelled = false;
+        ret = XF_CMD_INTERRUPTED;
+    }
+    return ret;
+}
+
+#if XF_SHELL_ASYNC_CMD
+/* Step the command the line left pending, then the rest of the line; true while pending */
+static bool shell_async_step(void)
+{
+    int ret;
+
+    if (s_async == NULL) {
+        return false;
+    }
+    ret = shell_async_call(s_async);
+    s_resumed = false;
+    if (ret == XF_CMD_PENDING) {
+        return true;
+    }
+
+    s_async = NULL;
+#if XF_SHELL_EMIT_DEPTH
+    xf_shell_emit_finish(&s_emit);
+#endif
+#if XF_SHELL_RX_RING_SIZE
+    xf_shell_rx_command_end();
+#endif
+#if XF_SHELL_TIMERS
+    // Scheduled commands waited for the shell to be free
+    shell_timers_arm();
+#endif
+    while (xf_cli_job_step(&s_cli)) {
+    }
+    s_line.ret = ret;
+    ret = shell_chain_run(&s_line);
+    if (ret == XF_CMD_PENDING) {
+        return true;
+    }
+    shell_line_done(ret);
+    (void)shell_take_interrupt();
+    return false;
+}
+#endif
+
+/* Run one step of the output job, then the deferred prompt once it is done */
+static bool shell_job_step(void)
+{
+    if (xf_cli_job_step(&s_cli)) {
+        return true;
+    }
+    if (s_prompt_pending) {
+        s_prompt_pending = false;
+        shell_prompt();
+    }
+    return false;
+}
+
+/* The prompt, or in pipe mode the end marker carrying the return code */
+static void shell_prompt(void)
+{
+#if XF_SHELL_PIPE_MODE
+    if (s_pipe) {
+        char mark[sizeof(XF_SHELL_PIPE_END_MARK) + sizeof(XF_SHELL_NEWLINE) + 11];
+
+        snprintf(mark, sizeof(mark), XF_SHELL_PIPE_END_MARK "%d" XF_SHELL_NEWLINE,
+                 s_last_rc);
+        xf_cli_puts(&s_cli, mark);
+        xf_cli_flush(&s_cli);
+        return;
+    }
+#endif
+    xf_cli_prompt(&s_cli);
+}
+
+/* Drop the type-ahead up to the Ctrl-C that stopped a command, if any */
+static bool shell_take_interrupt(void)
+{
+#if XF_SHELL_RX_RING_SIZE
+    return xf_shell_rx_discard_interrupted();
+#else
+    return false;
+#endif
+}
+
+/* Outside of xf_shell_cmd_poll() every job runs to completion right away */
+static void shell_settle(void)
+{
+    if (!s_budgeted || s_cli.job == NULL) {
+        while (shell_job_step()) {
+        }
+    }
+}
+
 static bool are_completion_candidates_valid(const char *const *candidates, uint16_t count)
 {
     uint16_t i;
@@ -324,76 +1543,908 @@ static bool are_completion_candidates_valid(const char *const *candidates, uint1
 
 static int help_command(const xf_cmd_args_t *cmd)
 {
-    uint16_t i;
-
     (void)cmd;
-    cli_puts(&s_cli, ">>>>>>>>>>> help <<<<<<<<<<<<" XF_SHELL_NEWLINE);
+    xf_cli_job_start(&s_cli, help_job, NULL);
+    return XF_CMD_OK;
+}
 
-    for (i = 0; i < s_cmd_count; ++i) {
-        cmd_item_t *it = s_cmd_table[i];
-        if (it == NULL || it->help == NULL) {
-            continue;
-        }
+/* One registered command per step */
+static bool help_job(struct xf_cli *cli, void *ctx, uint16_t step)
+{
+    cmd_item_t *it;
 
-        cli_puts(&s_cli, "\t");
-        cli_puts(&s_cli, it->command);
-        cli_puts(&s_cli, ":\t");
-        cli_puts(&s_cli, it->help);
-        cli_puts(&s_cli, XF_SHELL_NEWLINE);
+    (void)ctx;
+    if (step == 0) {
+        xf_cli_puts(cli, ">>>>>>>>>>> help <<<<<<<<<<<<" XF_SHELL_NEWLINE);
+        return s_cmd_count > 0;
     }
 
-    return XF_CMD_OK;
+    it = s_cmd_table[step - 1];
+    if (it != NULL && it->help != NULL) {
+        xf_cli_puts(cli, "\t");
+        xf_cli_puts(cli, it->command);
+        xf_cli_puts(cli, ":\t");
+        xf_cli_puts(cli, it->help);
+        xf_cli_puts(cli, XF_SHELL_NEWLINE);
+    }
+    return step < s_cmd_count;
 }
 
 #if XF_CLI_HISTORY_LEN
 static int history_command(const xf_cmd_args_t *cmd)
 {
-    int i;
+    (void)cmd;
+    xf_cli_job_start(&s_cli, history_job, NULL);
+    return XF_CMD_OK;
+}
+
+/* One history entry per step */
+static bool history_job(struct xf_cli *cli, void *ctx, uint16_t step)
+{
     const char *line;
     char buffer[32];
 
-    (void)cmd;
-    for (i = 0;; ++i) {
-        line = xf_cli_get_history(&s_cli, i);
-        if (line == NULL || line[0] == '\0') {
+    (void)ctx;
+    line = xf_cli_get_history(cli, step);
+    if (line == NULL || line[0] == '\0') {
+        if (step == 0) {
+            xf_cli_puts(cli, "history is empty" XF_SHELL_NEWLINE);
+        }
+        return false;
+    }
+    snprintf(buffer, sizeof(buffer), "\t[%d] ", (int)step);
+    xf_cli_puts(cli, buffer);
+    xf_cli_puts(cli, line);
+    xf_cli_puts(cli, XF_SHELL_NEWLINE);
+    return true;
+}
+#endif
+
+#if XF_SHELL_BG_JOBS
+/* Parse here, so a bad argument is reported at once, then hand the copy to a worker */
+static int shell_job_launch(int argc, const char **argv)
+{
+    cmd_item_t *item = find_command_by_name(argv[0]);
+    char text[16];
+    int ret;
+    int id;
+
+    if (item == NULL) {
+        return XF_CMD_NOT_SUPPORTED;
+    }
+    if (shell_is_builtin(item)) {
+        xf_cli_puts(&s_cli, "cannot run in the background: ");
+        xf_cli_puts(&s_cli, argv[0]);
+        xf_cli_puts(&s_cli, XF_SHELL_NEWLINE);
+        return XF_CMD_NO_INVALID_ARG;
+    }
+    ret = xf_shell_parser_parse(item, argc, argv, cli_puts_adapter, &s_cli);
+    if (ret == XF_SHELL_PARSER_HANDLED) {
+        return XF_CMD_OK;
+    }
+    if (ret != XF_CMD_OK) {
+        return ret;
+    }
+    ret = xf_shell_job_start(item, argc, argv, &id);
+    if (ret != XF_CMD_OK) {
+        xf_cli_puts(&s_cli, "no room for another job" XF_SHELL_NEWLINE);
+        return ret;
+    }
+    snprintf(text, sizeof(text), "[%d]" XF_SHELL_NEWLINE, id);
+    xf_cli_puts(&s_cli, text);
+    return XF_CMD_OK;
+}
+
+/* Built-ins drive the shell itself, which only the shell task may touch */
+static bool shell_is_builtin(const cmd_item_t *item)
+{
+    if (item->func == help_command || item->func == jobs_command ||
+        item->func == wait_command || item->func == kill_command) {
+        return true;
+    }
+#if SHELL_TAIL_CMDS
+    if (shell_takes_command(item)) {
+        return true;
+    }
+#endif
+#if XF_SHELL_SCHED_ENTRIES
+    if (item->func == sched_command) {
+        return true;
+    }
+#endif
+#if XF_CLI_HISTORY_LEN
+    if (item->func == history_command) {
+        return true;
+    }
+#endif
+    return false;
+}
+
+/*
+ * Print the lines background jobs wrote and, between commands, the notices
+ * of finished jobs; a pending `wait` reaps its job itself. At the prompt the
+ * line being edited is cleared first and drawn again below. At most one
+ * queue worth per call, so a chatty job cannot keep the shell here.
+ */
+static void shell_jobs_report(bool in_command)
+{
+    char buf[XF_CLI_OUT_BUF_SIZE];
+    xf_shell_job_info_t info;
+    size_t budget = XF_SHELL_BG_OUT_SIZE;
+    bool idle = !in_command && !SHELL_PENDING();
+    bool edit = idle && !SHELL_PIPE() && !s_prompt_pending;
+    bool erased = false;
+    size_t n = 0;
+    int id = 0;
+
+    if (s_cli.job != NULL || !xf_shell_job_pending()) {
+        return;
+    }
+    while (budget > 0) {
+        n = xf_shell_job_read(buf, budget < sizeof(buf) ? budget : sizeof(buf));
+        if (n == 0 && (!idle || (id = xf_shell_job_reap(0, &info)) == 0)) {
             break;
         }
-        snprintf(buffer, sizeof(buffer), "\t[%d] ", i);
-        cli_puts(&s_cli, buffer);
-        cli_puts(&s_cli, line);
-        cli_puts(&s_cli, XF_SHELL_NEWLINE);
+        if (edit && !erased) {
+            xf_cli_erase_line(&s_cli);
+            erased = true;
+        }
+        if (n > 0) {
+            xf_cli_write(&s_cli, buf, n);
+            budget -= n;
+        } else {
+            shell_job_line(id, &info);
+        }
+    }
+    if (erased) {
+        xf_cli_redraw(&s_cli);
+    }
+}
+
+/* One line of `jobs`, also the notice of a finished job */
+static void shell_job_line(int id, const xf_shell_job_info_t *info)
+{
+    char status[16];
+    char line[32];
+
+    if (info->state == XF_SHELL_JOB_QUEUED) {
+        snprintf(status, sizeof(status), "Queued");
+    } else if (info->state == XF_SHELL_JOB_RUNNING) {
+        snprintf(status, sizeof(status), "Running");
+    } else if (info->killed) {
+        snprintf(status, sizeof(status), "Killed");
+    } else if (info->ret == XF_CMD_OK) {
+        snprintf(status, sizeof(status), "Done");
+    } else {
+        snprintf(status, sizeof(status), "Exit %d", info->ret);
+    }
+    snprintf(line, sizeof(line), "[%d] %-8s ", id, status);
+    xf_cli_puts(&s_cli, line);
+    xf_cli_puts(&s_cli, info->text);
+    xf_cli_puts(&s_cli, XF_SHELL_NEWLINE);
+}
+
+static void shell_no_such_job(int32_t id)
+{
+    char text[32];
+
+    snprintf(text, sizeof(text), "no such job: %d" XF_SHELL_NEWLINE, (int)id);
+    xf_cli_puts(&s_cli, text);
+}
+
+static int jobs_command(const xf_cmd_args_t *cmd)
+{
+    xf_shell_job_info_t info;
+    int id;
+
+    (void)cmd;
+    for (id = 1; id <= XF_SHELL_BG_JOBS; id++) {
+        if (xf_shell_job_get(id, &info)) {
+            shell_job_line(id, &info);
+        }
+    }
+    return XF_CMD_OK;
+}
+
+/*
+ * Pending until the job, or every job, has finished, printing job output
+ * meanwhile. A waited-for job is reaped without a notice and its status
+ * becomes ours, as in a POSIX shell.
+ */
+static int wait_command(const xf_cmd_args_t *cmd)
+{
+    xf_shell_job_info_t info;
+    int32_t id = 0;
+
+    (void)xf_shell_cmd_get_int(cmd, "job", &id);
+    shell_jobs_report(true);
+    if (id != 0) {
+        if (xf_shell_job_reap((int)id, &info) != 0) {
+            return info.ret;
+        }
+        if (!xf_shell_job_get((int)id, &info)) {
+            shell_no_such_job(id);
+            return XF_CMD_NO_INVALID_ARG;
+        }
+    } else if (!xf_shell_job_busy()) {
+        // The jobs waited for get no notice, which would follow this command's end
+        while (xf_shell_job_reap(0, &info) != 0) {
+        }
+        // A job whose last lines are still queued is reaped on the next call
+        if (!xf_shell_job_pending()) {
+            return XF_CMD_OK;
+        }
     }
-    if (i == 0) {
-        cli_puts(&s_cli, "history is empty" XF_SHELL_NEWLINE);
+    if (xf_shell_cmd_cancelled()) {
+        return XF_CMD_INTERRUPTED;
+    }
+    // Stepped in place, e.g. with XF_SHELL_ASYNC_CMD off, sleep rather than spin
+    xf_shell_job_wait(1);
+    return XF_CMD_PENDING;
+}
+
+static int kill_command(const xf_cmd_args_t *cmd)
+{
+    int32_t id = 0;
+
+    (void)xf_shell_cmd_get_int(cmd, "job", &id);
+    if (xf_shell_job_kill((int)id) != XF_CMD_OK) {
+        shell_no_such_job(id);
+        return XF_CMD_NO_INVALID_ARG;
     }
     return XF_CMD_OK;
 }
 #endif
 
-static void cli_puts_adapter(void *ctx, const char *s)
+#if SHELL_TAIL_CMDS
+static bool shell_takes_command(const cmd_item_t *item)
 {
-    if (ctx == NULL || s == NULL) {
+#if XF_SHELL_WATCH_SIZE
+    if (item->func == watch_command) {
+        return true;
+    }
+#endif
+#if XF_SHELL_SCHED_ENTRIES
+    if (item->func == every_command || item->func == at_command) {
+        return true;
+    }
+#endif
+    return false;
+}
+
+/*
+ * The command is the last positional argument of watch, every and at.
+ * Their parser gets the words up to the command's name, the command's own
+ * words are left in s_tail; returns how many words to parse.
+ */
+static int shell_tail_words(const cmd_item_t *item, int argc, const char **argv)
+{
+    int left = item->_arg_count;
+    bool options = true;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        const char *w = argv[i];
+
+        if (options && w[0] == '-' && w[1] != '\0') {
+            if (strcmp(w, "--") == 0) {
+                options = false;
+            } else if (strchr(w, '=') == NULL && strcmp(w, "-h") != 0 &&
+                       strcmp(w, "--help") != 0) {
+                // As in the parser, an option without '=' takes the next word as its value
+                i++;
+            }
+            continue;
+        }
+        if (--left == 0) {
+            break;
+        }
+    }
+    if (i > argc) {
+        i = argc;
+    }
+    s_tail_argv = &argv[i];
+    s_tail_argc = argc - i;
+    return i < argc ? i + 1 : argc;
+}
+#endif
+
+#if XF_SHELL_TIMERS
+/*
+ * Point xf_shell_tick() at the next deadline: watch's next run, and the
+ * earliest scheduled command unless a pending command holds the shell.
+ */
+static void shell_timers_arm(void)
+{
+    uint32_t due = 0;
+    bool armed = false;
+#if XF_SHELL_SCHED_ENTRIES
+    uint32_t next;
+#endif
+
+#if XF_SHELL_WATCH_SIZE
+    if (s_watch.item != NULL) {
+        due = s_watch.due;
+        armed = true;
+    }
+#endif
+#if XF_SHELL_SCHED_ENTRIES
+    if (!SHELL_PENDING() && xf_shell_sched_next(&s_sched, &next) &&
+        (!armed || (int32_t)(next - due) < 0)) {
+        due = next;
+        armed = true;
+    }
+#endif
+    // The tick may come from an interrupt, never let it see a half update
+    s_armed = false;
+    s_due = due;
+    s_armed = armed;
+}
+#endif
+
+#if XF_SHELL_WATCH_SIZE
+/* Parse the command once, its handler is called with the same options on every run */
+static int shell_watch_start(const xf_cmd_args_t *cmd)
+{
+    shell_watch_t *w = &s_watch;
+    cmd_item_t *item = find_command_by_name(s_tail_argv[0]);
+    int32_t period = 0;
+    int ret;
+
+    // Stepped in place it would never return, only the line typed or piped in may watch
+    if (!s_pend_top) {
+        return XF_CMD_NOT_SUPPORTED;
+    }
+    (void)xf_shell_cmd_get_int(cmd, "interval", &period);
+    if (item == NULL || item->func == watch_command) {
+        xf_cli_puts(&s_cli, item == NULL ? "command not found: " : "cannot watch: ");
+        xf_cli_puts(&s_cli, s_tail_argv[0]);
+        xf_cli_puts(&s_cli, XF_SHELL_NEWLINE);
+        return XF_CMD_NO_INVALID_ARG;
+    }
+    ret = xf_shell_parser_parse(item, s_tail_argc, s_tail_argv, cli_puts_adapter, &s_cli);
+    if (ret != XF_CMD_OK) {
+        return ret == XF_SHELL_PARSER_HANDLED ? XF_CMD_OK : ret;
+    }
+    w->item = item;
+    w->argv = s_tail_argv;
+    w->argc = s_tail_argc;
+    w->period = (uint32_t)period;
+    w->due = s_now;
+    w->rows = 0;
+    w->shown = 0;
+    w->len[0] = 0;
+    w->pending = false;
+    return XF_CMD_PENDING;
+}
+
+/* Call the command once, appending its output to the frame being collected */
+static int shell_watch_call(shell_watch_t *w)
+{
+    uint8_t next = (uint8_t)(w->shown ^ 1U);
+    bool resumed = s_resumed;
+    struct xf_cli_capture outer;
+    int ret;
+
+    if (!w->pending) {
+        w->len[next] = 0;
+    }
+    // Output already being captured, e.g. by a frame CALL, goes on after this run
+    outer = s_cli.cap;
+    xf_cli_capture_begin(&s_cli, &w->frame[next][w->len[next]],
+                         sizeof(w->frame[next]) - w->len[next]);
+    if (!w->pending) {
+        shell_watch_header(w);
+#if XF_SHELL_EMIT_DEPTH
+        xf_shell_emit_reset(&s_emit, (uint8_t)xf_shell_get_format());
+#endif
+    }
+    s_resumed = w->pending;
+    ret = w->item->func((const xf_cmd_args_t *)w->item);
+    s_resumed = resumed;
+#if XF_SHELL_EMIT_DEPTH
+    if (ret != XF_CMD_PENDING) {
+        xf_shell_emit_finish(&s_emit);
+    }
+#endif
+    // The output job of e.g. help belongs to the frame as well
+    while (xf_cli_job_step(&s_cli)) {
+    }
+    w->len[next] += xf_cli_capture_end(&s_cli);
+    s_cli.cap = outer;
+    w->pending = (ret == XF_CMD_PENDING);
+    return ret;
+}
+
+static void shell_watch_header(const shell_watch_t *w)
+{
+    char text[24];
+    int i;
+
+    snprintf(text, sizeof(text), "Every %lums:", (unsigned long)w->period);
+    xf_cli_puts(&s_cli, text);
+    for (i = 0; i < w->argc; i++) {
+        xf_cli_putc(&s_cli, ' ');
+        xf_cli_puts(&s_cli, w->argv[i]);
+    }
+    xf_cli_puts(&s_cli, XF_SHELL_NEWLINE);
+}
+
+/*
+ * Take the terminal from the frame shown to the new one: rows that changed
+ * are rewritten in place, rows past the old frame are appended below. The
+ * cursor starts and ends at the start of the row below the frame. A pipe
+ * gets the whole frame instead, and only when it changed.
+ */
+static void shell_watch_draw(shell_watch_t *w)
+{
+    const char *old = w->frame[w->shown];
+    const char *now = w->frame[w->shown ^ 1U];
+    size_t old_len = w->len[w->shown];
+    size_t now_len = w->len[w->shown ^ 1U];
+    size_t op = 0;
+    size_t np = 0;
+    const char *o;
+    const char *n;
+    size_t on;
+    size_t nn;
+    int cur = (int)w->rows;
+    int row;
+
+    if (SHELL_PIPE()) {
+        if (w->rows > 0 && old_len == now_len && memcmp(old, now, now_len) == 0) {
+            return;
+        }
+        // Nothing to move over, rows only tells a first frame apart
+        w->rows = 1;
+        cur = 0;
+    }
+    for (row = 0; row < cur; row++) {
+        on = shell_frame_line(old, old_len, &op, &o);
+        nn = shell_frame_line(now, now_len, &np, &n);
+        if (on != nn || memcmp(o, n, nn) != 0) {
+            xf_cli_move_rows(&s_cli, row - cur);
+            xf_cli_rewrite_row(&s_cli, n, nn);
+            xf_cli_move_rows(&s_cli, cur - row);
+        }
+    }
+    if (cur > 0) {
+        xf_cli_putc(&s_cli, '\r');
+    }
+    while (np < now_len) {
+        nn = shell_frame_line(now, now_len, &np, &n);
+        xf_cli_write(&s_cli, n, nn);
+        xf_cli_puts(&s_cli, XF_SHELL_NEWLINE);
+        if (!SHELL_PIPE()) {
+            w->rows++;
+        }
+    }
+}
+
+/* The next row of a captured frame without its line end, empty past the end */
+static size_t shell_frame_line(const char *buf, size_t len, size_t *pos, const char **line)
+{
+    size_t start = *pos;
+    size_t end = start;
+
+    while (end < len && buf[end] != '\n') {
+        end++;
+    }
+    *line = &buf[start];
+    *pos = end < len ? end + 1 : len;
+    if (end > start && buf[end - 1] == '\r') {
+        end--;
+    }
+    return end - start;
+}
+
+static bool watch_interval_valid(const xf_opt_arg_t *opt, const char **error_msg, bool *append_help)
+{
+    (void)append_help;
+    if (opt->_opt.integer > 0) {
+        return true;
+    }
+    if (error_msg != NULL) {
+        *error_msg = "must be positive";
+    }
+    return false;
+}
+
+/*
+ * Pending for as long as it runs, so the shell stays responsive and Ctrl-C
+ * stops it. Between runs it sleeps until xf_shell_tick() reaches the next
+ * one; a run that overran skips the runs it missed rather than catching up.
+ */
+static int watch_command(const xf_cmd_args_t *cmd)
+{
+    shell_watch_t *w = &s_watch;
+    int ret;
+
+    if (!xf_shell_cmd_resumed()) {
+        ret = shell_watch_start(cmd);
+        if (ret != XF_CMD_PENDING) {
+            return ret;
+        }
+    }
+    if (xf_shell_cmd_cancelled()) {
+        // A command left pending gets its last call as well
+        if (w->pending) {
+            (void)shell_watch_call(w);
+        }
+        w->item = NULL;
+        shell_timers_arm();
+        return XF_CMD_INTERRUPTED;
+    }
+    if (w->pending || (int32_t)(s_now - w->due) >= 0) {
+        if (shell_watch_call(w) == XF_CMD_PENDING) {
+            return XF_CMD_PENDING;
+        }
+        shell_watch_draw(w);
+        w->shown ^= 1U;
+        w->due += w->period;
+        if ((int32_t)(s_now - w->due) >= 0) {
+            w->due = s_now + w->period;
+        }
+        shell_timers_arm();
+    }
+    s_sleeping = true;
+    return XF_CMD_PENDING;
+}
+#endif
+
+#if XF_SHELL_SCHED_ENTRIES
+/*
+ * Run the scheduled commands that are due, each at most once per call.
+ * They wait while a command is running or its output is still going out;
+ * at the prompt the line being edited is cleared first and drawn again below.
+ */
+static void shell_sched_run(void)
+{
+    char line[XF_CLI_MAX_LINE];
+    int budget = XF_SHELL_SCHED_ENTRIES;
+    bool erased = false;
+    int id;
+
+    if (s_cli.job != NULL || s_prompt_pending || SHELL_PENDING()) {
         return;
     }
-    cli_puts((struct xf_cli *)ctx, s);
+    while (budget-- > 0 && (id = xf_shell_sched_take(&s_sched, s_now, line)) != 0) {
+        if (!SHELL_PIPE() && !erased) {
+            xf_cli_erase_line(&s_cli);
+            erased = true;
+        }
+        xf_shell_sched_done(&s_sched, id, xf_shell_exec_line(line, strlen(line)));
+        (void)shell_take_interrupt();
+    }
+    shell_timers_arm();
+    if (erased) {
+        xf_cli_redraw(&s_cli);
+    }
+}
+
+/* A scheduled command is due and the shell is free to run it */
+static bool shell_sched_due(void)
+{
+    uint32_t due;
+
+    return !SHELL_PENDING() && xf_shell_sched_next(&s_sched, &due) &&
+           (int32_t)(s_now - due) >= 0;
+}
+
+/* "500ms", "10s", "5m", "1h" or plain milliseconds, a '+' in front is allowed */
+static bool shell_parse_ms(const char *s, uint32_t *ms)
+{
+    uint32_t value = 0;
+    uint32_t unit;
+
+    if (*s == '+') {
+        s++;
+    }
+    if (*s < '0' || *s > '9') {
+        return false;
+    }
+    while (*s >= '0' && *s <= '9') {
+        if (value > (uint32_t)INT32_MAX / 10U) {
+            return false;
+        }
+        value = value * 10U + (uint32_t)(*s++ - '0');
+    }
+    if (*s == '\0' || strcmp(s, "ms") == 0) {
+        unit = 1U;
+    } else if (strcmp(s, "s") == 0) {
+        unit = 1000U;
+    } else if (strcmp(s, "m") == 0) {
+        unit = 60000U;
+    } else if (strcmp(s, "h") == 0) {
+        unit = 3600000U;
+    } else {
+        return false;
+    }
+    // Deadlines are compared on a wrapping clock, keep them within half of it
+    if (value == 0 || value > (uint32_t)INT32_MAX / unit) {
+        return false;
+    }
+    *ms = value * unit;
+    return true;
+}
+
+static bool sched_time_valid(const xf_arg_t *arg, const char **error_msg, bool *append_help)
+{
+    uint32_t ms;
+
+    (void)append_help;
+    if (shell_parse_ms(arg->_opt.string, &ms)) {
+        return true;
+    }
+    if (error_msg != NULL) {
+        *error_msg = "expected a time such as 500ms, 10s, 5m or 1h";
+    }
+    return false;
 }
 
-static void cli_putchar(struct xf_cli *cli, char ch, bool is_last)
+/*
+ * Schedule the command after every's or at's own words. As with watch(1)
+ * the words are joined by spaces and split again on every run, so a chain
+ * can be scheduled by quoting it: every 1s "a && b".
+ */
+static int shell_sched_add(const xf_cmd_args_t *cmd, const char *name, bool every)
 {
-    if (cli->put_char == NULL) {
+    char line[XF_CLI_MAX_LINE];
+    char first[XF_CLI_MAX_LINE];
+    char *argv[XF_CLI_MAX_ARGC];
+    const char *text = NULL;
+    uint32_t ms = 0;
+    size_t len = 0;
+    int argc;
+    int id;
+    int i;
+
+    (void)xf_shell_cmd_get_string(cmd, name, &text);
+    (void)shell_parse_ms(text, &ms);
+    for (i = 0; i < s_tail_argc; i++) {
+        size_t n = strlen(s_tail_argv[i]);
+
+        if (len + n + 1 >= sizeof(line)) {
+            xf_cli_puts(&s_cli, "line too long" XF_SHELL_NEWLINE);
+            return XF_CMD_NO_MEM;
+        }
+        if (i > 0) {
+            line[len++] = ' ';
+        }
+        memcpy(&line[len], s_tail_argv[i], n);
+        len += n;
+    }
+    line[len] = '\0';
+    // A typo is better reported now than on every run
+    memcpy(first, line, len + 1);
+    argc = xf_shell_tokenize(first, (int)len, argv, XF_CLI_MAX_ARGC);
+    if (argc > 0 && xf_shell_chain_op(argv[0]) == XF_SHELL_CHAIN_NONE &&
+        find_command_by_name(argv[0]) == NULL) {
+        xf_cli_puts(&s_cli, "command not found: ");
+        xf_cli_puts(&s_cli, argv[0]);
+        xf_cli_puts(&s_cli, XF_SHELL_NEWLINE);
+        return XF_CMD_NO_INVALID_ARG;
+    }
+#if XF_SHELL_WATCH_SIZE
+    // A scheduled line is run in place, where watch refuses to start
+    for (i = 0; i < argc; i++) {
+        const cmd_item_t *item = find_command_by_name(argv[i]);
+
+        if (item != NULL && item->func == watch_command &&
+            (i == 0 || xf_shell_chain_op(argv[i - 1]) != XF_SHELL_CHAIN_NONE)) {
+            xf_cli_puts(&s_cli, "cannot schedule: watch" XF_SHELL_NEWLINE);
+            return XF_CMD_NO_INVALID_ARG;
+        }
+    }
+#endif
+    if (xf_shell_sched_add(&s_sched, s_now + ms, every ? ms : 0U, line, &id) != XF_CMD_OK) {
+        xf_cli_puts(&s_cli, "no room for another entry" XF_SHELL_NEWLINE);
+        return XF_CMD_NO_MEM;
+    }
+    shell_timers_arm();
+    return XF_CMD_OK;
+}
+
+static int every_command(const xf_cmd_args_t *cmd)
+{
+    return shell_sched_add(cmd, "period", true);
+}
+
+static int at_command(const xf_cmd_args_t *cmd)
+{
+    return shell_sched_add(cmd, "delay", false);
+}
+
+/* The schedule with run counts and overruns, or with -d remove an entry */
+static int sched_command(const xf_cmd_args_t *cmd)
+{
+    const xf_shell_sched_entry_t *e;
+    char text[80];
+    char period[16];
+    char next[16];
+    char rc[12];
+    int32_t del = 0;
+    int32_t left;
+    int id;
+
+    (void)xf_shell_cmd_get_int(cmd, "delete", &del);
+    if (del != 0) {
+        if (!xf_shell_sched_remove(&s_sched, (int)del)) {
+            snprintf(text, sizeof(text), "no such entry: %d" XF_SHELL_NEWLINE, (int)del);
+            xf_cli_puts(&s_cli, text);
+            return XF_CMD_NO_INVALID_ARG;
+        }
+        shell_timers_arm();
+        return XF_CMD_OK;
+    }
+    xf_cli_puts(&s_cli, "id  period      next        runs  overruns  rc    command" XF_SHELL_NEWLINE);
+    for (id = 1; id <= XF_SHELL_SCHED_ENTRIES; id++) {
+        e = xf_shell_sched_get(&s_sched, id);
+        if (e == NULL) {
+            continue;
+        }
+        if (e->period != 0U) {
+            snprintf(period, sizeof(period), "%lums", (unsigned long)e->period);
+        } else {
+            snprintf(period, sizeof(period), "once");
+        }
+        left = (int32_t)(e->due - s_now);
+        snprintf(next, sizeof(next), "%ldms", (long)(left > 0 ? left : 0));
+        if (e->runs > 0U) {
+            snprintf(rc, sizeof(rc), "%d", e->ret);
+        } else {
+            snprintf(rc, sizeof(rc), "-");
+        }
+        snprintf(text, sizeof(text), "%-3d %-11s %-11s %-5lu %-9lu %-5s ", id, period, next,
+                 (unsigned long)e->runs, (unsigned long)e->overruns, rc);
+        xf_cli_puts(&s_cli, text);
+        xf_cli_puts(&s_cli, e->line);
+        xf_cli_puts(&s_cli, XF_SHELL_NEWLINE);
+    }
+    return XF_CMD_OK;
+}
+#endif
+
+#if XF_SHELL_SUBMIT_SLOTS
+/*
+ * Run what other tasks submitted, in order, under the same conditions as
+ * scheduled commands. The output goes to the submitter's callback instead
+ * of the console, so the line being edited is left alone.
+ */
+static void shell_submit_run(void)
+{
+    const xf_shell_submit_req_t *req;
+    int budget = XF_SHELL_SUBMIT_SLOTS;
+    xf_shell_done_t done;
+    void *ctx;
+    size_t len;
+    int ret;
+
+    if (s_cli.job != NULL || s_prompt_pending || SHELL_PENDING()) {
         return;
     }
-#if XF_CLI_SERIAL_XLATE
-    if (ch == '\n' && !XF_SHELL_NEWLINE_IS_CRLF) {
-        cli->put_char(cli->cb_data, '\r', false);
+    while (budget-- > 0 && (req = xf_shell_submit_peek()) != NULL) {
+        xf_cli_capture_begin(&s_cli, s_submit_out, sizeof(s_submit_out) - 1);
+        ret = xf_shell_exec_line(req->line, strlen(req->line));
+        // The output job of e.g. help belongs to the captured output as well
+        while (xf_cli_job_step(&s_cli)) {
+        }
+        len = xf_cli_capture_end(&s_cli);
+        s_submit_out[len] = '\0';
+        (void)shell_take_interrupt();
+        // The slot is free again before the callback, which may submit the next line
+        done = req->done;
+        ctx = req->ctx;
+        xf_shell_submit_pop();
+        if (done != NULL) {
+            done(ctx, ret, s_submit_out, len);
+        }
     }
+}
 #endif
-    cli->put_char(cli->cb_data, ch, is_last);
+
+#if XF_SHELL_FRAME_SIZE
+/* Run every request completed by the input, a partial one waits for more */
+static size_t shell_frame_feed(const char *buf, size_t len)
+{
+    size_t i = 0;
+
+    for (;;) {
+        i += xf_shell_frame_feed(&s_frame_rx, &buf[i], len - i);
+        if (!s_frame_rx.ready) {
+            return i;
+        }
+        shell_frame_call();
+    }
+}
+
+/*
+ * Run the request in s_frame_rx and answer it. The words are run as they
+ * came, no line editor or tokenizer in between; the output goes out in DATA
+ * frames as it fills s_frame_buf, the END frame carries the status.
+ */
+static void shell_frame_call(void)
+{
+    const char *argv[XF_CLI_MAX_ARGC];
+    char status[XF_SHELL_FRAME_STATUS];
+    char *words;
+    size_t len;
+    size_t i = 0;
+    int argc = 0;
+    int ret = XF_CMD_NO_INVALID_ARG;
+    uint32_t code;
+
+    s_frame_seq = xf_shell_frame_seq(&s_frame_rx);
+    s_frame_len = 0;
+    words = xf_shell_frame_payload(&s_frame_rx, &len);
+    if (xf_shell_frame_type(&s_frame_rx) != XF_SHELL_FRAME_CALL) {
+        ret = XF_CMD_NOT_SUPPORTED;
+    } else if (len > 0 && words[len - 1] == '\0') {
+        // Every word ends in a nul already, argv points into the frame
+        while (i < len && argc < XF_CLI_MAX_ARGC) {
+            argv[argc++] = &words[i];
+            i += strlen(&words[i]) + 1;
+        }
+        if (i == len) {
+            ret = xf_shell_cmd_run_stream(argc, argv, shell_frame_out, NULL);
+        }
+    }
+    if (s_frame_len > XF_SHELL_FRAME_SIZE - sizeof(status)) {
+        shell_frame_data();
+    }
+    code = (uint32_t)ret;
+    status[0] = (char)(code & 0xFFU);
+    status[1] = (char)((code >> 8) & 0xFFU);
+    status[2] = (char)((code >> 16) & 0xFFU);
+    status[3] = (char)(code >> 24);
+    xf_shell_frame_send(shell_frame_write, NULL, XF_SHELL_FRAME_END, s_frame_seq, status,
+                        sizeof(status), s_frame_buf, s_frame_len);
+    s_frame_len = 0;
 }
 
-static void cli_puts(struct xf_cli *cli, const char *s)
+static void shell_frame_out(void *data, const char *buf, size_t len)
 {
-    for (; *s != '\0'; s++) {
-        cli_putchar(cli, *s, s[1] == '\0');
+    (void)data;
+    while (len > 0) {
+        size_t k = XF_SHELL_FRAME_SIZE - s_frame_len;
+
+        if (k == 0) {
+            shell_frame_data();
+            continue;
+        }
+        if (k > len) {
+            k = len;
+        }
+        memcpy(&s_frame_buf[s_frame_len], buf, k);
+        s_frame_len += k;
+        buf += k;
+        len -= k;
+    }
+}
+
+static void shell_frame_data(void)
+{
+    xf_shell_frame_send(shell_frame_write, NULL, XF_SHELL_FRAME_DATA, s_frame_seq, NULL, 0,
+                        s_frame_buf, s_frame_len);
+    s_frame_len = 0;
+}
+
+/* DATA frames are sent from inside the capture that feeds them, past it */
+static void shell_frame_write(void *data, const char *buf, size_t len)
+{
+    bool capture = s_cli.cap.on;
+
+    (void)data;
+    s_cli.cap.on = false;
+    xf_cli_write_raw(&s_cli, buf, len);
+    s_cli.cap.on = capture;
+}
+#endif
+
+static void cli_puts_adapter(void *ctx, const char *s)
+{
+    if (ctx == NULL || s == NULL) {
+        return;
     }
+    xf_cli_puts((struct xf_cli *)ctx, s);
 }
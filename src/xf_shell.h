@@ -14,6 +14,7 @@
 
 /* ==================== [Includes] ========================================== */
 #include <stdbool.h>
+#include <stddef.h>
 #include "xf_shell_config_internal.h"
 #include "xf_shell_options.h"
 
@@ -31,6 +32,8 @@ typedef enum {
     XF_CMD_NO_INVALID_ARG,
     XF_CMD_NOT_SUPPORTED,
     XF_CMD_INITED,
+    XF_CMD_INTERRUPTED,
+    XF_CMD_PENDING = -32768, /* 远离用户自定义的小返回值，见 `xf_shell_cmd_func_t` */
 } xf_cmd_return_t;
 
 typedef void* xf_cmd_args_t;
@@ -44,6 +47,86 @@ typedef void* xf_cmd_args_t;
  */
 typedef void (*xf_putc_t)(void* user_data, char ch, bool is_last);
 
+/**
+ * @brief 控制台块输出回调类型。
+ *
+ * @details
+ * 输出先在内部缓冲区合并，只在提示符、行边界、命令执行前后以及每次输入处理结束时
+ * 整块交出，适合直接对接一次 DMA 发送或一次 `write(2)`。
+ *
+ * @param[in] user_data 用户上下文指针，由初始化接口透传。
+ * @param[in] data 待输出数据。
+ * @param[in] len 数据长度（字节）。
+ */
+typedef void (*xf_write_t)(void* user_data, const char* data, size_t len);
+
+/**
+ * @brief 非阻塞块输出回调类型。
+ *
+ * @details
+ * 不得阻塞：端口忙时只接收能立即放下的部分（可以是 0），其余数据留在发送环形缓冲区，
+ * 之后由 `xf_shell_tx_pump()` 继续发送。
+ *
+ * @param[in] user_data 用户上下文指针，由初始化接口透传。
+ * @param[in] data 待输出数据。
+ * @param[in] len 数据长度（字节）。
+ *
+ * @return 端口实际接收的字节数。
+ */
+typedef size_t (*xf_tx_write_t)(void* user_data, const char* data, size_t len);
+
+/**
+ * @brief 发送环形缓冲区已满时的处理策略。
+ */
+typedef enum {
+    XF_SHELL_TX_BLOCK,       /*!< 等待端口腾出空间（期间调用 `XF_SHELL_TX_WAIT()`） */
+    XF_SHELL_TX_DROP_OLDEST, /*!< 丢弃最早排队、尚未发出的数据 */
+    XF_SHELL_TX_DROP_NEWEST, /*!< 丢弃本次放不下的新数据 */
+} xf_shell_tx_policy_t;
+
+/**
+ * @brief 唤醒通知回调类型。
+ *
+ * @details
+ * 有新的待处理工作时调用（如输入环形缓冲区收到数据），可能在中断或其他线程中执行，
+ * 实现应简短且可重入，例如释放信号量、设置事件标志或写 eventfd。
+ *
+ * @param[in] user_data 用户上下文指针。
+ */
+typedef void (*xf_shell_notify_t)(void* user_data);
+
+/**
+ * @brief 提交的命令执行完成回调类型，见 `xf_shell_submit()`。
+ *
+ * @details
+ * 在 shell 任务中调用。`out` 为命令的全部输出（含解析错误与帮助信息），以 `\0` 结尾，
+ * 仅在回调期间有效。
+ *
+ * @param[in] ctx 提交时传入的上下文指针。
+ * @param[in] ret 命令返回值，同 `xf_shell_exec_line()`。
+ * @param[in] out 命令输出。
+ * @param[in] len 输出长度（字节），不含结尾的 `\0`。
+ */
+typedef void (*xf_shell_done_t)(void* ctx, int ret, const char* out, size_t len);
+
+/**
+ * @brief shell 运行模式。
+ */
+typedef enum {
+    XF_SHELL_MODE_INTERACTIVE, /*!< 交互终端：行编辑、回显、彩色提示符 */
+    XF_SHELL_MODE_PIPE,        /*!< 主机脚本经管道驱动：无回显、转义序列与提示符 */
+    XF_SHELL_MODE_FRAME,       /*!< 主机程序以二进制帧调用命令，需要 `XF_SHELL_FRAME_SIZE` */
+} xf_shell_mode_t;
+
+/**
+ * @brief 结构化输出（`xf_shell_emit_*()`）的渲染格式。
+ */
+typedef enum {
+    XF_SHELL_FORMAT_TEXT, /*!< 按键名对齐的 `key: value` 文本，供人阅读 */
+    XF_SHELL_FORMAT_JSON, /*!< 每条命令一行紧凑 JSON 对象 */
+    XF_SHELL_FORMAT_CBOR, /*!< 每条命令一个 CBOR map（RFC 8949，不定长编码） */
+} xf_shell_format_t;
+
 /**
  * @brief 控制台字符输入回调类型。
  *
@@ -55,7 +138,8 @@ typedef char (*xf_getc_t)(void);
  * @brief 命令执行回调类型。
  *
  * @param[in] arg 命令运行时上下文（可用于读取参数值）。
- * @return 用户自定义返回值（通常返回 `0` 表示成功）。
+ * @return 用户自定义返回值（通常返回 `0` 表示成功），但不能与 `XF_CMD_PENDING`（-32768）相同；
+ *         返回 `XF_CMD_PENDING` 表示尚未完成，稍后会再次调用，见 `xf_shell_cmd_resumed()`。
  */
 typedef int (*xf_shell_cmd_func_t)(const xf_cmd_args_t* arg);
 
@@ -148,16 +232,353 @@ struct _xf_arg_t {
  */
 void xf_shell_cmd_init(const char* prompt, xf_putc_t putc, void* user_data);
 
+/**
+ * @brief 以块输出回调初始化命令控制台子系统。
+ *
+ * @details
+ * 与 `xf_shell_cmd_init()` 相同，但输出以整块形式交给 `write`。
+ *
+ * @param[in] prompt 命令提示符文本。
+ * @param[in] write 块输出回调。
+ * @param[in] user_data 传递给 `write` 的用户上下文。
+ */
+void xf_shell_cmd_init_write(const char* prompt, xf_write_t write, void* user_data);
+
+#if XF_SHELL_TX_RING_SIZE
+/**
+ * @brief 以非阻塞输出回调初始化命令控制台子系统。
+ *
+ * @details
+ * 输出经过 `XF_SHELL_TX_RING_SIZE` 字节的发送环形缓冲区交给 `write`。
+ * 终端停止接收时，按 `policy` 选择等待或丢弃数据，丢弃策略下 shell 永远不会被输出阻塞。
+ * 丢弃可能截断转义序列，之后的一次重绘（如 Ctrl-L）可恢复显示。
+ *
+ * @param[in] prompt 命令提示符文本。
+ * @param[in] write 非阻塞块输出回调。
+ * @param[in] user_data 传递给 `write` 的用户上下文。
+ * @param[in] policy 缓冲区满时的处理策略。
+ */
+void xf_shell_cmd_init_tx(const char* prompt, xf_tx_write_t write, void* user_data,
+                          xf_shell_tx_policy_t policy);
+
+/**
+ * @brief 继续发送排队中的输出数据，不会阻塞。
+ *
+ * @details
+ * 每次输入处理结束时会自动调用；端口可写（如发送完成中断置位的标志、
+ * 主循环空闲）时也应调用，以便把剩余数据发出。须与其他 shell 接口在同一上下文中调用。
+ *
+ * @return 仍在排队的字节数。
+ */
+size_t xf_shell_tx_pump(void);
+
+/**
+ * @brief 获取因丢弃策略而丢失的输出字节数。
+ *
+ * @return 累计丢弃字节数。
+ */
+uint32_t xf_shell_tx_dropped(void);
+#endif
+
 /**
  * @brief 处理一次字符输入驱动流程。
  *
  * @details
  * 内部会读取 1 个字符并更新编辑状态；当检测到完整命令行时自动完成解析与执行。
+ * 启用输入环形缓冲区时，`getc` 传 `NULL` 等同于调用 `xf_shell_cmd_process()`。
+ * 有挂起的命令（`XF_CMD_PENDING`）时每次调用推进一步，此时 `getc` 应为非阻塞。
  *
  * @param[in] getc 字符输入回调。
  */
 void xf_shell_cmd_handle(xf_getc_t getc);
 
+#if XF_SHELL_RX_RING_SIZE
+/**
+ * @brief 向输入环形缓冲区写入一个字节（生产者侧，可在中断中调用）。
+ *
+ * @details
+ * 单生产者/单消费者无锁实现：同一时刻只能有一个生产者（如 UART 接收中断
+ * 或一个读线程），消费者为 `xf_shell_cmd_process()`。不会阻塞或关中断。
+ *
+ * @param[in] ch 输入字节。
+ *
+ * @return `true` 写入成功；`false` 缓冲区已满，字节被丢弃并计入溢出计数。
+ */
+bool xf_shell_rx_push(char ch);
+
+/**
+ * @brief 向输入环形缓冲区写入一段数据（生产者侧，可在中断中调用）。
+ *
+ * @param[in] data 输入数据。
+ * @param[in] len 数据长度（字节）。
+ *
+ * @return 实际写入的字节数，其余字节计入溢出计数。
+ */
+size_t xf_shell_rx_write(const char* data, size_t len);
+
+/**
+ * @brief 获取因输入环形缓冲区已满而丢失的字节数。
+ *
+ * @return 累计丢失字节数。
+ */
+uint32_t xf_shell_rx_overflow(void);
+
+/**
+ * @brief 处理输入环形缓冲区中已到达的全部数据（消费者侧）。
+ *
+ * @details
+ * 在 shell 任务中调用，数据原地交给 `xf_shell_cmd_feed()`，无需额外拷贝。
+ * 只处理调用时已到达的数据，处理期间新到达的字节留待下次调用。
+ */
+void xf_shell_cmd_process(void);
+
+/**
+ * @brief 当前命令是否被 `Ctrl-C` 中断。
+ *
+ * @details
+ * 命令执行期间输入仍由生产者写入环形缓冲区（预输入），命令结束后再交给编辑器。
+ * 其间收到的 `Ctrl-C` 会被带外识别：耗时命令应周期性调用本函数，返回 `true` 时尽快返回。
+ * 命令结束后，该 `Ctrl-C` 及其之前的预输入会被丢弃，并输出 `^C`。
+ *
+ * @return `true` 已请求中断。
+ */
+bool xf_shell_interrupted(void);
+
+/**
+ * @brief 在预算内处理输入与未完成的输出（消费者侧）。
+ *
+ * @details
+ * 适用于固定周期的前后台主循环：每次调用只做有限的工作，限制 shell 带来的最坏延迟。
+ * 定义了 `XF_SHELL_POLL_CLOCK()` 时预算单位为该时钟的计数（通常为微秒），
+ * 否则为输入字节数，每个输出步骤（如 help 列表中的一行）也计为 1。
+ *
+ * `help`、`history` 的列表、补全候选列表以及随后的重绘会逐行输出，
+ * 超出预算时留到下次调用继续；此期间新到达的输入保留在环形缓冲区中，顺序不变。
+ * 用户命令本身的执行时间不受预算限制。每次调用至少推进一步。
+ *
+ * @param[in] budget 本次调用的预算。
+ *
+ * @return `true` 仍有待处理的工作（同 `xf_shell_has_pending_work()`）。
+ */
+bool xf_shell_cmd_poll(uint32_t budget);
+#endif
+
+/**
+ * @brief 一次处理一整块输入数据。
+ *
+ * @details
+ * 适用于 USB-CDC、UART DMA 等按块到达的输入，效果等同于对每个字节调用
+ * `xf_shell_cmd_handle()`，但连续的可打印字符会作为一段整体插入与回显，
+ * 不必逐字节经过编辑器状态机。数据中可以包含多行命令。
+ *
+ * 启用输入环形缓冲区时，某条命令挂起（`XF_CMD_PENDING`）后数据的剩余部分，
+ * 以及挂起期间再次调用时传入的数据，都写入环形缓冲区，命令结束后按顺序执行，
+ * 超出缓冲区容量的部分同 `xf_shell_rx_write()` 一样丢弃。
+ * 未启用时数据无处暂存，其中的命令在本函数返回前执行完毕，不会挂起。
+ *
+ * @param[in] buf 输入数据。
+ * @param[in] len 数据长度（字节）。
+ */
+void xf_shell_cmd_feed(const char* buf, size_t len);
+
+/**
+ * @brief 设置唤醒通知回调。
+ *
+ * @details
+ * 应在启用输入中断或读线程之前调用。配合 `xf_shell_has_pending_work()`
+ * 可让 shell 任务在无事可做时休眠：
+ *
+ * @code
+ * while (1) {
+ *     while (xf_shell_has_pending_work()) {
+ *         xf_shell_cmd_process();
+ *     }
+ *     wait_for_notify(); // 如 xSemaphoreTake()、poll()
+ * }
+ * @endcode
+ *
+ * 每次生产者写入都会调用通知回调（不只在缓冲区由空变非空时），
+ * 因此上述循环不会丢失唤醒。
+ *
+ * @param[in] notify 通知回调，`NULL` 表示不通知。
+ * @param[in] user_data 回调透传上下文。
+ */
+void xf_shell_set_notify(xf_shell_notify_t notify, void* user_data);
+
+/**
+ * @brief 通知 shell 任务有新的待处理工作。
+ *
+ * @details
+ * 调用已设置的通知回调，可在中断或其他线程中调用。
+ * 内置输入环形缓冲区写入后会自动调用。
+ */
+void xf_shell_wakeup(void);
+
+#if XF_SHELL_TIMERS
+/**
+ * @brief 推进 shell 的毫秒时钟，驱动 `watch`、`every`、`at` 等定时执行的命令。
+ *
+ * @details
+ * 可在定时器中断（如 SysTick）中按固定周期调用，也可在主循环中按实际经过的时间调用；
+ * 只能在一处调用。有命令到期时调用通知回调，见 `xf_shell_set_notify()`。
+ * 等待到期期间 `xf_shell_has_pending_work()` 返回 `false`，shell 任务可以休眠。
+ *
+ * @param[in] ms 距上次调用经过的毫秒数。
+ */
+void xf_shell_tick(uint32_t ms);
+
+/**
+ * @brief 距下一个到期时刻的毫秒数，用于无节拍系统设置休眠时长。
+ *
+ * @return 毫秒数，已到期时为 `0`，没有等待中的定时时为 `UINT32_MAX`。
+ */
+uint32_t xf_shell_next_timeout(void);
+#endif
+
+/**
+ * @brief shell 是否还有待处理的工作。
+ *
+ * @details
+ * 包括输入环形缓冲区中未处理的数据、尚未交给端口的输出。
+ * 返回 `false` 时 shell 任务可以休眠，直到通知回调被调用。
+ * 发送环形缓冲区中仍有数据时，应等待端口可写后调用 `xf_shell_tx_pump()`。
+ *
+ * @return `true` 仍有工作待处理。
+ */
+bool xf_shell_has_pending_work(void);
+
+#if XF_SHELL_PIPE_MODE
+/**
+ * @brief 切换交互/管道模式。
+ *
+ * @details
+ * 管道模式跳过行编辑器：输入不回显，不解析转义序列，不补全，不记录历史，
+ * 也不输出彩色提示符。每行输入直接拆分并执行，空行被忽略。
+ * 每条命令的输出之后跟一行结束标记 `XF_SHELL_PIPE_END_MARK` 与十进制返回值，
+ * 默认为 `"\x1e" "rc=0"` 加换行，主机读到该行即可认为命令结束：
+ *
+ * @code
+ * $ printf 'help\nfoo\n' | ./shell
+ * ...help 输出...
+ * \x1erc=0
+ * command not found: foo
+ * \x1erc=3
+ * @endcode
+ *
+ * 超过 `XF_CLI_MAX_LINE` 的行不会被截断执行，而是输出 `line too long`，
+ * 返回值为 `XF_CMD_NO_MEM`；词数超过 `XF_CLI_MAX_ARGC - 1` 的行输出 `too many words`，
+ * 返回值为 `XF_CMD_NO_INVALID_ARG`。可在 `xf_shell_cmd_init()` 之前调用，也可在运行中切换，
+ * 切回交互模式时会重新输出提示符；切换时尚未结束的一行被丢弃。
+ * 通常按输入是否为终端选择，如 `isatty(STDIN_FILENO)`。
+ *
+ * 帧模式（`XF_SHELL_FRAME_SIZE` 不为 0）连分词也跳过：每个请求帧带着已拆分的各个词，
+ * 直接交给 `xf_shell_cmd_run()`，输出与返回值装入响应帧，帧格式见 `xf_shell_frame.h`。
+ * 长度或 CRC 不对的帧被丢弃，主机按超时重发。帧以外的字节被忽略，
+ * 输入中的 `0x03` 也不再作为 `Ctrl-C`。后台任务、定时命令等不属于某个请求的输出
+ * 仍以文本直接输出，主机按起始字节与 CRC 跳过即可。未启用帧模式时按管道模式处理。
+ *
+ * @param[in] mode 运行模式。
+ */
+void xf_shell_set_mode(xf_shell_mode_t mode);
+
+/**
+ * @brief 获取当前运行模式。
+ *
+ * @return 当前模式。
+ */
+xf_shell_mode_t xf_shell_get_mode(void);
+
+#if XF_SHELL_FRAME_SIZE
+/**
+ * @brief 帧模式下因长度或 CRC 错误被丢弃的帧数。
+ *
+ * @return 累计丢弃帧数。
+ */
+uint32_t xf_shell_frame_dropped(void);
+#endif
+#endif
+
+#if XF_SHELL_EMIT_DEPTH
+/**
+ * @brief 设置结构化输出的渲染格式（会话级）。
+ *
+ * @details
+ * 命令回调用 `xf_shell_emit_*()` 描述输出，由会话决定渲染方式，回调本身不需要区分：
+ * 交互终端用文本，主机脚本用 JSON 或 CBOR。一条命令的结构化输出构成一个顶层对象，
+ * 在第一次输出时打开，命令结束（含 `XF_CMD_PENDING` 之后的最后一步）时由 shell 关闭；
+ * JSON 以换行结尾，一条命令一行。CBOR 为二进制，不做换行转换，宜配合管道模式或捕获接口使用。
+ * 后台任务（`cmd &`）的输出按行加前缀，总是渲染为文本。
+ *
+ * @param[in] format 渲染格式，默认 `XF_SHELL_FORMAT_TEXT`。
+ */
+void xf_shell_set_format(xf_shell_format_t format);
+
+/**
+ * @brief 获取结构化输出的渲染格式。
+ *
+ * @return 当前格式。
+ */
+xf_shell_format_t xf_shell_get_format(void);
+
+/**
+ * @brief 输出一个整数字段。
+ *
+ * @details
+ * 在对象中 `key` 为字段名；在数组中 `key` 被忽略，可传 `NULL`。
+ * 以下 `xf_shell_emit_*()` 相同，只能在命令回调中调用。
+ *
+ * @param[in] key 字段名。
+ * @param[in] value 值。
+ */
+void xf_shell_emit_kv_int(const char* key, int32_t value);
+
+/**
+ * @brief 输出一个无符号整数字段。
+ *
+ * @param[in] key 字段名。
+ * @param[in] value 值。
+ */
+void xf_shell_emit_kv_uint(const char* key, uint32_t value);
+
+/**
+ * @brief 输出一个字符串字段。
+ *
+ * @param[in] key 字段名。
+ * @param[in] value 值，`NULL` 输出为 JSON/CBOR 的 null，文本为 `-`。
+ */
+void xf_shell_emit_kv_str(const char* key, const char* value);
+
+/**
+ * @brief 输出一个布尔字段。
+ *
+ * @param[in] key 字段名。
+ * @param[in] value 值。
+ */
+void xf_shell_emit_kv_bool(const char* key, bool value);
+
+/**
+ * @brief 开始一个嵌套对象，以 `xf_shell_emit_end()` 结束。
+ *
+ * @details
+ * 含顶层对象最多嵌套 `XF_SHELL_EMIT_DEPTH` 层，更深的层及其内容被丢弃。
+ *
+ * @param[in] key 字段名。
+ */
+void xf_shell_emit_object(const char* key);
+
+/**
+ * @brief 开始一个数组，以 `xf_shell_emit_end()` 结束。
+ *
+ * @param[in] key 字段名。
+ */
+void xf_shell_emit_array(const char* key);
+
+/**
+ * @brief 结束最近一个未结束的对象或数组。命令结束时仍未结束的会被自动关闭。
+ */
+void xf_shell_emit_end(void);
+#endif
+
 /**
  * @brief 绑定静态命令表（数组索引模式）。
  *
@@ -246,6 +667,38 @@ int xf_shell_cmd_get_float(const xf_cmd_args_t* cmd, const char* long_opt, float
  */
 int xf_shell_cmd_get_string(const xf_cmd_args_t* cmd, const char* long_opt, const char** value);
 
+/**
+ * @brief 当前命令回调是否为 `XF_CMD_PENDING` 之后的再次调用。
+ *
+ * @details
+ * 耗时命令（如擦除 Flash）可以分步执行：每次只推进一步，未完成时返回 `XF_CMD_PENDING`，
+ * 状态保存在静态变量中（类似 protothread，无需线程）。首次调用时本函数返回 `false`，
+ * 用于初始化状态；参数值在命令结束前保持有效。
+ *
+ * 终端或管道输入的命令行中，挂起的命令由之后的 `xf_shell_cmd_process()`、
+ * `xf_shell_cmd_poll()`、`xf_shell_cmd_feed()` 或 `xf_shell_cmd_handle()` 每次调用一步，
+ * 期间控制台与主循环不被阻塞，命令结束后才继续执行 `&&`/`||` 后的命令并显示提示符。
+ * 通过 `xf_shell_cmd_run()`、`xf_shell_exec_line()` 或脚本执行的命令，
+ * 未启用输入环形缓冲区时经 `xf_shell_cmd_feed()` 输入的命令，
+ * 以及 `XF_SHELL_ASYNC_CMD` 为 `0` 时，会在返回前连续调用直到完成。
+ *
+ * @return `true` 为再次调用。
+ */
+bool xf_shell_cmd_resumed(void);
+
+/**
+ * @brief 挂起的命令是否已被 `Ctrl-C` 取消。
+ *
+ * @details
+ * 取消后命令回调会被最后调用一次，本函数返回 `true`，回调应停止操作并释放资源，
+ * 其返回值被忽略，命令以 `XF_CMD_INTERRUPTED` 结束。
+ * 未启用输入环形缓冲区时，挂起期间收到的其他输入会被丢弃；
+ * 启用时留在缓冲区中，命令结束后再交给编辑器。
+ *
+ * @return `true` 已取消。
+ */
+bool xf_shell_cmd_cancelled(void);
+
 /**
  * @brief 直接执行一次命令解析与分发。
  *
@@ -255,6 +708,147 @@ int xf_shell_cmd_get_string(const xf_cmd_args_t* cmd, const char* long_opt, cons
  */
 int xf_shell_cmd_run(int argc, const char** argv);
 
+#if XF_CLI_CAPTURE
+/**
+ * @brief 执行一次命令，输出收集到调用方的缓冲区而不是终端。
+ *
+ * @details
+ * 同 `xf_shell_cmd_run()`，其间的全部输出（解析错误、`-h` 帮助、命令经 `xf_shell_write()`/`xf_shell_puts()`
+ * 的输出以及 help 等分步输出）直接写入 `buf`，写满后多余的部分被丢弃，结尾补 `\0`。
+ * 可以嵌套：命令回调中再次调用时，外层的收集在返回后继续。只能在 shell 任务中调用，
+ * 其他任务请用 `xf_shell_submit()`。
+ *
+ * @param[in] argc 参数数量。
+ * @param[in] argv 参数数组，`argv[0]` 为命令名。
+ * @param[out] buf 输出缓冲区，`cap` 为 0 时可为 `NULL`（丢弃输出）。
+ * @param[in] cap 缓冲区大小（字节），含结尾的 `\0`。
+ * @param[out] len 写入的字节数，不含结尾的 `\0`，可为 `NULL`。
+ *
+ * @return 同 `xf_shell_cmd_run()`。
+ */
+int xf_shell_cmd_run_capture(int argc, const char** argv, char* buf, size_t cap, size_t* len);
+
+/**
+ * @brief 执行一次命令，输出逐段交给回调而不是终端。
+ *
+ * @details
+ * 同 `xf_shell_cmd_run_capture()`，但没有长度限制：每段输出以原指针直接交给 `write`，
+ * 不经过输出缓冲，也不拷贝，适合转发到网络连接或文件。
+ *
+ * @param[in] argc 参数数量。
+ * @param[in] argv 参数数组，`argv[0]` 为命令名。
+ * @param[in] write 输出回调，在 shell 任务中调用。
+ * @param[in] user_data 回调上下文指针。
+ *
+ * @return 同 `xf_shell_cmd_run()`；`write` 为 `NULL` 时返回 `XF_CMD_NO_INVALID_ARG`。
+ */
+int xf_shell_cmd_run_stream(int argc, const char** argv, xf_write_t write, void* user_data);
+#endif
+
+/**
+ * @brief 拆分并执行一行命令，支持 `;`、`&&`、`||` 连接多条命令。
+ *
+ * @details
+ * 与终端输入的规则相同：运算符须单独成词（`a && b`，而非 `a&&b`），加引号或转义后按普通参数处理。
+ * `&&` 仅在前一条命令返回 `XF_CMD_OK` 时执行后一条，`||` 仅在失败时执行，`;` 总是执行；
+ * 被跳过的命令不改变状态，例如 `a && b || c` 在 `a` 失败时执行 `c`。
+ * 运算符前后缺少命令（行尾的 `;` 除外）时整行不执行，返回 `XF_CMD_NO_INVALID_ARG`。
+ * 启用输入环形缓冲区时，`Ctrl-C` 会在当前命令结束后停止后续命令。
+ * 整行（含运算符）最多 `XF_CLI_MAX_ARGC - 1` 个参数，超出时整行不执行。
+ *
+ * @param[in] line 命令行文本，无需以 `\0` 结尾，内容不会被修改。
+ * @param[in] len 行长度（字节），须小于 `XF_CLI_MAX_LINE`。
+ *
+ * @return 最后一条被执行命令的返回值；空行返回 `XF_CMD_OK`，
+ *         超长的行返回 `XF_CMD_NO_MEM`，参数过多的行返回 `XF_CMD_NO_INVALID_ARG`。
+ */
+int xf_shell_exec_line(const char* line, size_t len);
+
+#if XF_SHELL_SUBMIT_SLOTS
+/**
+ * @brief 从其他任务提交一行命令，由 shell 任务执行（可在任意任务中调用）。
+ *
+ * @details
+ * 多生产者/单消费者无锁队列（`XF_SHELL_SUBMIT_SLOTS` 个槽位），命令行拷贝进槽位后立即返回，
+ * 不会阻塞；适用于 Web、MQTT、CAN 等协议处理任务调用 shell 命令。
+ * shell 任务在下次调用输入接口时按提交顺序逐条执行，规则同 `xf_shell_exec_line()`；
+ * 命令的输出不经过终端，收集后连同返回值交给 `done`，超过 `XF_SHELL_SUBMIT_OUT_SIZE`
+ * 字节的部分被丢弃。终端上有命令挂起（`XF_CMD_PENDING`）或输出未完成时，提交的命令顺延到其结束。
+ *
+ * @param[in] line 命令行，以 `\0` 结尾，长度须小于 `XF_CLI_MAX_LINE`。
+ * @param[in] done 完成回调，可为 `NULL`。
+ * @param[in] ctx 回调上下文指针。
+ *
+ * @return `XF_CMD_OK`；队列已满时返回 `XF_CMD_NO_MEM`，命令行为空指针或过长时返回 `XF_CMD_NO_INVALID_ARG`。
+ */
+int xf_shell_submit(const char* line, xf_shell_done_t done, void* ctx);
+#endif
+
+/**
+ * @brief 逐行执行内存中的命令脚本。
+ *
+ * @details
+ * 原地按行遍历 `buf`，不拷贝整个脚本，也不经过行编辑器（无回显、无历史）：
+ * 每行去掉行尾 `\r` 与行首空白后，空行和以 `#` 开头的注释行直接跳过，
+ * 其余行交给 `xf_shell_exec_line()`，因此一行内也可以用 `;`、`&&`、`||` 连接多条命令。
+ * 因为 `buf` 只读，命令行会先拷贝到栈上 `XF_CLI_MAX_LINE` 字节的行缓冲区再拆分。
+ *
+ * 命令返回非 `XF_CMD_OK` 视为失败；超过 `XF_CLI_MAX_LINE - 1` 字节的行不会截断执行，
+ * 按 `XF_CMD_NO_MEM` 失败处理。启用输入环形缓冲区时，执行期间收到的 `Ctrl-C`
+ * 会在当前命令结束后停止脚本，返回 `XF_CMD_INTERRUPTED`。
+ *
+ * @param[in] buf 脚本内容，无需以 `\0` 结尾。
+ * @param[in] len 脚本长度（字节）。
+ * @param[in] stop_on_error `true` 遇到第一条失败的命令即停止，`false` 继续执行后续行。
+ * @param[out] line 第一条失败命令所在行号（从 1 开始），全部成功时为 `0`，可为 `NULL`。
+ *
+ * @return 全部成功返回 `XF_CMD_OK`，否则为第一条失败命令的返回值。
+ */
+int xf_shell_exec_script(const char* buf, size_t len, bool stop_on_error, uint32_t* line);
+
+#if XF_SHELL_SCRIPT_MMAP
+/**
+ * @brief 通过 `mmap(2)` 映射并执行脚本文件。
+ *
+ * @details
+ * 文件以只读方式映射后交给 `xf_shell_exec_script()`，不读入额外缓冲区。
+ * 仅在 POSIX 主机上可用（`XF_SHELL_SCRIPT_MMAP`）。
+ *
+ * @param[in] path 脚本文件路径。
+ * @param[in] stop_on_error 同 `xf_shell_exec_script()`。
+ * @param[out] line 同 `xf_shell_exec_script()`，可为 `NULL`。
+ *
+ * @return 同 `xf_shell_exec_script()`；文件无法打开时返回 `XF_CMD_NO_INVALID_ARG`，
+ *         无法映射时返回 `XF_CMD_NO_MEM`。
+ */
+int xf_shell_exec_file(const char* path, bool stop_on_error, uint32_t* line);
+#endif
+
+/**
+ * @brief 通过控制台输出数据（先进入内部缓冲区）。
+ *
+ * @details
+ * 命令回调中使用本接口输出时，与 shell 自身的输出共用同一缓冲区，
+ * 在命令返回后随提示符一起整块发出。后台任务（`cmd &`，`XF_SHELL_BG_JOBS`）中
+ * 输出按行收集并加上 `[编号] ` 前缀，由 shell 任务在下次调用输入接口时输出。
+ *
+ * @param[in] data 数据。
+ * @param[in] len 数据长度（字节）。
+ */
+void xf_shell_write(const char* data, size_t len);
+
+/**
+ * @brief 通过控制台输出以 `\0` 结尾的字符串。
+ *
+ * @param[in] s 字符串。
+ */
+void xf_shell_puts(const char* s);
+
+/**
+ * @brief 立即把内部输出缓冲区的数据交给输出回调。
+ */
+void xf_shell_flush(void);
+
 /* ==================== [Macros] ============================================ */
 
 #ifndef XF_SHELL_COUNT_OF
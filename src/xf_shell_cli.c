@@ -9,40 +9,152 @@
 
 #include "xf_shell.h"
 #include "xf_shell_cli.h"
+#include "xf_shell_tokenizer.h"
 
 #define CTRL_R 0x12
 
-#define CLEAR_EOL "\x1b[0K"
-#define MOVE_BOL "\x1b[1G"
+#define CLEAR_EOL "\x1b[K"
+#define INSERT_CHAR "\x1b[@"
+#define DELETE_CHAR "\x1b[P"
 
-static void cli_putchar(struct xf_cli *cli, char ch, bool is_last)
+#define PASTE_ON "\x1b[?2004h"
+#define PASTE_BEGIN 200 /* ESC[200~ */
+#define PASTE_END 201   /* ESC[201~ */
+
+/* Input decoder states, see s_vt_table */
+enum {
+    VT_GROUND,
+    VT_ESC,
+    VT_CSI, /* ESC [ */
+    VT_SS3, /* ESC O */
+    VT_STATES,
+};
+
+/* Usable line length, the last byte of the buffer always stays '\0' */
+#define LINE_CAP ((int)sizeof(((struct xf_cli *)0)->buffer) - 1)
+
+/* Append raw bytes to the output buffer, flushing it whenever it fills up */
+static void cli_out(struct xf_cli *cli, const char *s, size_t n)
+{
+#if XF_CLI_CAPTURE
+    if (cli->cap.on) {
+        size_t k = n;
+
+        if (cli->cap.write != NULL) {
+            cli->cap.write(cli->cap.data, s, n);
+        } else {
+            if (k > cli->cap.size - cli->cap.len) {
+                k = cli->cap.size - cli->cap.len;
+            }
+            memcpy(&cli->cap.buf[cli->cap.len], s, k);
+        }
+        cli->cap.len += k;
+        return;
+    }
+#endif
+    while (n > 0) {
+        size_t room = sizeof(cli->out) - cli->out_len;
+        size_t k;
+
+        if (room == 0) {
+            xf_cli_flush(cli);
+            room = sizeof(cli->out);
+        }
+        k = n < room ? n : room;
+        memcpy(&cli->out[cli->out_len], s, k);
+        cli->out_len += k;
+        s += k;
+        n -= k;
+    }
+}
+
+void xf_cli_write(struct xf_cli *cli, const char *s, size_t n)
 {
-    if (cli->put_char) {
 #if XF_CLI_SERIAL_XLATE
-        if (ch == '\n' && !XF_SHELL_NEWLINE_IS_CRLF)
-            cli->put_char(cli->cb_data, '\r', false);
+    if (!XF_SHELL_NEWLINE_IS_CRLF) {
+        size_t start = 0;
+
+        for (size_t i = 0; i < n; i++) {
+            if (s[i] == '\n') {
+                cli_out(cli, &s[start], i - start);
+                cli_out(cli, "\r\n", 2);
+                start = i + 1;
+            }
+        }
+        cli_out(cli, &s[start], n - start);
+        return;
+    }
 #endif
-        cli->put_char(cli->cb_data, ch, is_last);
+    cli_out(cli, s, n);
+}
+
+void xf_cli_write_raw(struct xf_cli *cli, const char *s, size_t n)
+{
+    cli_out(cli, s, n);
+}
+
+void xf_cli_puts(struct xf_cli *cli, const char *s)
+{
+    xf_cli_write(cli, s, strlen(s));
+}
+
+void xf_cli_putc(struct xf_cli *cli, char ch)
+{
+    xf_cli_write(cli, &ch, 1);
+}
+
+void xf_cli_flush(struct xf_cli *cli)
+{
+    int n = cli->out_len;
+
+    if (n == 0)
+        return;
+    cli->out_len = 0;
+    if (cli->write) {
+        cli->write(cli->cb_data, cli->out, n);
+    } else if (cli->put_char) {
+        for (int i = 0; i < n; i++)
+            cli->put_char(cli->cb_data, cli->out[i], i == n - 1);
     }
 }
 
-static void cli_puts(struct xf_cli *cli, const char *s)
+#if XF_CLI_CAPTURE
+void xf_cli_capture_begin(struct xf_cli *cli, char *buf, size_t size)
 {
-    for (; *s; s++)
-        cli_putchar(cli, *s, s[1] == '\0');
+    cli->cap.on = true;
+    cli->cap.buf = buf;
+    cli->cap.size = size;
+    cli->cap.len = 0;
+    cli->cap.write = NULL;
 }
 
+void xf_cli_capture_stream(struct xf_cli *cli, void (*write)(void *data, const char *buf, size_t len),
+                           void *data)
+{
+    cli->cap.on = true;
+    cli->cap.len = 0;
+    cli->cap.write = write;
+    cli->cap.data = data;
+}
+
+size_t xf_cli_capture_end(struct xf_cli *cli)
+{
+    cli->cap.on = false;
+    return cli->cap.len;
+}
+#endif
+
 #if XF_CLI_COLORFUL
 static void cli_set_command_color(struct xf_cli *cli)
 {
-    cli_puts(cli, XF_CLI_COMMAND_COLOR);
+    xf_cli_puts(cli, XF_CLI_COMMAND_COLOR);
 }
 #endif
 
 static void cli_reset_color(struct xf_cli *cli)
 {
 #if XF_CLI_COLORFUL
-    cli_puts(cli, XF_CLI_COLOR_RESET);
+    xf_cli_puts(cli, XF_CLI_COLOR_RESET);
 #else
     (void)cli;
 #endif
@@ -51,12 +163,12 @@ static void cli_reset_color(struct xf_cli *cli)
 static void cli_put_prompt(struct xf_cli *cli)
 {
 #if XF_CLI_COLORFUL
-    cli_puts(cli, XF_CLI_PROMPT_COLOR);
-    cli_puts(cli, cli->prompt);
+    xf_cli_puts(cli, XF_CLI_PROMPT_COLOR);
+    xf_cli_puts(cli, cli->prompt);
     cli_reset_color(cli);
     cli_set_command_color(cli);
 #else
-    cli_puts(cli, cli->prompt);
+    xf_cli_puts(cli, cli->prompt);
 #endif
 }
 
@@ -64,20 +176,16 @@ static void xf_cli_reset_line(struct xf_cli *cli)
 {
     cli->len = 0;
     cli->cursor = 0;
-    cli->counter = 0;
-    cli->have_csi = cli->have_escape = false;
+    cli->vt_state = VT_GROUND;
 #if XF_CLI_HISTORY_LEN
     cli->history_pos = -1;
     cli->searching = false;
 #endif
 }
 
-void xf_cli_init(struct xf_cli *cli, const char *prompt,
-                       void (*put_char)(void *data, char ch, bool is_last),
-                       void *cb_data)
+static void cli_init(struct xf_cli *cli, const char *prompt, void *cb_data)
 {
     memset(cli, 0, sizeof(*cli));
-    cli->put_char = put_char;
     cli->cb_data = cb_data;
     if (prompt) {
         strncpy(cli->prompt, prompt, sizeof(cli->prompt));
@@ -87,39 +195,302 @@ void xf_cli_init(struct xf_cli *cli, const char *prompt,
     xf_cli_reset_line(cli);
 }
 
+void xf_cli_init(struct xf_cli *cli, const char *prompt,
+                       void (*put_char)(void *data, char ch, bool is_last),
+                       void *cb_data)
+{
+    cli_init(cli, prompt, cb_data);
+    cli->put_char = put_char;
+}
+
+void xf_cli_init_write(struct xf_cli *cli, const char *prompt,
+                       void (*write)(void *data, const char *buf, size_t len),
+                       void *cb_data)
+{
+    cli_init(cli, prompt, cb_data);
+    cli->write = write;
+}
+
+/*
+ * Gap buffer helpers. While editing, the text after the cursor is kept at
+ * the end of the buffer so inserting or deleting at the cursor is O(1).
+ */
+static int line_tail_len(const struct xf_cli *cli)
+{
+    return cli->len - cli->cursor;
+}
+
+static char *line_tail(struct xf_cli *cli)
+{
+    if (cli->flat)
+        return &cli->buffer[cli->cursor];
+    return &cli->buffer[LINE_CAP - line_tail_len(cli)];
+}
+
+static void line_open_gap(struct xf_cli *cli)
+{
+    int tail = line_tail_len(cli);
+
+    if (!cli->flat)
+        return;
+    if (tail > 0)
+        memmove(&cli->buffer[LINE_CAP - tail], &cli->buffer[cli->cursor], tail);
+    cli->flat = false;
+}
+
+void xf_cli_flatten(struct xf_cli *cli)
+{
+    int tail = line_tail_len(cli);
+
+    if (!cli->flat) {
+        if (tail > 0)
+            memmove(&cli->buffer[cli->cursor], &cli->buffer[LINE_CAP - tail],
+                    tail);
+        cli->flat = true;
+    }
+    cli->buffer[cli->len] = '\0';
+}
+
+static void line_move_cursor(struct xf_cli *cli, int pos)
+{
+    int tail;
+
+    line_open_gap(cli);
+    tail = line_tail_len(cli);
+    if (pos < cli->cursor) {
+        int n = cli->cursor - pos;
+        memmove(&cli->buffer[LINE_CAP - tail - n], &cli->buffer[pos], n);
+    } else if (pos > cli->cursor) {
+        int n = pos - cli->cursor;
+        memmove(&cli->buffer[cli->cursor], &cli->buffer[LINE_CAP - tail], n);
+    }
+    cli->cursor = pos;
+}
+
+static char line_char_at(const struct xf_cli *cli, int pos)
+{
+    if (cli->flat || pos < cli->cursor)
+        return cli->buffer[pos];
+    return cli->buffer[LINE_CAP - cli->len + pos];
+}
+
+/*
+ * Incremental token index. An edit re-lexes from the first token it may
+ * touch; as soon as the lexer is between tokens at a point that was also
+ * between tokens before the edit, the rest of the old index is still valid
+ * and is only shifted.
+ */
+void xf_cli_update_tokens(struct xf_cli *cli, int pos, int removed,
+                          int inserted)
+{
+    xf_shell_token_t old[XF_CLI_MAX_ARGC];
+    xf_shell_lexer_t lx;
+    int delta = inserted - removed;
+    int first, old_count, count, q;
+    int j = 0;
+    // A full index may hide later tokens, so then lex up to the end
+    bool resync = cli->token_count < XF_CLI_MAX_ARGC;
+
+    // A token ending at pos ends on the separator that may be edited
+    for (first = 0; first < cli->token_count; first++)
+        if (cli->tokens[first].end >= pos)
+            break;
+    old_count = cli->token_count - first;
+    memcpy(old, &cli->tokens[first], old_count * sizeof(old[0]));
+
+    count = first;
+    q = (old_count > 0 && old[0].start < pos) ? old[0].start : pos;
+    xf_shell_lexer_init(&lx);
+    for (; q < cli->len; q++) {
+        uint8_t ev;
+
+        if (resync && !lx.in_token && q >= pos + inserted) {
+            int x = q - delta;
+
+            while (j < old_count && old[j].end < x)
+                j++;
+            if (j == old_count || old[j].start >= x) {
+                for (; j < old_count && count < XF_CLI_MAX_ARGC; j++) {
+                    cli->tokens[count] = old[j];
+                    cli->tokens[count].start += delta;
+                    cli->tokens[count].end += delta;
+                    count++;
+                }
+                cli->token_count = count;
+                return;
+            }
+        }
+
+        ev = xf_shell_lexer_step(&lx, line_char_at(cli, q));
+        if (ev & XF_SHELL_LEX_END) {
+            cli->tokens[count - 1].end = q;
+            cli->tokens[count - 1].flags = xf_shell_lexer_kind(&lx);
+        } else if (ev & XF_SHELL_LEX_BEGIN) {
+            if (count >= XF_CLI_MAX_ARGC) {
+                cli->token_count = count;
+                return;
+            }
+            cli->tokens[count++].start = q;
+        }
+    }
+    if (lx.in_token) {
+        cli->tokens[count - 1].end = cli->len;
+        cli->tokens[count - 1].flags = xf_shell_lexer_kind(&lx);
+    }
+    cli->token_count = count;
+}
+
+/*
+ * Minimal-diff rendering. The screen always mirrors the prompt followed by
+ * the line, with the terminal cursor at cli->cursor. Every update sends
+ * only the part of the line that changed, using whichever cursor movement
+ * is cheapest in bytes.
+ */
+static int ansi_cost(int n)
+{
+    int cost = 3;
+
+    // "\x1b[D" moves one column, larger counts need their digits
+    if (n > 1)
+        for (; n > 0; n /= 10)
+            cost++;
+    return cost;
+}
+
 static void cli_ansi(struct xf_cli *cli, int n, char code)
 {
-    char buffer[5] = {'\x1b', '[', '0' + (n % 10), code, '\0'};
-    cli_puts(cli, buffer);
+    char buffer[16];
+    int len;
+
+    if (n == 1)
+        len = snprintf(buffer, sizeof(buffer), "\x1b[%c", code);
+    else
+        len = snprintf(buffer, sizeof(buffer), "\x1b[%d%c", n, code);
+    xf_cli_write(cli, buffer, len);
+}
+
+static void line_put_range(struct xf_cli *cli, int from, int to)
+{
+    if (from < cli->cursor) {
+        int end = to < cli->cursor ? to : cli->cursor;
+        xf_cli_write(cli, &cli->buffer[from], end - from);
+        from = end;
+    }
+    if (from < to)
+        xf_cli_write(cli, line_tail(cli) + (from - cli->cursor), to - from);
 }
 
 static void term_cursor_back(struct xf_cli *cli, int n)
 {
-    while (n > 0) {
-        int count = n > 9 ? 9 : n;
-        cli_ansi(cli, count, 'D');
-        n -= count;
+    if (n <= 0)
+        return;
+    if (n < ansi_cost(n)) {
+        while (n--)
+            xf_cli_putc(cli, '\b');
+    } else {
+        cli_ansi(cli, n, 'D');
     }
 }
 
-static void term_cursor_fwd(struct xf_cli *cli, int n)
+/* Move the terminal cursor between two columns of the current line */
+static void term_move(struct xf_cli *cli, int from, int to)
 {
-    while (n > 0) {
-        int count = n > 9 ? 9 : n;
-        cli_ansi(cli, count, 'C');
-        n -= count;
+    if (to < from) {
+        term_cursor_back(cli, from - to);
+    } else if (to - from < ansi_cost(to - from)) {
+        // Re-printing a few characters is shorter than an escape sequence
+        line_put_range(cli, from, to);
+    } else {
+        cli_ansi(cli, to - from, 'C');
     }
 }
 
-#if XF_CLI_HISTORY_LEN
-static void term_backspace(struct xf_cli *cli, int n)
+void xf_cli_refresh(struct xf_cli *cli, int from, int old_len, int old_cursor)
+{
+    term_move(cli, old_cursor, from);
+    line_put_range(cli, from, cli->len);
+    if (old_len > cli->len)
+        xf_cli_puts(cli, CLEAR_EOL);
+    term_move(cli, cli->len, cli->cursor);
+}
+
+void xf_cli_redraw(struct xf_cli *cli)
+{
+    uint16_t step = 0;
+
+    while (xf_cli_redraw_step(cli, step++)) {
+    }
+}
+
+void xf_cli_erase_line(struct xf_cli *cli)
+{
+    xf_cli_puts(cli, "\r" CLEAR_EOL);
+    // Whatever comes next is not command line text
+    cli_reset_color(cli);
+}
+
+void xf_cli_move_rows(struct xf_cli *cli, int rows)
+{
+    if (rows < 0) {
+        cli_ansi(cli, -rows, 'A');
+    } else if (rows > 0) {
+        cli_ansi(cli, rows, 'B');
+    }
+}
+
+void xf_cli_rewrite_row(struct xf_cli *cli, const char *s, size_t n)
+{
+    xf_cli_putc(cli, '\r');
+    xf_cli_write(cli, s, n);
+    xf_cli_puts(cli, CLEAR_EOL);
+}
+
+bool xf_cli_redraw_step(struct xf_cli *cli, uint16_t step)
+{
+    int from;
+
+    if (step == 0) {
+        xf_cli_putc(cli, '\r');
+        cli_put_prompt(cli);
+        return true;
+    }
+    // One output buffer worth of the line per step
+    from = (step - 1) * XF_CLI_OUT_BUF_SIZE;
+    if (from < cli->len) {
+        int to = from + XF_CLI_OUT_BUF_SIZE;
+        line_put_range(cli, from, to < cli->len ? to : cli->len);
+        return true;
+    }
+    xf_cli_puts(cli, CLEAR_EOL);
+    term_move(cli, cli->len, cli->cursor);
+    return false;
+}
+
+void xf_cli_job_start(struct xf_cli *cli, xf_cli_job_t job, void *ctx)
+{
+    while (xf_cli_job_step(cli)) {
+    }
+    cli->job = job;
+    cli->job_ctx = ctx;
+    cli->job_step = 0;
+}
+
+bool xf_cli_job_step(struct xf_cli *cli)
 {
-    while (n--)
-        cli_putchar(cli, '\b', n == 0);
+    if (cli->job == NULL) {
+        return false;
+    }
+    if (!cli->job(cli, cli->job_ctx, cli->job_step++)) {
+        cli->job = NULL;
+        return false;
+    }
+    return true;
 }
 
+#if XF_CLI_HISTORY_LEN
 static const char *xf_cli_get_history_search(struct xf_cli *cli)
 {
+    xf_cli_flatten(cli);
     for (int i = 0;; i++) {
         const char *h = xf_cli_get_history(cli, i);
         if (!h)
@@ -135,29 +506,115 @@ static void xf_cli_insert_default_char(struct xf_cli *cli,
                                              char ch)
 {
     // If the buffer is full, there's nothing we can do
-    if (cli->len >= (int)sizeof(cli->buffer) - 1)
+    if (cli->len >= LINE_CAP)
         return;
-    // Insert a gap in the buffer for the new character
-    memmove(&cli->buffer[cli->cursor + 1], &cli->buffer[cli->cursor],
-            cli->len - cli->cursor);
+    line_open_gap(cli);
     cli->buffer[cli->cursor] = ch;
     cli->len++;
-    cli->buffer[cli->len] = '\0';
     cli->cursor++;
+    xf_cli_update_tokens(cli, cli->cursor - 1, 0, 1);
 
 #if XF_CLI_HISTORY_LEN
     if (cli->searching) {
-        cli_puts(cli, MOVE_BOL CLEAR_EOL "search:");
+        xf_cli_puts(cli, "\r" CLEAR_EOL "search:");
         const char *h = xf_cli_get_history_search(cli);
         if (h)
-            cli_puts(cli, h);
+            xf_cli_puts(cli, h);
 
     } else
 #endif
-    {
-        cli_puts(cli, &cli->buffer[cli->cursor - 1]);
-        term_cursor_back(cli, cli->len - cli->cursor);
+    if (cli->cursor == cli->len) {
+        xf_cli_putc(cli, ch);
+    } else {
+#if XF_CLI_VT_EDIT
+        // Let the terminal shift the tail instead of reprinting it
+        xf_cli_puts(cli, INSERT_CHAR);
+        xf_cli_putc(cli, ch);
+#else
+        line_put_range(cli, cli->cursor - 1, cli->len);
+        term_move(cli, cli->len, cli->cursor);
+#endif
+    }
+}
+
+int xf_cli_insert_run(struct xf_cli *cli, const char *s, int n)
+{
+    int room = LINE_CAP - cli->len;
+    int k = n < room ? n : room;
+
+    if (n <= 0 || cli->vt_state != VT_GROUND)
+        return 0;
+#if XF_CLI_HISTORY_LEN
+    if (cli->searching)
+        return 0;
+#endif
+    if (cli->done) {
+        cli->buffer[0] = '\0';
+        cli->done = false;
+        cli->token_count = 0;
+    }
+#if XF_SHELL_PIPE_MODE
+    if (cli->raw) {
+        // Stored as is and never echoed, an overlong line is flagged
+        if (cli->len == 0)
+            cli->overflow = false;
+        if (k < n)
+            cli->overflow = true;
+        if (k > 0) {
+            memcpy(&cli->buffer[cli->len], s, k);
+            cli->len += k;
+            cli->cursor = cli->len;
+        }
+        return n;
+    }
+#endif
+    // If the buffer is full, the rest of the run is dropped
+    if (k <= 0)
+        return n;
+
+    line_open_gap(cli);
+    memcpy(&cli->buffer[cli->cursor], s, k);
+#if XF_CLI_BRACKETED_PASTE
+    if (cli->pasting) {
+        for (int i = cli->cursor; i < cli->cursor + k; i++) {
+            if (cli->buffer[i] == '\t')
+                cli->buffer[i] = ' ';
+        }
+        cli->paste_cr = false;
+    }
+#endif
+    cli->len += k;
+    cli->cursor += k;
+    xf_cli_update_tokens(cli, cli->cursor - k, 0, k);
+
+    // Echo what was stored, pasted tabs have become spaces
+    if (cli->cursor == cli->len) {
+        xf_cli_write(cli, &cli->buffer[cli->cursor - k], k);
+    } else {
+#if XF_CLI_VT_EDIT
+        cli_ansi(cli, k, '@');
+        xf_cli_write(cli, &cli->buffer[cli->cursor - k], k);
+#else
+        line_put_range(cli, cli->cursor - k, cli->len);
+        term_move(cli, cli->len, cli->cursor);
+#endif
     }
+    return n;
+}
+
+static void xf_cli_delete_at_cursor(struct xf_cli *cli)
+{
+    line_open_gap(cli);
+    // Dropping the first byte of the parked tail is just a length change
+    cli->len--;
+    xf_cli_update_tokens(cli, cli->cursor, 1, 0);
+#if XF_CLI_VT_EDIT
+    xf_cli_puts(cli, DELETE_CHAR);
+#else
+    line_put_range(cli, cli->cursor, cli->len);
+    xf_cli_puts(cli, " ");
+    term_cursor_back(cli, line_tail_len(cli) + 1);
+#endif
 }
 
 #if XF_CLI_HISTORY_LEN
@@ -191,7 +648,7 @@ static void xf_cli_extend_history(struct xf_cli *cli)
         if (strcmp(cli->buffer, cli->history) == 0)
             return;
         memmove(&cli->history[len + 1], &cli->history[0],
-                sizeof(cli->history) - len + 1);
+                sizeof(cli->history) - len - 1);
         memcpy(cli->history, cli->buffer, len + 1);
         // Make sure it's always nul terminated
         cli->history[sizeof(cli->history) - 1] = '\0';
@@ -207,209 +664,572 @@ static void xf_cli_stop_search(struct xf_cli *cli, bool print)
     } else
         cli->buffer[0] = '\0';
     cli->len = cli->cursor = strlen(cli->buffer);
+    cli->flat = true;
     cli->searching = false;
-    if (print) {
-        cli_puts(cli, MOVE_BOL CLEAR_EOL);
-        cli_put_prompt(cli);
-        cli_puts(cli, cli->buffer);
-    }
+    cli->token_count = 0;
+    xf_cli_update_tokens(cli, 0, 0, cli->len);
+    if (print)
+        xf_cli_redraw(cli);
+}
+
+/* Replace the whole line, only re-printing what differs from the screen */
+static void xf_cli_show_line(struct xf_cli *cli, const char *line)
+{
+    int old_len = cli->len;
+    int old_cursor = cli->cursor;
+    int len = strlen(line);
+    int from = 0;
+
+    if (len > LINE_CAP)
+        len = LINE_CAP;
+    xf_cli_flatten(cli);
+    while (from < len && from < old_len && cli->buffer[from] == line[from])
+        from++;
+    memcpy(&cli->buffer[from], &line[from], len - from);
+    cli->buffer[len] = '\0';
+    cli->len = cli->cursor = len;
+    xf_cli_update_tokens(cli, from, old_len - from, len - from);
+    xf_cli_refresh(cli, from, old_len, old_cursor);
 }
 #endif
 
-bool xf_cli_insert_char(struct xf_cli *cli, char ch)
+#if XF_CLI_BRACKETED_PASTE
+/*
+ * Pasted text is data: tabs become spaces and editing keys are dropped.
+ * Ctrl-C still gets through, so a lost ESC[201~ can't wedge the editor.
+ */
+static char xf_cli_paste_filter(struct xf_cli *cli, char ch)
 {
-    // If we're inserting a character just after a finished line, clear things
-    // up
-    if (cli->done) {
-        cli->buffer[0] = '\0';
-        cli->done = false;
-    }
-    if (cli->have_csi) {
-        if (ch >= '0' && ch <= '9' && cli->counter < 100) {
-            cli->counter = cli->counter * 10 + ch - '0';
+    bool after_cr = cli->paste_cr;
+
+    cli->paste_cr = (ch == '\r');
+    if (ch == '\t')
+        return ' ';
+    if (ch == '\n')
+        return after_cr ? '\0' : ch;
+    if (ch == '\r' || ch == '\x1b' || ch == '\x03' || (ch >= ' ' && ch < 0x7f))
+        return ch;
+    return '\0';
+}
+#endif
+
+#if XF_SHELL_PIPE_MODE
+void xf_cli_set_raw(struct xf_cli *cli, bool raw)
+{
+    // A half-typed line is dropped either way
+    xf_cli_reset_line(cli);
+    cli->buffer[0] = '\0';
+    cli->token_count = 0;
+    cli->done = false;
+    cli->pasting = false;
+    cli->overflow = false;
+    cli->raw = raw;
+}
+
+/* Pipe mode input, returns true when a non-blank line is finished */
+static bool cli_raw_char(struct xf_cli *cli, char ch)
+{
+    switch (ch) {
+    case '\r':
+    case '\n':
+        // Blank lines, and so the '\n' of "\r\n", are skipped
+        return cli->len > 0 || cli->overflow;
+    case '\x03':
+        cli->len = cli->cursor = 0;
+        cli->overflow = false;
+        return false;
+    default:
+        if (cli->len < LINE_CAP) {
+            cli->buffer[cli->len++] = ch;
+            cli->cursor = cli->len;
         } else {
-            if (cli->counter == 0)
-                cli->counter = 1;
-            switch (ch) {
-            case 'A': { // up arrow
-#if XF_CLI_HISTORY_LEN
-                // Backspace over our current line
-                term_backspace(cli, cli->done ? 0 : cli->cursor);
-                const char *line =
-                    xf_cli_get_history(cli, cli->history_pos + 1);
-                if (line) {
-                    int len = strlen(line);
-                    cli->history_pos++;
-                    strncpy(cli->buffer, line, sizeof(cli->buffer));
-                    cli->buffer[sizeof(cli->buffer) - 1] = '\0';
-                    cli->len = len;
-                    cli->cursor = len;
-                    cli_puts(cli, cli->buffer);
-                    cli_puts(cli, CLEAR_EOL);
-                } else {
-                    int tmp = cli->history_pos; // We don't want to wrap this
-                                                // history, so retain it
-                    cli->buffer[0] = '\0';
-                    xf_cli_reset_line(cli);
-                    cli->history_pos = tmp;
-                    cli_puts(cli, CLEAR_EOL);
-                }
+            cli->overflow = true;
+        }
+        return false;
+    }
+}
 #endif
-                break;
-            }
 
-            case 'B': { // down arrow
+void xf_cli_enable_paste(struct xf_cli *cli)
+{
+#if XF_CLI_BRACKETED_PASTE
+    xf_cli_puts(cli, PASTE_ON);
+#else
+    (void)cli;
+#endif
+}
+
+/*
+ * Input decoder. Every byte is mapped to a class, and the pair (state,
+ * class) selects the next state and an action, so escape sequences are
+ * decoded without nested conditionals. A finished sequence is looked up
+ * in s_vt_keys[] and handled by s_key_handlers[]; a new key is one entry
+ * in each table.
+ */
+
+/* Byte classes, the printable ones last */
+enum {
+    VC_CTRL,  /* C0 controls and DEL */
+    VC_ESC,   /* ESC */
+    VC_HIGH,  /* 0x80 and above, not handled by the editor */
+    VC_DIGIT, /* parameter digit */
+    VC_SEMI,  /* parameter separator */
+    VC_CSI,   /* [ */
+    VC_SS3,   /* O */
+    VC_FINAL, /* other final bytes, @ to ~ */
+    VC_OTHER, /* other printable, private markers and intermediates */
+    VC_CLASSES,
+};
+
+/* Decoder actions */
+enum {
+    VA_NONE,
+    VA_PRINT, /* insert the character */
+    VA_CTRL,  /* control key */
+    VA_ESC,   /* a sequence starts */
+    VA_PARAM, /* parameter digit */
+    VA_SEP,   /* next parameter */
+    VA_CSI,   /* ESC [ params final */
+    VA_SS3,   /* ESC O [modifier] final */
+};
+
+/* Keys produced by escape sequences */
+enum {
+    KEY_UP,
+    KEY_DOWN,
+    KEY_RIGHT,
+    KEY_LEFT,
+    KEY_HOME,
+    KEY_END,
+    KEY_DELETE,
+    KEY_WORD_RIGHT,
+    KEY_WORD_LEFT,
+    KEY_PASTE_BEGIN,
+    KEY_PASTE_END,
+};
+
+/* xterm modifier bits, the parameter is 1 + mask */
+#define MOD_ALT 0x02U
+#define MOD_CTRL 0x04U
+
+#define VT(next, action) ((uint8_t)(((next) << 4) | (action)))
+#define VT_NEXT(t) ((uint8_t)((t) >> 4))
+#define VT_ACTION(t) ((uint8_t)((t) & 0x0FU))
+
+#define C VC_CTRL
+#define E VC_ESC
+#define D VC_DIGIT
+#define S VC_SEMI
+#define B VC_CSI
+#define O VC_SS3
+#define F VC_FINAL
+#define X VC_OTHER
+static const uint8_t s_vt_class[128] = {
+    C, C, C, C, C, C, C, C, C, C, C, C, C, C, C, C, /* 0x00 */
+    C, C, C, C, C, C, C, C, C, C, C, E, C, C, C, C, /* 0x10 */
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, /* 0x20 */
+    D, D, D, D, D, D, D, D, D, D, X, S, X, X, X, X, /* 0x30 */
+    F, F, F, F, F, F, F, F, F, F, F, F, F, F, F, O, /* 0x40 */
+    F, F, F, F, F, F, F, F, F, F, F, B, F, F, F, F, /* 0x50 */
+    F, F, F, F, F, F, F, F, F, F, F, F, F, F, F, F, /* 0x60 */
+    F, F, F, F, F, F, F, F, F, F, F, F, F, F, F, C, /* 0x70 */
+};
+#undef C
+#undef E
+#undef D
+#undef S
+#undef B
+#undef O
+#undef F
+#undef X
+
+static const uint8_t s_vt_table[VT_STATES][VC_CLASSES] = {
+    [VT_GROUND] = {
+        [VC_CTRL] = VT(VT_GROUND, VA_CTRL),   [VC_ESC] = VT(VT_ESC, VA_ESC),
+        [VC_HIGH] = VT(VT_GROUND, VA_NONE),   [VC_DIGIT] = VT(VT_GROUND, VA_PRINT),
+        [VC_SEMI] = VT(VT_GROUND, VA_PRINT),  [VC_CSI] = VT(VT_GROUND, VA_PRINT),
+        [VC_SS3] = VT(VT_GROUND, VA_PRINT),   [VC_FINAL] = VT(VT_GROUND, VA_PRINT),
+        [VC_OTHER] = VT(VT_GROUND, VA_PRINT),
+    },
+    [VT_ESC] = {
+        [VC_CTRL] = VT(VT_GROUND, VA_CTRL),   [VC_ESC] = VT(VT_ESC, VA_ESC),
+        [VC_HIGH] = VT(VT_GROUND, VA_NONE),   [VC_DIGIT] = VT(VT_GROUND, VA_NONE),
+        [VC_SEMI] = VT(VT_GROUND, VA_NONE),   [VC_CSI] = VT(VT_CSI, VA_NONE),
+        [VC_SS3] = VT(VT_SS3, VA_NONE),       [VC_FINAL] = VT(VT_GROUND, VA_NONE),
+        [VC_OTHER] = VT(VT_GROUND, VA_NONE),
+    },
+    [VT_CSI] = {
+        [VC_CTRL] = VT(VT_GROUND, VA_CTRL),   [VC_ESC] = VT(VT_ESC, VA_ESC),
+        [VC_HIGH] = VT(VT_GROUND, VA_NONE),   [VC_DIGIT] = VT(VT_CSI, VA_PARAM),
+        [VC_SEMI] = VT(VT_CSI, VA_SEP),       [VC_CSI] = VT(VT_GROUND, VA_CSI),
+        [VC_SS3] = VT(VT_GROUND, VA_CSI),     [VC_FINAL] = VT(VT_GROUND, VA_CSI),
+        [VC_OTHER] = VT(VT_CSI, VA_NONE),
+    },
+    [VT_SS3] = {
+        [VC_CTRL] = VT(VT_GROUND, VA_CTRL),   [VC_ESC] = VT(VT_ESC, VA_ESC),
+        [VC_HIGH] = VT(VT_GROUND, VA_NONE),   [VC_DIGIT] = VT(VT_SS3, VA_PARAM),
+        [VC_SEMI] = VT(VT_GROUND, VA_NONE),   [VC_CSI] = VT(VT_GROUND, VA_SS3),
+        [VC_SS3] = VT(VT_GROUND, VA_SS3),     [VC_FINAL] = VT(VT_GROUND, VA_SS3),
+        [VC_OTHER] = VT(VT_GROUND, VA_NONE),
+    },
+};
+
+typedef struct {
+    char final;
+    uint8_t param; /* first parameter, 0 matches any */
+    uint8_t mods;  /* any of these modifiers must be held, 0 matches any */
+    uint8_t key;
+} vt_key_t;
+
+/* First match wins, so modified keys come before their plain form */
+static const vt_key_t s_vt_keys[] = {
+    {'C', 0, MOD_CTRL | MOD_ALT, KEY_WORD_RIGHT},
+    {'D', 0, MOD_CTRL | MOD_ALT, KEY_WORD_LEFT},
+    {'A', 0, 0, KEY_UP},
+    {'B', 0, 0, KEY_DOWN},
+    {'C', 0, 0, KEY_RIGHT},
+    {'D', 0, 0, KEY_LEFT},
+    {'H', 0, 0, KEY_HOME},
+    {'F', 0, 0, KEY_END},
+    {'~', 1, 0, KEY_HOME},
+    {'~', 7, 0, KEY_HOME},
+    {'~', 4, 0, KEY_END},
+    {'~', 8, 0, KEY_END},
+    {'~', 3, 0, KEY_DELETE},
+#if XF_CLI_BRACKETED_PASTE
+    {'~', PASTE_BEGIN, 0, KEY_PASTE_BEGIN},
+    {'~', PASTE_END, 0, KEY_PASTE_END},
+#endif
+};
+
+static uint8_t vt_class(char ch)
+{
+    unsigned char c = (unsigned char)ch;
+
+    return c < sizeof(s_vt_class) ? s_vt_class[c] : (uint8_t)VC_HIGH;
+}
+
+static void key_up(struct xf_cli *cli, int count)
+{
 #if XF_CLI_HISTORY_LEN
-                term_backspace(cli, cli->done ? 0 : cli->cursor);
-                const char *line =
-                    xf_cli_get_history(cli, cli->history_pos - 1);
-                if (line) {
-                    int len = strlen(line);
-                    cli->history_pos--;
-                    strncpy(cli->buffer, line, sizeof(cli->buffer));
-                    cli->buffer[sizeof(cli->buffer) - 1] = '\0';
-                    cli->len = len;
-                    cli->cursor = len;
-                    cli_puts(cli, cli->buffer);
-                    cli_puts(cli, CLEAR_EOL);
-                } else {
-                    cli->buffer[0] = '\0';
-                    xf_cli_reset_line(cli);
-                    cli_puts(cli, CLEAR_EOL);
-                }
+    const char *line = xf_cli_get_history(cli, cli->history_pos + 1);
+
+    (void)count;
+    if (line) {
+        cli->history_pos++;
+        xf_cli_show_line(cli, line);
+    } else {
+        // We don't want to wrap this history, so retain history_pos
+        xf_cli_show_line(cli, "");
+    }
+#else
+    (void)cli;
+    (void)count;
 #endif
-                break;
-            }
+}
 
-            case 'C':
-                if (cli->cursor <= cli->len - cli->counter) {
-                    cli->cursor += cli->counter;
-                    term_cursor_fwd(cli, cli->counter);
-                }
-                break;
-            case 'D':
-                if (cli->cursor >= cli->counter) {
-                    cli->cursor -= cli->counter;
-                    term_cursor_back(cli, cli->counter);
-                }
-                break;
-            case 'F':
-                term_cursor_fwd(cli, cli->len - cli->cursor);
-                cli->cursor = cli->len;
-                break;
-            case 'H':
-                term_cursor_back(cli, cli->cursor);
-                cli->cursor = 0;
-                break;
-            case '~':
-                if (cli->counter == 3) { // delete key
-                    if (cli->cursor < cli->len) {
-                        memmove(&cli->buffer[cli->cursor],
-                                &cli->buffer[cli->cursor + 1],
-                                cli->len - cli->cursor);
-                        cli->len--;
-                        cli_puts(cli, &cli->buffer[cli->cursor]);
-                        cli_puts(cli, " ");
-                        term_cursor_back(cli, cli->len - cli->cursor + 1);
-                    }
-                }
-                break;
-            default:
-                // TODO: Handle more escape sequences
-                break;
-            }
-            cli->have_csi = cli->have_escape = false;
-            cli->counter = 0;
-        }
+static void key_down(struct xf_cli *cli, int count)
+{
+#if XF_CLI_HISTORY_LEN
+    const char *line = xf_cli_get_history(cli, cli->history_pos - 1);
+
+    (void)count;
+    if (line) {
+        cli->history_pos--;
+        xf_cli_show_line(cli, line);
     } else {
-        switch (ch) {
-        case '\0':
-            break;
-        case '\x01':
-            // Go to the beginning of the line
-            term_cursor_back(cli, cli->cursor);
-            cli->cursor = 0;
-            break;
-        case '\x03':
-            cli_reset_color(cli);
-            cli_puts(cli, "^C" XF_SHELL_NEWLINE);
-            cli_put_prompt(cli);
-            xf_cli_reset_line(cli);
-            cli->buffer[0] = '\0';
-            break;
-        case '\x05': // Ctrl-E
-            term_cursor_fwd(cli, cli->len - cli->cursor);
-            cli->cursor = cli->len;
-            break;
-        case '\x0b': // Ctrl-K
-            cli_puts(cli, CLEAR_EOL);
-            cli->buffer[cli->cursor] = '\0';
+        xf_cli_show_line(cli, "");
+        cli->history_pos = -1;
+    }
+#else
+    (void)cli;
+    (void)count;
+#endif
+}
+
+static void cli_move_to(struct xf_cli *cli, int pos)
+{
+    term_move(cli, cli->cursor, pos);
+    line_move_cursor(cli, pos);
+}
+
+static void key_right(struct xf_cli *cli, int count)
+{
+    if (cli->cursor <= cli->len - count)
+        cli_move_to(cli, cli->cursor + count);
+}
+
+static void key_left(struct xf_cli *cli, int count)
+{
+    if (cli->cursor >= count)
+        cli_move_to(cli, cli->cursor - count);
+}
+
+static void key_home(struct xf_cli *cli, int count)
+{
+    (void)count;
+    cli_move_to(cli, 0);
+}
+
+static void key_end(struct xf_cli *cli, int count)
+{
+    (void)count;
+    cli_move_to(cli, cli->len);
+}
+
+static void key_delete(struct xf_cli *cli, int count)
+{
+    (void)count;
+    if (cli->cursor < cli->len)
+        xf_cli_delete_at_cursor(cli);
+}
+
+/* Word motion: skip separators, then the word itself */
+static void key_word_right(struct xf_cli *cli, int count)
+{
+    int pos = cli->cursor;
+
+    (void)count;
+    while (pos < cli->len && line_char_at(cli, pos) == ' ')
+        pos++;
+    while (pos < cli->len && line_char_at(cli, pos) != ' ')
+        pos++;
+    cli_move_to(cli, pos);
+}
+
+static void key_word_left(struct xf_cli *cli, int count)
+{
+    int pos = cli->cursor;
+
+    (void)count;
+    while (pos > 0 && line_char_at(cli, pos - 1) == ' ')
+        pos--;
+    while (pos > 0 && line_char_at(cli, pos - 1) != ' ')
+        pos--;
+    cli_move_to(cli, pos);
+}
+
+#if XF_CLI_BRACKETED_PASTE
+static void key_paste_begin(struct xf_cli *cli, int count)
+{
+    (void)count;
+    cli->pasting = true;
+    cli->paste_cr = false;
+}
+
+static void key_paste_end(struct xf_cli *cli, int count)
+{
+    (void)count;
+    cli->pasting = false;
+    cli->paste_cr = false;
+}
+#endif
+
+static void (*const s_key_handlers[])(struct xf_cli *cli, int count) = {
+    [KEY_UP] = key_up,
+    [KEY_DOWN] = key_down,
+    [KEY_RIGHT] = key_right,
+    [KEY_LEFT] = key_left,
+    [KEY_HOME] = key_home,
+    [KEY_END] = key_end,
+    [KEY_DELETE] = key_delete,
+    [KEY_WORD_RIGHT] = key_word_right,
+    [KEY_WORD_LEFT] = key_word_left,
+#if XF_CLI_BRACKETED_PASTE
+    [KEY_PASTE_BEGIN] = key_paste_begin,
+    [KEY_PASTE_END] = key_paste_end,
+#endif
+};
+
+/* Look up a finished sequence, param is its first parameter (0 if absent) */
+static void vt_dispatch(struct xf_cli *cli, char final, int param, int modifier)
+{
+    unsigned mods = modifier > 1 ? (unsigned)(modifier - 1) : 0U;
+    size_t i;
+
+    for (i = 0; i < sizeof(s_vt_keys) / sizeof(s_vt_keys[0]); i++) {
+        const vt_key_t *k = &s_vt_keys[i];
+
+        if (k->final != final)
+            continue;
+        if (k->param != 0 && k->param != param)
+            continue;
+        if (k->mods != 0 && (mods & k->mods) == 0)
+            continue;
+        s_key_handlers[k->key](cli, param > 0 ? param : 1);
+        return;
+    }
+}
+
+/* Control keys, returns true when the line is finished */
+static bool cli_control(struct xf_cli *cli, char ch)
+{
+    switch (ch) {
+    case '\x01':
+        // Go to the beginning of the line
+        cli_move_to(cli, 0);
+        break;
+    case '\x03':
+        cli->pasting = false;
+        cli_reset_color(cli);
+        xf_cli_puts(cli, "^C" XF_SHELL_NEWLINE);
+        cli_put_prompt(cli);
+        xf_cli_reset_line(cli);
+        cli->buffer[0] = '\0';
+        cli->token_count = 0;
+        break;
+    case '\x05': // Ctrl-E
+        cli_move_to(cli, cli->len);
+        break;
+    case '\x0b': // Ctrl-K
+        xf_cli_puts(cli, CLEAR_EOL);
+        // Forget the parked tail
+        line_open_gap(cli);
+        {
+            int tail = line_tail_len(cli);
             cli->len = cli->cursor;
-            break;
-        case '\x0c': // Ctrl-L
-            cli_puts(cli, MOVE_BOL CLEAR_EOL);
-            cli_put_prompt(cli);
-            cli_puts(cli, cli->buffer);
-            term_cursor_back(cli, cli->len - cli->cursor);
-            break;
-        case '\b': // Backspace
-        case 0x7f: // backspace?
+            xf_cli_update_tokens(cli, cli->cursor, tail, 0);
+        }
+        break;
+    case '\x0c': // Ctrl-L
+        xf_cli_redraw(cli);
+        break;
+    case '\b': // Backspace
+    case 0x7f: // backspace?
 #if XF_CLI_HISTORY_LEN
-            if (cli->searching)
-                xf_cli_stop_search(cli, true);
-#endif
-            if (cli->cursor > 0) {
-                memmove(&cli->buffer[cli->cursor - 1],
-                        &cli->buffer[cli->cursor],
-                        cli->len - cli->cursor + 1);
-                cli->cursor--;
-                cli->len--;
+        if (cli->searching)
+            xf_cli_stop_search(cli, true);
+#endif
+        if (cli->cursor > 0) {
+            line_open_gap(cli);
+            cli->cursor--;
+            cli->len--;
+            xf_cli_update_tokens(cli, cli->cursor, 1, 0);
+            if (cli->cursor == cli->len) {
+                xf_cli_puts(cli, "\b \b");
+            } else {
+#if XF_CLI_VT_EDIT
+                xf_cli_puts(cli, "\b" DELETE_CHAR);
+#else
                 term_cursor_back(cli, 1);
-                cli_puts(cli, &cli->buffer[cli->cursor]);
-                cli_puts(cli, " ");
-                term_cursor_back(cli, cli->len - cli->cursor + 1);
+                line_put_range(cli, cli->cursor, cli->len);
+                xf_cli_puts(cli, " ");
+                term_cursor_back(cli, line_tail_len(cli) + 1);
+#endif
             }
-            break;
-        case CTRL_R:
+        }
+        break;
+    case CTRL_R:
 #if XF_CLI_HISTORY_LEN
-            if (!cli->searching) {
-                cli_puts(cli, XF_SHELL_NEWLINE "search:");
-                cli->searching = true;
-            }
+        if (!cli->searching) {
+            xf_cli_puts(cli, XF_SHELL_NEWLINE "search:");
+            cli->searching = true;
+        }
 #endif
-            break;
-        case '\x1b':
-#if XF_CLI_HISTORY_LEN
-            if (cli->searching)
-                xf_cli_stop_search(cli, true);
+        break;
+    case '\r':
+    case '\n':
+        cli_reset_color(cli);
+        xf_cli_puts(cli, XF_SHELL_NEWLINE);
+        return true;
+    default:
+        break;
+    }
+    return false;
+}
+
+int xf_cli_scan_run(const struct xf_cli *cli, const char *s, int n)
+{
+    int i = 0;
+
+    if (cli->vt_state != VT_GROUND)
+        return 0;
+#if XF_SHELL_PIPE_MODE
+    if (cli->raw) {
+        while (i < n && s[i] != '\r' && s[i] != '\n' && s[i] != '\x03')
+            i++;
+        return i;
+    }
 #endif
-            cli->have_csi = false;
-            cli->have_escape = true;
-            cli->counter = 0;
-            break;
-        case '[':
-            if (cli->have_escape)
-                cli->have_csi = true;
-            else
-                xf_cli_insert_default_char(cli, ch);
-            break;
-        case '\r':
-#if XF_CLI_SERIAL_XLATE
-            ch = '\n'; // So cli->done will exit
+#if XF_CLI_BRACKETED_PASTE
+    if (cli->pasting) {
+        while (i < n && (vt_class(s[i]) >= VC_DIGIT || s[i] == '\t'))
+            i++;
+        return i;
+    }
 #endif
-            // fallthrough
-        case '\n':
-            cli_reset_color(cli);
-            cli_puts(cli, XF_SHELL_NEWLINE);
-            break;
-        default:
-            if (ch > 0)
-                xf_cli_insert_default_char(cli, ch);
+    while (i < n && vt_class(s[i]) >= VC_DIGIT)
+        i++;
+    return i;
+}
+
+bool xf_cli_insert_char(struct xf_cli *cli, char ch)
+{
+    uint8_t t;
+
+    // If we're inserting a character just after a finished line, clear things
+    // up
+    if (cli->done) {
+        cli->buffer[0] = '\0';
+        cli->done = false;
+        cli->token_count = 0;
+    }
+#if XF_SHELL_PIPE_MODE
+    if (cli->raw) {
+        if (cli->len == 0)
+            cli->overflow = false;
+        cli->done = cli_raw_char(cli, ch);
+        if (cli->done) {
+            cli->buffer[cli->len] = '\0';
+            cli->len = cli->cursor = 0;
         }
+        return cli->done;
+    }
+#endif
+#if XF_CLI_BRACKETED_PASTE
+    if (cli->pasting && cli->vt_state == VT_GROUND)
+        ch = xf_cli_paste_filter(cli, ch);
+#endif
+
+    t = s_vt_table[cli->vt_state][vt_class(ch)];
+    cli->vt_state = VT_NEXT(t);
+    switch (VT_ACTION(t)) {
+    case VA_PRINT:
+        xf_cli_insert_default_char(cli, ch);
+        break;
+    case VA_CTRL:
+        cli->done = cli_control(cli, ch);
+        break;
+    case VA_ESC:
+#if XF_CLI_HISTORY_LEN
+        if (cli->searching)
+            xf_cli_stop_search(cli, true);
+#endif
+        cli->vt_param[0] = cli->vt_param[1] = 0;
+        cli->vt_second = false;
+        break;
+    case VA_PARAM: {
+        uint16_t *p = &cli->vt_param[cli->vt_second];
+        if (*p < 100)
+            *p = *p * 10 + ch - '0';
+        break;
+    }
+    case VA_SEP:
+        cli->vt_second = true;
+        break;
+    case VA_CSI:
+        vt_dispatch(cli, ch, cli->vt_param[0], cli->vt_param[1]);
+        break;
+    case VA_SS3:
+        // ESC O may carry a modifier digit, but never a count
+        vt_dispatch(cli, ch, 0, cli->vt_param[0]);
+        break;
+    default:
+        break;
     }
-    cli->done = (ch == '\n' || ch == '\r');
 
     if (cli->done) {
+        xf_cli_flatten(cli);
 #if XF_CLI_HISTORY_LEN
         if (cli->searching)
             xf_cli_stop_search(cli, false);
@@ -428,85 +1248,47 @@ const char *xf_cli_get_line(const struct xf_cli *cli)
     return cli->buffer;
 }
 
-static bool is_whitespace(char ch)
+int xf_cli_argc(struct xf_cli *cli, char *argv[XF_CLI_MAX_ARGC])
 {
-    return (ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r');
-}
+    int argc = 0;
 
-int xf_cli_argc(struct xf_cli *cli, char ***argv)
-{
-    int pos = 0;
-    bool in_arg = false;
-    bool in_escape = false;
-    char in_string = '\0';
-    if (!cli->done)
-        return 0;
-    for (size_t i = 0; i < sizeof(cli->buffer) && cli->buffer[i] != '\0';
-         i++) {
-
-        // If we're escaping this character, just absorb it regardless
-        if (in_escape) {
-            in_escape = false;
-            continue;
-        }
-
-        if (in_string) {
-            // If we're finishing a string, blank it out
-            if (cli->buffer[i] == in_string) {
-                memmove(&cli->buffer[i], &cli->buffer[i + 1],
-                        sizeof(cli->buffer) - i - 1);
-                in_string = '\0';
-                i--;
-            }
-            continue;
-        }
-
-        // Skip over whitespace, and replace it with nul terminators so
-        // each argv is nul terminated
-        if (is_whitespace(cli->buffer[i])) {
-            if (in_arg)
-                cli->buffer[i] = '\0';
-            in_arg = false;
-            continue;
-        }
-
-        if (!in_arg) {
-            if (pos >= XF_CLI_MAX_ARGC) {
-                break;
-            }
-            cli->argv[pos] = &cli->buffer[i];
-            pos++;
-            in_arg = true;
-        }
-
-        if (cli->buffer[i] == '\\') {
-            // Absorb the escape character
-            memmove(&cli->buffer[i], &cli->buffer[i + 1],
-                    sizeof(cli->buffer) - i - 1);
-            i--;
-            in_escape = true;
-        }
-
-        // If we're starting a new string, absorb the character and shuffle
-        // things back
-        if (cli->buffer[i] == '\'' || cli->buffer[i] == '"') {
-            in_string = cli->buffer[i];
-            memmove(&cli->buffer[i], &cli->buffer[i + 1],
-                    sizeof(cli->buffer) - i - 1);
-            i--;
+#if XF_SHELL_PIPE_MODE
+    // Raw lines have no token index, split them once here
+    if (cli->raw) {
+        if (!cli->done || cli->overflow) {
+            argv[0] = NULL;
+            return cli->done ? -1 : 0;
         }
+        return xf_shell_tokenize(cli->buffer, LINE_CAP, argv, XF_CLI_MAX_ARGC);
     }
-    // Traditionally, there is a NULL entry at argv[argc].
-    if (pos >= XF_CLI_MAX_ARGC) {
-        pos--;
+#endif
+    // The index holds one token more than argv, so a full index is too many
+    if (cli->done && cli->token_count >= XF_CLI_MAX_ARGC) {
+        argv[0] = NULL;
+        return -1;
     }
-    cli->argv[pos] = NULL;
+    // Traditionally, there is a NULL entry at argv[argc]
+    for (; cli->done && argc < cli->token_count; argc++) {
+        const xf_shell_token_t *tok = &cli->tokens[argc];
+        char *arg = &cli->buffer[tok->start];
 
-    *argv = cli->argv;
-    return pos;
+        // The separator after each token becomes its terminator
+        if (tok->flags & XF_SHELL_TOKEN_QUOTED)
+            xf_shell_token_copy(cli->buffer, tok->start, tok->end, arg,
+                                tok->end - tok->start + 1);
+        else
+            arg[tok->end - tok->start] = '\0';
+        // Operators are told apart from quoted look-alikes by address
+        if ((tok->flags & XF_SHELL_TOKEN_KIND_MASK) == XF_SHELL_TOKEN_OPERATOR)
+            arg = xf_shell_chain_word(arg);
+        argv[argc] = arg;
+    }
+    argv[argc] = NULL;
+    return argc;
 }
 
 void xf_cli_prompt(struct xf_cli *cli)
 {
     cli_put_prompt(cli);
+    xf_cli_flush(cli);
 }
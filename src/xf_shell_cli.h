@@ -2,7 +2,41 @@
 #define __XF_SHELL_CLI_H__
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "xf_shell_config_internal.h"
+#include "xf_shell_tokenizer.h"
+
+struct xf_cli;
+
+/**
+ * @brief 可分步执行的输出任务（如命令列表、候选列表）。
+ *
+ * @details
+ * 每次调用只输出一步（通常是一行），长输出因此可以分散到多次轮询中完成。
+ *
+ * @param[in,out] cli CLI 状态对象。
+ * @param[in] ctx 启动任务时传入的上下文。
+ * @param[in] step 步骤序号，从 0 开始。
+ *
+ * @return `true` 还有后续步骤，`false` 任务已完成。
+ */
+typedef bool (*xf_cli_job_t)(struct xf_cli *cli, void *ctx, uint16_t step);
+
+#if XF_CLI_CAPTURE
+/**
+ * Where output goes instead of the terminal, see xf_cli_capture_begin().
+ * Callers that nest captures save and restore the whole struct.
+ */
+struct xf_cli_capture {
+    bool on;
+    char *buf;    /* collected here, unless write is set */
+    size_t size;
+    size_t len;   /* bytes collected or streamed */
+    void (*write)(void *data, const char *buf, size_t len);
+    void *data;
+};
+#endif
 
 /**
  * This is the structure which defines the current state of the CLI
@@ -12,43 +46,103 @@
  * structure, but all elements of the structure should be considered private
  */
 struct xf_cli {
+    /*
+     * Hot editing state first, so a keystroke touches as few cache lines
+     * as possible. Positions are only as wide as XF_CLI_MAX_LINE needs.
+     */
+
     /**
-     * Internal buffer. This should not be accessed directly, use the
-     * access functions below
+     * Number of characters in buffer at the moment
      */
-    char buffer[XF_CLI_MAX_LINE];
+    xf_shell_pos_t len;
 
-#if XF_CLI_HISTORY_LEN
     /**
-     * List of history entries
+     * Position of the cursor
      */
-    char history[XF_CLI_HISTORY_LEN];
+    xf_shell_pos_t cursor;
+
+    /**
+     * Number of valid entries in tokens[]
+     */
+    uint8_t token_count;
 
+    /**
+     * Have we just parsed a full line?
+     */
+    bool done : 1;
+
+    /**
+     * Is the buffer currently a contiguous string (gap closed)?
+     */
+    bool flat : 1;
+
+    /**
+     * The escape sequence parameter being read is the second one
+     */
+    bool vt_second : 1;
+
+    /**
+     * Inside an ESC[200~ ... ESC[201~ bracketed paste
+     */
+    bool pasting : 1;
+
+    /**
+     * The last pasted character was '\r', so a following '\n' is dropped
+     */
+    bool paste_cr : 1;
+
+#if XF_SHELL_PIPE_MODE
+    /**
+     * Pipe mode: lines are collected as they are, without editing or echo
+     */
+    bool raw : 1;
+
+    /**
+     * The raw line did not fit in the buffer
+     */
+    bool overflow : 1;
+#endif
+
+#if XF_CLI_HISTORY_LEN
     /**
      * Are we searching through the history?
      */
-    bool searching;
+    bool searching : 1;
 
     /**
      * How far back in the history are we?
      */
-    int history_pos;
+    int16_t history_pos;
 #endif
 
     /**
-     * Number of characters in buffer at the moment
+     * Input decoder state and escape sequence parameters
      */
-    int len;
+    uint8_t vt_state;
+    uint16_t vt_param[2];
 
     /**
-     * Position of the cursor
+     * Bytes waiting in out[]
      */
-    int cursor;
+    uint16_t out_len;
 
     /**
-     * Have we just parsed a full line?
+     * Internal buffer. This should not be accessed directly, use the
+     * access functions below.
+     * While editing, it is a gap buffer: the text before the cursor lives at
+     * the start, the text after the cursor is parked at the end (just before
+     * the final byte, which always stays '\0'), and the gap sits in between.
+     * Call xf_cli_flatten() to get a plain nul terminated string.
+     */
+    char buffer[XF_CLI_MAX_LINE];
+
+    /**
+     * Token index of the line, in logical positions. It is updated on every
+     * edit, so completion and dispatch never need to scan the line again.
+     * Holds at most XF_CLI_MAX_ARGC tokens, later ones are ignored.
+     * Once a line is done, these offsets are also its argv.
      */
-    bool done;
+    xf_shell_token_t tokens[XF_CLI_MAX_ARGC];
 
     /**
      * Callback function to output a single character to the user
@@ -58,21 +152,42 @@ struct xf_cli {
     void (*put_char)(void *data, char ch, bool is_last);
 
     /**
-     * Data to provide to the put_char callback
+     * Block output callback, used instead of put_char when set
+     */
+    void (*write)(void *data, const char *buf, size_t len);
+
+    /**
+     * Data to provide to the put_char / write callback
      */
     void *cb_data;
 
-    bool have_escape;
-    bool have_csi;
+    /**
+     * Resumable output job, NULL when idle
+     */
+    xf_cli_job_t job;
+    void *job_ctx;
+    uint16_t job_step;
 
     /**
-     * counter of the value for the CSI code
+     * Output is coalesced here and handed to the callback on xf_cli_flush()
      */
-    int counter;
+    char out[XF_CLI_OUT_BUF_SIZE];
 
-    char *argv[XF_CLI_MAX_ARGC];
+#if XF_CLI_CAPTURE
+    /**
+     * While on, output lands here instead of out[], see xf_cli_capture_begin()
+     */
+    struct xf_cli_capture cap;
+#endif
 
     char prompt[XF_CLI_MAX_PROMPT_LEN];
+
+#if XF_CLI_HISTORY_LEN
+    /**
+     * List of history entries
+     */
+    char history[XF_CLI_HISTORY_LEN];
+#endif
 };
 
 /**
@@ -91,6 +206,110 @@ void xf_cli_init(struct xf_cli *, const char *prompt,
                  void (*put_char)(void *data, char ch, bool is_last),
                  void *cb_data);
 
+/**
+ * @brief 以块输出回调初始化 CLI 核心状态对象。
+ *
+ * @details
+ * 与 `xf_cli_init()` 相同，但输出以整块形式交给 `write`，
+ * 每次 `xf_cli_flush()` 最多调用一次（缓冲区写满时除外）。
+ *
+ * @param[in,out] cli CLI 状态对象。
+ * @param[in] prompt 提示符字符串（会复制到内部缓存）。
+ * @param[in] write 块输出回调。
+ * @param[in] cb_data 回调透传上下文。
+ */
+void xf_cli_init_write(struct xf_cli *cli, const char *prompt,
+                       void (*write)(void *data, const char *buf, size_t len),
+                       void *cb_data);
+
+/**
+ * @brief 向输出缓冲追加数据。
+ *
+ * @details
+ * 所有输出都先进入 `XF_CLI_OUT_BUF_SIZE` 字节的内部缓冲区，缓冲区满或调用
+ * `xf_cli_flush()` 时才交给输出回调。开启 `XF_CLI_SERIAL_XLATE` 时，
+ * 单独的 `\n` 会被转换为 `\r\n`。
+ *
+ * @param[in,out] cli CLI 状态对象。
+ * @param[in] s 数据。
+ * @param[in] n 数据长度。
+ */
+void xf_cli_write(struct xf_cli *cli, const char *s, size_t n);
+
+/**
+ * @brief 向输出缓冲追加数据，不做换行转换（如二进制数据）。
+ *
+ * @param[in,out] cli CLI 状态对象。
+ * @param[in] s 数据。
+ * @param[in] n 数据长度。
+ */
+void xf_cli_write_raw(struct xf_cli *cli, const char *s, size_t n);
+
+/**
+ * @brief 向输出缓冲追加以 `\0` 结尾的字符串。
+ *
+ * @param[in,out] cli CLI 状态对象。
+ * @param[in] s 字符串。
+ */
+void xf_cli_puts(struct xf_cli *cli, const char *s);
+
+/**
+ * @brief 向输出缓冲追加单个字符。
+ *
+ * @param[in,out] cli CLI 状态对象。
+ * @param[in] ch 字符。
+ */
+void xf_cli_putc(struct xf_cli *cli, char ch);
+
+/**
+ * @brief 将输出缓冲中的数据交给输出回调。
+ *
+ * @details
+ * 使用单字符回调时，`is_last` 只在本次刷新的最后一个字符上置位。
+ * `xf_cli_prompt()` 会自动刷新；直接使用 CLI 内核时，
+ * 每批输入处理完后也应调用本函数。
+ *
+ * @param[in,out] cli CLI 状态对象。
+ */
+void xf_cli_flush(struct xf_cli *cli);
+
+#if XF_CLI_CAPTURE
+/**
+ * @brief 开始把输出收集到调用方的缓冲区，而不是发往终端。
+ *
+ * @details
+ * 此后经 `xf_cli_write()` 等接口的输出（含换行转换后的 `\r\n`）依次写入 `buf`，
+ * 写满后多余的部分被丢弃。`xf_cli_flush()` 仍只发送开始前已在缓冲区中的输出。
+ *
+ * @param[in,out] cli CLI 状态对象。
+ * @param[out] buf 收集缓冲区。
+ * @param[in] size 缓冲区大小（字节）。
+ */
+void xf_cli_capture_begin(struct xf_cli *cli, char *buf, size_t size);
+
+/**
+ * @brief 开始把输出原样交给回调，而不是发往终端。
+ *
+ * @details
+ * 每段输出直接以原指针交给 `write`，不经过输出缓冲，也不拷贝。其余同 `xf_cli_capture_begin()`。
+ *
+ * @param[in,out] cli CLI 状态对象。
+ * @param[in] write 输出回调。
+ * @param[in] data 回调透传上下文。
+ */
+void xf_cli_capture_stream(struct xf_cli *cli, void (*write)(void *data, const char *buf, size_t len),
+                           void *data);
+
+/**
+ * @brief 结束收集，之后的输出恢复发往终端。
+ *
+ * @param[in,out] cli CLI 状态对象。
+ *
+ * @return 收集到（或交给回调）的字节数。
+ */
+size_t xf_cli_capture_end(struct xf_cli *cli);
+#endif
+
 /**
  * @brief 向 CLI 输入缓冲插入一个字符并更新编辑状态。
  *
@@ -109,6 +328,183 @@ void xf_cli_init(struct xf_cli *, const char *prompt,
  */
 bool xf_cli_insert_char(struct xf_cli *cli, char ch);
 
+/**
+ * @brief 返回 `s` 开头可以整段交给 `xf_cli_insert_run()` 的字符数。
+ *
+ * @details
+ * 按输入解码器的字符分类逐字节判断，遇到控制字符、`ESC` 或非 ASCII 字节即停止；
+ * 正在解析转义序列时返回 `0`。管道模式下只在行结束符与 `Ctrl-C` 处停止。
+ *
+ * @param[in] cli CLI 状态对象。
+ * @param[in] s 输入数据。
+ * @param[in] n 数据长度。
+ *
+ * @return 可整段插入的字符数。
+ */
+int xf_cli_scan_run(const struct xf_cli *cli, const char *s, int n);
+
+/**
+ * @brief 在光标处插入一段可打印字符。
+ *
+ * @details
+ * 与逐个调用 `xf_cli_insert_char()` 的显示结果相同，但只做一次拷贝、
+ * 一次 token 索引更新与一次回显。行缓冲已满时多余字符被丢弃。
+ * 正在解析转义序列或处于历史搜索模式时不处理，返回 `0`，
+ * 调用方应改为逐字符输入。
+ *
+ * @param[in,out] cli CLI 状态对象。
+ * @param[in] s 字符序列，只能包含可打印字符（`' '` 到 `'~'`），
+ *              括号粘贴期间还可以包含 `Tab`（按空格插入）。
+ * @param[in] n 字符个数。
+ *
+ * @return 已消费的字符数（`0` 或 `n`）。
+ */
+int xf_cli_insert_run(struct xf_cli *cli, const char *s, int n);
+
+/**
+ * @brief 将内部间隙缓冲整理为连续的 `\0` 结尾字符串。
+ *
+ * @details
+ * 编辑过程中光标后的文本暂存在缓冲区尾部，插入/删除只需 O(1)。
+ * 需要按普通字符串访问 `buffer` 时（如 Tab 补全）先调用本函数；
+ * 之后的编辑操作会在需要时自动重新打开间隙。
+ *
+ * @param[in,out] cli CLI 状态对象。
+ */
+void xf_cli_flatten(struct xf_cli *cli);
+
+/**
+ * @brief 在行内容被外部修改后，以最少输出同步终端显示。
+ *
+ * @details
+ * 终端显示始终等于“提示符 + 当前行”，光标位于 `cli->cursor`。
+ * 调用方（如 Tab 补全）直接改写 `buffer` 后，只需告知修改前的行长度、
+ * 光标位置以及首个发生变化的列，本函数会移动到该列、重绘其后的内容、
+ * 必要时清除行尾，并把光标移回 `cli->cursor`。
+ * 光标移动会在退格、多位数 CSI 序列与重打字符之间选择字节数最少的方式。
+ *
+ * @param[in,out] cli CLI 状态对象。
+ * @param[in] from 首个发生变化的列（相对提示符之后）。
+ * @param[in] old_len 修改前的行长度。
+ * @param[in] old_cursor 修改前的光标位置。
+ */
+void xf_cli_refresh(struct xf_cli *cli, int from, int old_len, int old_cursor);
+
+/**
+ * @brief 在行内容被外部修改后更新 token 索引。
+ *
+ * @details
+ * 表示逻辑区间 `[pos, pos + removed)` 被替换为 `inserted` 个新字符。
+ * 只对受影响的 token 重新做词法分析，一旦词法状态与修改前重新对齐，
+ * 其后的 token 仅平移位置，开销与修改附近的 token 长度成正比。
+ *
+ * @param[in,out] cli CLI 状态对象（`cli->len` 须已是修改后的长度）。
+ * @param[in] pos 修改起始位置。
+ * @param[in] removed 被删除的字符数。
+ * @param[in] inserted 新插入的字符数。
+ */
+void xf_cli_update_tokens(struct xf_cli *cli, int pos, int removed, int inserted);
+
+#if XF_SHELL_PIPE_MODE
+/**
+ * @brief 切换管道（非交互）输入模式。
+ *
+ * @details
+ * 管道模式下不再经过行编辑器：输入不回显、不解析转义序列、不记录历史，
+ * 字节原样收集到行缓冲区，遇到 `\r` 或 `\n` 结束一行（空行被跳过，`\r\n` 只算一次），
+ * `Ctrl-C` 丢弃当前行。需要 `XF_SHELL_PIPE_MODE`。
+ *
+ * @param[in,out] cli CLI 状态对象。
+ * @param[in] raw `true` 进入管道模式，`false` 恢复交互编辑。
+ */
+void xf_cli_set_raw(struct xf_cli *cli, bool raw);
+#endif
+
+/**
+ * @brief 开启终端的括号粘贴模式（输出 `ESC[?2004h`）。
+ *
+ * @details
+ * 开启后终端会用 `ESC[200~`/`ESC[201~` 包裹粘贴的文本。粘贴内容中的 `Tab`
+ * 按空格插入而不触发补全，其他控制字符被忽略，`\r\n` 只结束一行。
+ * 需要 `XF_CLI_BRACKETED_PASTE`。
+ *
+ * @param[in,out] cli CLI 状态对象。
+ */
+void xf_cli_enable_paste(struct xf_cli *cli);
+
+/**
+ * @brief 回到行首并完整重绘提示符与当前行。
+ *
+ * @details
+ * 用于终端内容已失效的场景（如 Ctrl-L、补全候选列表输出之后）。
+ *
+ * @param[in,out] cli CLI 状态对象。
+ */
+void xf_cli_redraw(struct xf_cli *cli);
+
+/**
+ * @brief 清除终端上的提示符与当前行，光标回到行首。
+ *
+ * @details
+ * 用于在编辑中的行之前插入其他输出（如后台任务的输出），之后调用 `xf_cli_redraw()` 恢复。
+ * 行缓冲区内容不变。
+ *
+ * @param[in,out] cli CLI 状态对象。
+ */
+void xf_cli_erase_line(struct xf_cli *cli);
+
+/**
+ * @brief 将光标上移或下移若干行，列不变。
+ *
+ * @param[in,out] cli CLI 状态对象。
+ * @param[in] rows 移动的行数，负数上移，正数下移，0 不移动。
+ */
+void xf_cli_move_rows(struct xf_cli *cli, int rows);
+
+/**
+ * @brief 回到行首，用给定文本改写光标所在的一行并清除行尾。
+ *
+ * @param[in,out] cli CLI 状态对象。
+ * @param[in] s 文本，不含换行。
+ * @param[in] n 文本长度（字节）。
+ */
+void xf_cli_rewrite_row(struct xf_cli *cli, const char *s, size_t n);
+
+/**
+ * @brief 分步重绘：输出 `xf_cli_redraw()` 的第 `step` 步。
+ *
+ * @details
+ * 第 0 步输出提示符，之后每步最多输出 `XF_CLI_OUT_BUF_SIZE` 个行内字符，
+ * 最后一步清除行尾并恢复光标。可直接在 `xf_cli_job_t` 中调用。
+ *
+ * @param[in,out] cli CLI 状态对象。
+ * @param[in] step 步骤序号，从 0 开始。
+ *
+ * @return `true` 还有后续步骤。
+ */
+bool xf_cli_redraw_step(struct xf_cli *cli, uint16_t step);
+
+/**
+ * @brief 启动分步输出任务。
+ *
+ * @details
+ * 若已有未完成的任务，会先将其执行完毕。任务由 `xf_cli_job_step()` 推进。
+ *
+ * @param[in,out] cli CLI 状态对象。
+ * @param[in] job 任务函数。
+ * @param[in] ctx 任务上下文。
+ */
+void xf_cli_job_start(struct xf_cli *cli, xf_cli_job_t job, void *ctx);
+
+/**
+ * @brief 执行当前任务的下一步。
+ *
+ * @param[in,out] cli CLI 状态对象。
+ *
+ * @return `true` 任务仍未完成；没有任务或任务刚完成时返回 `false`。
+ */
+bool xf_cli_job_step(struct xf_cli *cli);
+
 /**
  * @brief 获取当前已完成命令行的内部字符串指针。
  *
@@ -123,20 +519,26 @@ const char *xf_cli_get_line(const struct xf_cli *cli);
  * @brief 将内部命令行按参数拆分为 `argc/argv` 形式。
  *
  * @details
- * 拆分结果写入 `cli` 内部的 `argv` 数组，并通过 `argv` 输出指针返回。
+ * 直接使用编辑过程中维护的 token 索引，不再重新扫描整行：
+ * 每个 token 原地以 `\0` 结尾，仅含引号或转义符的 token 需要原地去引号。
+ * `cli` 内只保存 token 偏移，指针数组由调用方提供（通常位于栈上）。
+ * 连接运算符 `;`、`&&`、`||`、`&` 输出为 `xf_shell_chain_words` 中的常量。
+ * 管道模式下行缓冲区在行结束时一次性拆分。
+ * 参数多于 `XF_CLI_MAX_ARGC - 1` 个，或管道模式下该行超出 `XF_CLI_MAX_LINE` 被截断时，
+ * 该行不会被部分拆分，调用方应整行不执行。
  *
  * @param[in,out] cli CLI 状态对象。
- * @param[out] argv 输出参数数组指针。
+ * @param[out] argv 输出参数数组，容量为 `XF_CLI_MAX_ARGC`，`argv[argc]` 为 `NULL`。
  *
- * @return 参数个数，最大不超过 `XF_CLI_MAX_ARGC`。
+ * @return 参数个数，最大为 `XF_CLI_MAX_ARGC - 1`；无法完整拆分时返回 `-1`。
  */
-int xf_cli_argc(struct xf_cli *cli, char ***argv);
+int xf_cli_argc(struct xf_cli *cli, char *argv[XF_CLI_MAX_ARGC]);
 
 /**
  * @brief 输出提示符并准备下一轮输入。
  *
  * @details
- * 一般在命令处理完成后调用，使终端回到可输入状态。
+ * 一般在命令处理完成后调用，使终端回到可输入状态。提示符输出后会刷新输出缓冲。
  *
  * @param[in,out] cli CLI 状态对象。
  */
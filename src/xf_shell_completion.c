@@ -10,6 +10,7 @@
  */
 
 /* ==================== [Includes] ========================================== */
+#include "xf_shell_config_internal.h"
 #if XF_SHELL_COMPLETION_ENABLE
 #include "xf_shell_completion.h"
 #include "xf_shell_cli.h"
@@ -19,12 +20,10 @@
 #include <stdio.h>
 #include <string.h>
 #include "xf_shell.h"
+#include "xf_shell_tokenizer.h"
 
 /* ==================== [Defines] =========================================== */
 
-#define CLEAR_EOL "\x1b[0K"
-#define MOVE_BOL "\x1b[1G"
-
 /* ==================== [Typedefs] ========================================== */
 
 typedef xf_shell_cmd_t cmd_item_t;
@@ -34,11 +33,6 @@ typedef xf_opt_arg_t cmd_opt_t;
 
 static bool is_whitespace(char ch);
 static bool starts_with(const char* str, const char* prefix);
-static int copy_prefix_from_line(const struct xf_cli* cli,
-                                 int start,
-                                 int cursor,
-                                 char prefix[],
-                                 int prefix_size);
 static cmd_item_t* find_command_by_name(cmd_item_t *const *cmd_table,
                                         int cmd_count,
                                         const char* name);
@@ -73,24 +67,24 @@ static void resolve_value_completion(const xf_completion_words_t* completion,
                                      int* match_count);
 #endif
 static cmd_item_t* resolve_current_command(const struct xf_cli* cli,
+                                           const xf_shell_token_t tokens[],
+                                           int token_count,
                                            cmd_item_t *const *cmd_table,
                                            int cmd_count);
 static int common_prefix_len(char matches[][XF_CLI_MAX_LINE], int match_count);
-static bool replace_prefix(struct xf_cli* cli, int start, int cursor, const char* replacement);
+static bool replace_prefix(struct xf_cli* cli, int start, int cursor, const char* replacement,
+                           int* changed_from);
 static bool insert_space_if_needed(struct xf_cli* cli);
-static void cli_putchar(struct xf_cli* cli, char ch, bool is_last);
-static void cli_puts(struct xf_cli* cli, const char* s);
-static void cli_ansi(struct xf_cli* cli, int n, char code);
-static void term_cursor_back(struct xf_cli* cli, int n);
-static void redraw_line(struct xf_cli* cli);
 #if XF_SHELL_COMPLETION_ENABLE_SUGGESTIONS
-static void print_suggestions(struct xf_cli *cli,
-                              char matches[][XF_CLI_MAX_LINE],
-                              int match_count);
+static bool suggestion_job(struct xf_cli *cli, void *ctx, uint16_t step);
 #endif
 
 /* ==================== [Static Variables] ================================== */
 
+#if XF_SHELL_COMPLETION_ENABLE && XF_SHELL_COMPLETION_ENABLE_SUGGESTIONS
+static int s_suggestion_count = 0;
+#endif
+
 /* ==================== [Macros] ============================================ */
 
 /* ==================== [Global Functions] ================================== */
@@ -103,54 +97,69 @@ bool xf_shell_completion_handle_tab(struct xf_cli *cli,
                                     char matches[][XF_CLI_MAX_LINE],
                                     int max_matches)
 {
+    const xf_shell_token_t* tokens;
+    int token_count;
+    int token_index;
     int token_start;
     int prefix_len;
-    bool first_token = true;
-    int token_end;
-    bool at_token_end;
+    int i;
+    bool first_token;
+    bool at_token_end = true;
     char prefix[XF_CLI_MAX_LINE];
     int candidate_budget = 0;
     int match_count = 0;
     cmd_item_t* cmd = NULL;
     int replace_start;
     int replace_cursor;
+    int old_len;
+    int old_cursor;
+    int changed_from;
 
     if (cli == NULL || cmd_table == NULL || cmd_count < 0 ||
         matches == NULL || max_matches <= 0) {
         return false;
     }
 
-    if (cli->len < 0) {
-        cli->len = 0;
-    }
-    if (cli->cursor < 0) {
-        cli->cursor = 0;
-    }
     if (cli->cursor > cli->len) {
         cli->cursor = cli->len;
     }
-    cli->buffer[cli->len] = '\0';
+    xf_cli_flatten(cli);
+    old_len = cli->len;
+    old_cursor = cli->cursor;
 
+    /* The editor keeps the token index current, same rules as dispatch. */
+    tokens = cli->tokens;
+    token_count = cli->token_count;
     token_start = cli->cursor;
-    while (token_start > 0 && !is_whitespace(cli->buffer[token_start - 1])) {
-        token_start--;
+    for (token_index = 0; token_index < token_count; ++token_index) {
+        if (cli->cursor < tokens[token_index].start) {
+            break;
+        }
+        if (cli->cursor <= tokens[token_index].end) {
+            token_start = tokens[token_index].start;
+            at_token_end = (cli->cursor == tokens[token_index].end);
+            break;
+        }
     }
-
-    for (int i = 0; i < token_start; ++i) {
-        if (!is_whitespace(cli->buffer[i])) {
-            first_token = false;
+    if (token_index < token_count &&
+        (tokens[token_index].flags & XF_SHELL_TOKEN_KIND_MASK) == XF_SHELL_TOKEN_OPERATOR) {
+        xf_cli_putc(cli, '\a');
+        return true;
+    }
+    /* In a chained line only the command around the cursor counts. */
+    for (i = token_index - 1; i >= 0; --i) {
+        if ((tokens[i].flags & XF_SHELL_TOKEN_KIND_MASK) == XF_SHELL_TOKEN_OPERATOR) {
+            tokens += i + 1;
+            token_count -= i + 1;
+            token_index -= i + 1;
             break;
         }
     }
+    first_token = (token_index == 0);
 
-    prefix_len = copy_prefix_from_line(cli, token_start, cli->cursor,
-                                       prefix, (int)sizeof(prefix));
+    prefix_len = xf_shell_token_copy(cli->buffer, token_start, cli->cursor,
+                                     prefix, (int)sizeof(prefix));
 
-    token_end = cli->cursor;
-    while (token_end < cli->len && !is_whitespace(cli->buffer[token_end])) {
-        token_end++;
-    }
-    at_token_end = (token_end == cli->cursor);
     replace_start = token_start;
     replace_cursor = cli->cursor;
 
@@ -159,16 +168,17 @@ bool xf_shell_completion_handle_tab(struct xf_cli *cli,
                                               prefix, matches, max_matches,
                                               &candidate_budget);
     } else {
-        cmd = resolve_current_command(cli, cmd_table, cmd_count);
+        cmd = resolve_current_command(cli, tokens, token_count, cmd_table, cmd_count);
         if (cmd != NULL) {
 #if XF_SHELL_COMPLETION_ENABLE_VALUE
             xf_shell_completion_context_t context;
 
-            xf_shell_completion_resolve_context(cli, cmd, cli->cursor, &context);
+            xf_shell_completion_resolve_context(cli, tokens, token_count, cmd, cli->cursor,
+                                                &context);
 
             if (context.inline_opt != NULL) {
-                prefix_len = copy_prefix_from_line(cli, context.inline_value_start, cli->cursor,
-                                                   prefix, (int)sizeof(prefix));
+                prefix_len = xf_shell_token_copy(cli->buffer, context.inline_value_start,
+                                                 cli->cursor, prefix, (int)sizeof(prefix));
                 replace_start = context.inline_value_start;
                 replace_cursor = cli->cursor;
 
@@ -200,25 +210,26 @@ bool xf_shell_completion_handle_tab(struct xf_cli *cli,
     }
 
     if (candidate_budget <= 0) {
-        cli_putchar(cli, '\a', true);
+        xf_cli_putc(cli, '\a');
         return true;
     }
 
     if (match_count <= 0) {
-        cli_putchar(cli, '\a', true);
+        xf_cli_putc(cli, '\a');
         return true;
     }
 
     if (match_count == 1) {
-        bool replaced = replace_prefix(cli, replace_start, replace_cursor, matches[0]);
+        bool replaced = replace_prefix(cli, replace_start, replace_cursor, matches[0],
+                                       &changed_from);
         if (!replaced) {
-            cli_putchar(cli, '\a', true);
+            xf_cli_putc(cli, '\a');
             return true;
         }
         if (at_token_end) {
             (void)insert_space_if_needed(cli);
         }
-        redraw_line(cli);
+        xf_cli_refresh(cli, changed_from, old_len, old_cursor);
         return true;
     }
 
@@ -228,19 +239,20 @@ bool xf_shell_completion_handle_tab(struct xf_cli *cli,
             char lcp[XF_CLI_MAX_LINE];
             memcpy(lcp, matches[0], (size_t)lcp_len);
             lcp[lcp_len] = '\0';
-            if (!replace_prefix(cli, replace_start, replace_cursor, lcp)) {
-                cli_putchar(cli, '\a', true);
+            if (!replace_prefix(cli, replace_start, replace_cursor, lcp, &changed_from)) {
+                xf_cli_putc(cli, '\a');
                 return true;
             }
-            redraw_line(cli);
+            xf_cli_refresh(cli, changed_from, old_len, old_cursor);
             return true;
         }
     }
 
 #if XF_SHELL_COMPLETION_ENABLE_SUGGESTIONS
-    print_suggestions(cli, matches, match_count);
+    // The list can be long, it is printed one line per job step
+    s_suggestion_count = match_count;
+    xf_cli_job_start(cli, suggestion_job, matches);
 #endif
-    redraw_line(cli);
     return true;
 }
 #endif
@@ -264,38 +276,6 @@ static bool starts_with(const char* str, const char* prefix) {
     return true;
 }
 
-static int copy_prefix_from_line(const struct xf_cli* cli,
-                                 int start,
-                                 int cursor,
-                                 char prefix[],
-                                 int prefix_size) {
-    int len;
-
-    if (cli == NULL || prefix == NULL || prefix_size <= 0) {
-        return 0;
-    }
-
-    if (start < 0) {
-        start = 0;
-    }
-    if (cursor < start) {
-        cursor = start;
-    }
-    if (cursor > cli->len) {
-        cursor = cli->len;
-    }
-
-    len = cursor - start;
-    if (len >= prefix_size) {
-        len = prefix_size - 1;
-    }
-    if (len > 0) {
-        memcpy(prefix, &cli->buffer[start], (size_t)len);
-    }
-    prefix[len] = '\0';
-    return len;
-}
-
 static cmd_item_t* find_command_by_name(cmd_item_t *const *cmd_table,
                                         int cmd_count,
                                         const char* name) {
@@ -490,36 +470,34 @@ static void resolve_value_completion(const xf_completion_words_t* completion,
 #endif
 
 static cmd_item_t* resolve_current_command(const struct xf_cli* cli,
+                                           const xf_shell_token_t tokens[],
+                                           int token_count,
                                            cmd_item_t *const *cmd_table,
                                            int cmd_count) {
-    int start = 0;
-    int end = 0;
-    int cmd_len;
     char command[XF_CLI_MAX_LINE];
+    int len;
+    int i;
 
-    if (cli == NULL || cmd_table == NULL || cmd_count <= 0) {
+    if (cli == NULL || cmd_table == NULL || cmd_count <= 0 || token_count <= 0) {
         return NULL;
     }
 
-    while (start < cli->len && is_whitespace(cli->buffer[start])) {
-        start++;
-    }
-    end = start;
-    while (end < cli->len && !is_whitespace(cli->buffer[end])) {
-        end++;
+    if (tokens[0].flags & XF_SHELL_TOKEN_QUOTED) {
+        (void)xf_shell_token_copy(cli->buffer, tokens[0].start, tokens[0].end,
+                                  command, (int)sizeof(command));
+        return find_command_by_name(cmd_table, cmd_count, command);
     }
 
-    cmd_len = end - start;
-    if (cmd_len <= 0) {
-        return NULL;
-    }
-    if (cmd_len >= (int)sizeof(command)) {
-        cmd_len = (int)sizeof(command) - 1;
+    /* Plain command names are compared in place. */
+    len = tokens[0].end - tokens[0].start;
+    for (i = 0; i < cmd_count; ++i) {
+        cmd_item_t* it = cmd_table[i];
+        if (it != NULL && strncmp(it->command, &cli->buffer[tokens[0].start], (size_t)len) == 0 &&
+            it->command[len] == '\0') {
+            return it;
+        }
     }
-
-    memcpy(command, &cli->buffer[start], (size_t)cmd_len);
-    command[cmd_len] = '\0';
-    return find_command_by_name(cmd_table, cmd_count, command);
+    return NULL;
 }
 
 static int common_prefix_len(char matches[][XF_CLI_MAX_LINE], int match_count)
@@ -542,10 +520,12 @@ static int common_prefix_len(char matches[][XF_CLI_MAX_LINE], int match_count)
     return common_len;
 }
 
-static bool replace_prefix(struct xf_cli* cli, int start, int cursor, const char* replacement) {
+static bool replace_prefix(struct xf_cli* cli, int start, int cursor, const char* replacement,
+                           int* changed_from) {
     int old_len = cursor - start;
     int rep_len = (int)strlen(replacement);
     int new_len = cli->len - old_len + rep_len;
+    int same = 0;
 
     if (start < 0 || cursor < start || cursor > cli->len) {
         return false;
@@ -554,11 +534,18 @@ static bool replace_prefix(struct xf_cli* cli, int start, int cursor, const char
         return false;
     }
 
+    /* Completions usually extend the typed prefix, which stays on screen. */
+    while (same < old_len && same < rep_len && cli->buffer[start + same] == replacement[same]) {
+        same++;
+    }
+    *changed_from = start + same;
+
     memmove(&cli->buffer[start + rep_len], &cli->buffer[cursor], (size_t)(cli->len - cursor + 1));
     memcpy(&cli->buffer[start], replacement, (size_t)rep_len);
     cli->len = new_len;
     cli->cursor = start + rep_len;
     cli->buffer[cli->len] = '\0';
+    xf_cli_update_tokens(cli, start, old_len, rep_len);
     return true;
 }
 
@@ -575,79 +562,30 @@ static bool insert_space_if_needed(struct xf_cli* cli) {
     cli->cursor++;
     cli->len++;
     cli->buffer[cli->len] = '\0';
+    xf_cli_update_tokens(cli, cli->cursor - 1, 0, 1);
     return true;
 }
 
-static void cli_putchar(struct xf_cli* cli, char ch, bool is_last) {
-    if (cli->put_char == NULL) {
-        return;
-    }
-#if XF_CLI_SERIAL_XLATE
-    if (ch == '\n' && !XF_SHELL_NEWLINE_IS_CRLF) {
-        cli->put_char(cli->cb_data, '\r', false);
-    }
-#endif
-    cli->put_char(cli->cb_data, ch, is_last);
-}
-
-static void cli_puts(struct xf_cli* cli, const char* s) {
-    for (; *s != '\0'; s++) {
-        cli_putchar(cli, *s, s[1] == '\0');
-    }
-}
-
-static void cli_ansi(struct xf_cli* cli, int n, char code) {
-    char buffer[16];
-    int len;
-
-    if (n <= 0) {
-        return;
-    }
-    len = snprintf(buffer, sizeof(buffer), "\x1b[%d%c", n, code);
-    if (len <= 0) {
-        return;
-    }
-    for (int i = 0; i < len && buffer[i] != '\0'; ++i) {
-        cli_putchar(cli, buffer[i], (i == len - 1));
-    }
-}
-
-static void term_cursor_back(struct xf_cli* cli, int n) {
-    cli_ansi(cli, n, 'D');
-}
-
-static void redraw_line(struct xf_cli* cli) {
-    cli_puts(cli, MOVE_BOL CLEAR_EOL);
-#if XF_CLI_COLORFUL
-    cli_puts(cli, XF_CLI_PROMPT_COLOR);
-    cli_puts(cli, cli->prompt);
-    cli_puts(cli, XF_CLI_COLOR_RESET);
-    cli_puts(cli, XF_CLI_COMMAND_COLOR);
-#else
-    cli_puts(cli, cli->prompt);
-#endif
-    cli_puts(cli, cli->buffer);
-    if (cli->cursor < cli->len) {
-        term_cursor_back(cli, cli->len - cli->cursor);
-    }
-}
-
 #if XF_SHELL_COMPLETION_ENABLE_SUGGESTIONS
-static void print_suggestions(struct xf_cli *cli,
-                              char matches[][XF_CLI_MAX_LINE],
-                              int match_count)
+static bool suggestion_job(struct xf_cli *cli, void *ctx, uint16_t step)
 {
-    int i;
+    char (*matches)[XF_CLI_MAX_LINE] = (char (*)[XF_CLI_MAX_LINE])ctx;
 
+    if (step == 0) {
 #if XF_CLI_COLORFUL
-    cli_puts(cli, XF_CLI_COLOR_RESET);
+        xf_cli_puts(cli, XF_CLI_COLOR_RESET);
 #endif
-    cli_puts(cli, XF_SHELL_NEWLINE);
-    for (i = 0; i < match_count; ++i) {
-        cli_puts(cli, "  ");
-        cli_puts(cli, matches[i]);
-        cli_puts(cli, XF_SHELL_NEWLINE);
+        xf_cli_puts(cli, XF_SHELL_NEWLINE);
+        return true;
+    }
+    if (step <= s_suggestion_count) {
+        xf_cli_puts(cli, "  ");
+        xf_cli_puts(cli, matches[step - 1]);
+        xf_cli_puts(cli, XF_SHELL_NEWLINE);
+        return true;
     }
+    // Then redraw the line below the list
+    return xf_cli_redraw_step(cli, (uint16_t)(step - s_suggestion_count - 1));
 }
 #endif
 #endif
@@ -45,6 +45,7 @@ struct xf_cli;
  * - 若位于参数值位置，则补全该位置参数/选项已注册的候选词。
  *
  * 同时函数会在需要时输出候选列表，并重绘当前输入行。
+ * 候选列表以 `xf_cli_job_t` 任务的形式启动，调用者需用 `xf_cli_job_step()` 推进。
  *
  * @param[in,out] cli CLI 状态对象，会被就地修改（buffer/cursor/len）。
  * @param[in] cmd_table 已注册命令指针数组。
@@ -16,22 +16,22 @@ typedef xf_shell_cmd_t cmd_item_t;
 typedef xf_opt_arg_t cmd_opt_t;
 typedef xf_arg_t cmd_arg_t;
 
-typedef struct {
-    int start;
-    int end;
-} token_span_t;
+typedef xf_shell_token_t token_span_t;
 
 /* ==================== [Static Prototypes] ================================= */
 
-static bool is_whitespace(char ch);
 static cmd_opt_t* find_option_by_long_name(cmd_item_t* cmd, const char* name, int len);
 static cmd_opt_t* find_option_by_short_name(cmd_item_t* cmd, char short_opt);
 static cmd_arg_t* find_argument_by_index(cmd_item_t* cmd, int index);
-static int tokenize_line(const struct xf_cli* cli, token_span_t tokens[], int max_tokens);
 static int locate_cursor_token(const token_span_t tokens[],
                                int token_count,
                                int cursor,
                                bool* has_current_token);
+static const char* token_text(const struct xf_cli* cli,
+                              const token_span_t* token,
+                              char* scratch,
+                              int scratch_size,
+                              int* len);
 static void analyze_tokens_before_cursor(const struct xf_cli* cli,
                                          cmd_item_t* cmd,
                                          const token_span_t tokens[],
@@ -48,11 +48,11 @@ static cmd_opt_t* resolve_inline_value_option(const struct xf_cli* cli,
 /* ==================== [Global Functions] ================================== */
 
 void xf_shell_completion_resolve_context(const struct xf_cli* cli,
+                                         const xf_shell_token_t tokens[],
+                                         int token_count,
                                          xf_shell_cmd_t* cmd,
                                          int cursor,
                                          xf_shell_completion_context_t* out) {
-    token_span_t tokens[XF_CLI_MAX_ARGC];
-    int token_count;
     bool has_current_token = false;
     int cursor_token_index;
     cmd_opt_t* pending_opt = NULL;
@@ -67,7 +67,7 @@ void xf_shell_completion_resolve_context(const struct xf_cli* cli,
     out->pending_opt = NULL;
     out->positional_arg = NULL;
 
-    if (cli == NULL || cmd == NULL) {
+    if (cli == NULL || cmd == NULL || tokens == NULL) {
         return;
     }
 
@@ -78,7 +78,6 @@ void xf_shell_completion_resolve_context(const struct xf_cli* cli,
         cursor = cli->len;
     }
 
-    token_count = tokenize_line(cli, tokens, XF_CLI_MAX_ARGC);
     cursor_token_index = locate_cursor_token(tokens, token_count, cursor,
                                              &has_current_token);
 
@@ -99,10 +98,6 @@ void xf_shell_completion_resolve_context(const struct xf_cli* cli,
 
 /* ==================== [Static Functions] ================================== */
 
-static bool is_whitespace(char ch) {
-    return (ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r');
-}
-
 static cmd_opt_t* find_option_by_long_name(cmd_item_t* cmd, const char* name, int len) {
     uint16_t i;
 
@@ -161,33 +156,6 @@ static cmd_arg_t* find_argument_by_index(cmd_item_t* cmd, int index) {
     return cmd->_args[index];
 }
 
-static int tokenize_line(const struct xf_cli* cli, token_span_t tokens[], int max_tokens) {
-    int i = 0;
-    int count = 0;
-
-    if (cli == NULL || tokens == NULL || max_tokens <= 0) {
-        return 0;
-    }
-
-    while (i < cli->len && count < max_tokens) {
-        while (i < cli->len && is_whitespace(cli->buffer[i])) {
-            i++;
-        }
-        if (i >= cli->len) {
-            break;
-        }
-
-        tokens[count].start = i;
-        while (i < cli->len && !is_whitespace(cli->buffer[i])) {
-            i++;
-        }
-        tokens[count].end = i;
-        count++;
-    }
-
-    return count;
-}
-
 static int locate_cursor_token(const token_span_t tokens[],
                                int token_count,
                                int cursor,
@@ -213,6 +181,21 @@ static int locate_cursor_token(const token_span_t tokens[],
     return token_count;
 }
 
+/* Unquoted tokens are read in place, only quoted ones need a copy. */
+static const char* token_text(const struct xf_cli* cli,
+                              const token_span_t* token,
+                              char* scratch,
+                              int scratch_size,
+                              int* len) {
+    if (token->flags & XF_SHELL_TOKEN_QUOTED) {
+        *len = xf_shell_token_copy(cli->buffer, token->start, token->end,
+                                   scratch, scratch_size);
+        return scratch;
+    }
+    *len = token->end - token->start;
+    return &cli->buffer[token->start];
+}
+
 static void analyze_tokens_before_cursor(const struct xf_cli* cli,
                                          cmd_item_t* cmd,
                                          const token_span_t tokens[],
@@ -242,14 +225,11 @@ static void analyze_tokens_before_cursor(const struct xf_cli* cli,
         return;
     }
 
+    /* The editor keeps each token's lexical kind, only option names are read. */
     for (i = 1; i < cursor_token_index; ++i) {
-        int start = tokens[i].start;
-        int end = tokens[i].end;
-        int len = end - start;
-
-        if (len <= 0) {
-            continue;
-        }
+        char scratch[XF_CLI_MAX_LINE];
+        const char* text;
+        int len;
 
         if (*pending_opt != NULL) {
             *pending_opt = NULL;
@@ -261,54 +241,25 @@ static void analyze_tokens_before_cursor(const struct xf_cli* cli,
             continue;
         }
 
-        if (len == 2 && cli->buffer[start] == '-' && cli->buffer[start + 1] == '-') {
+        switch (tokens[i].flags & XF_SHELL_TOKEN_KIND_MASK) {
+        case XF_SHELL_TOKEN_WORD:
+            (*positional_count)++;
+            break;
+        case XF_SHELL_TOKEN_END_OPTS:
             force_positional = true;
-            continue;
-        }
-
-        if (cli->buffer[start] == '-' && len > 1) {
-            if (cli->buffer[start + 1] == '-') {
-                int name_start = start + 2;
-                int eq = -1;
-
-                for (int j = name_start; j < end; ++j) {
-                    if (cli->buffer[j] == '=') {
-                        eq = j;
-                        break;
-                    }
-                }
-
-                if (eq >= 0) {
-                    continue;
-                }
-
-                if (name_start < end) {
-                    cmd_opt_t* opt = find_option_by_long_name(cmd,
-                                                              &cli->buffer[name_start],
-                                                              end - name_start);
-                    if (opt != NULL) {
-                        *pending_opt = opt;
-                    }
-                }
-                continue;
-            }
-
-            if (len == 2) {
-                cmd_opt_t* opt = find_option_by_short_name(cmd, cli->buffer[start + 1]);
-                if (opt != NULL) {
-                    *pending_opt = opt;
-                }
-                continue;
-            }
-
-            if (len >= 3 && cli->buffer[start + 2] == '=') {
-                continue;
-            }
-
-            continue;
+            break;
+        case XF_SHELL_TOKEN_LONG_OPT:
+            text = token_text(cli, &tokens[i], scratch, (int)sizeof(scratch), &len);
+            *pending_opt = find_option_by_long_name(cmd, &text[2], len - 2);
+            break;
+        case XF_SHELL_TOKEN_SHORT_OPT:
+            text = token_text(cli, &tokens[i], scratch, (int)sizeof(scratch), &len);
+            *pending_opt = find_option_by_short_name(cmd, text[1]);
+            break;
+        default:
+            /* Inline values and option clusters never consume the next token. */
+            break;
         }
-
-        (*positional_count)++;
     }
 }
 
@@ -322,7 +273,7 @@ static cmd_opt_t* resolve_inline_value_option(const struct xf_cli* cli,
     if (cli == NULL || cmd == NULL || value_start == NULL) {
         return NULL;
     }
-    if (token.start < 0 || token.end <= token.start || token.end > cli->len) {
+    if (token.end <= token.start || token.end > cli->len) {
         return NULL;
     }
     if (cli->buffer[token.start] != '-') {
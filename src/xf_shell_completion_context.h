@@ -10,6 +10,7 @@
 #include "xf_shell_completion.h"
 #include "xf_shell.h"
 #include "xf_shell_cli.h"
+#include "xf_shell_tokenizer.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -29,6 +30,8 @@ typedef struct {
 /* ==================== [Global Prototypes] ================================= */
 
 void xf_shell_completion_resolve_context(const struct xf_cli* cli,
+                                         const xf_shell_token_t tokens[],
+                                         int token_count,
                                          xf_shell_cmd_t* cmd,
                                          int cursor,
                                          xf_shell_completion_context_t* out);
@@ -149,6 +149,60 @@
 #endif
 #endif
 
+#if XF_CLI_MAX_ARGC > 255
+#error "XF_CLI_MAX_ARGC must be at most 255"
+#endif
+
+/* Output coalescing buffer bytes, flushed at prompt and line boundaries (>= 1). */
+#ifndef XF_CLI_OUT_BUF_SIZE
+#if XF_SHELL_PROFILE_MIN_SIZE
+#define XF_CLI_OUT_BUF_SIZE 32
+#else
+#define XF_CLI_OUT_BUF_SIZE 128
+#endif
+#endif
+
+#if XF_CLI_OUT_BUF_SIZE > 65535
+#error "XF_CLI_OUT_BUF_SIZE must be at most 65535"
+#endif
+
+/* Non-blocking TX ring bytes, 0 to disable xf_shell_cmd_init_tx(). */
+#ifndef XF_SHELL_TX_RING_SIZE
+#if XF_SHELL_PROFILE_MIN_SIZE
+#define XF_SHELL_TX_RING_SIZE 0
+#else
+#define XF_SHELL_TX_RING_SIZE 256
+#endif
+#endif
+
+/* Called while the blocking TX policy waits for the port, e.g. a task yield. */
+#ifndef XF_SHELL_TX_WAIT
+#define XF_SHELL_TX_WAIT() do { } while (0)
+#endif
+
+/* ISR-fed SPSC input ring bytes, power of two, 0 to disable. */
+#ifndef XF_SHELL_RX_RING_SIZE
+#if XF_SHELL_PROFILE_MIN_SIZE
+#define XF_SHELL_RX_RING_SIZE 0
+#else
+#define XF_SHELL_RX_RING_SIZE 128
+#endif
+#endif
+
+/*
+ * Input ring index access. C11 atomics or GCC/Clang __atomic builtins are
+ * used when available; other compilers must define both hooks, e.g. as a
+ * volatile access plus a barrier:
+ *   #define XF_SHELL_RX_LOAD_ACQUIRE(p)     (*(p))
+ *   #define XF_SHELL_RX_STORE_RELEASE(p, v) do { __DMB(); *(p) = (v); } while (0)
+ */
+
+/*
+ * Free running clock for xf_shell_cmd_poll() budgets, e.g. a microsecond
+ * timer. Leave undefined to budget in input bytes and output steps:
+ *   #define XF_SHELL_POLL_CLOCK() (DWT->CYCCNT / (SystemCoreClock / 1000000U))
+ */
+
 /* Maximum prompt string length. */
 #ifndef XF_CLI_MAX_PROMPT_LEN
 #if XF_SHELL_PROFILE_MIN_SIZE
@@ -163,6 +217,125 @@
 #define XF_CLI_SERIAL_XLATE 1
 #endif
 
+/* Enable xterm bracketed paste: pasted text skips completion and control keys. */
+#ifndef XF_CLI_BRACKETED_PASTE
+#if XF_SHELL_PROFILE_MIN_SIZE
+#define XF_CLI_BRACKETED_PASTE 0
+#else
+#define XF_CLI_BRACKETED_PASTE 1
+#endif
+#endif
+
+/* Non-interactive pipe mode: no echo, ANSI or prompt, an end marker per command. */
+#ifndef XF_SHELL_PIPE_MODE
+#if XF_SHELL_PROFILE_MIN_SIZE
+#define XF_SHELL_PIPE_MODE 0
+#else
+#define XF_SHELL_PIPE_MODE 1
+#endif
+#endif
+
+/* Pipe mode end-of-output line prefix, followed by the return code and a newline. */
+#ifndef XF_SHELL_PIPE_END_MARK
+#define XF_SHELL_PIPE_END_MARK "\x1e" "rc="
+#endif
+
+/* Largest frame payload of XF_SHELL_MODE_FRAME (binary RPC), at most 65535; 0 to disable. */
+#ifndef XF_SHELL_FRAME_SIZE
+#define XF_SHELL_FRAME_SIZE 0
+#endif
+#if XF_SHELL_FRAME_SIZE > 0 && !XF_SHELL_PIPE_MODE
+#error "XF_SHELL_FRAME_SIZE needs XF_SHELL_PIPE_MODE"
+#endif
+
+/* Leave XF_CMD_PENDING commands to later input calls instead of stepping them in place. */
+#ifndef XF_SHELL_ASYNC_CMD
+#if XF_SHELL_PROFILE_MIN_SIZE
+#define XF_SHELL_ASYNC_CMD 0
+#else
+#define XF_SHELL_ASYNC_CMD 1
+#endif
+#endif
+
+/* Background job slots for `cmd &` on a pthread worker pool, 0 to disable. */
+#ifndef XF_SHELL_BG_JOBS
+#define XF_SHELL_BG_JOBS 0
+#endif
+
+/* Worker threads running background jobs. */
+#ifndef XF_SHELL_BG_WORKERS
+#define XF_SHELL_BG_WORKERS 2
+#endif
+
+/* Per-job arena bytes for the command line and parsed option copies. */
+#ifndef XF_SHELL_BG_ARENA_SIZE
+#define XF_SHELL_BG_ARENA_SIZE 1024
+#endif
+
+/* Tagged background job output bytes waiting for the shell task. */
+#ifndef XF_SHELL_BG_OUT_SIZE
+#define XF_SHELL_BG_OUT_SIZE 1024
+#endif
+
+/* Bytes of one `watch` output frame, two are kept to find the changed lines; 0 to disable. */
+#ifndef XF_SHELL_WATCH_SIZE
+#define XF_SHELL_WATCH_SIZE 0
+#endif
+
+#if XF_SHELL_WATCH_SIZE && !XF_SHELL_ASYNC_CMD
+#error "XF_SHELL_WATCH_SIZE needs XF_SHELL_ASYNC_CMD"
+#endif
+
+/* Commands scheduled with `every`/`at`, run by the shell task; 0 to disable. */
+#ifndef XF_SHELL_SCHED_ENTRIES
+#define XF_SHELL_SCHED_ENTRIES 0
+#endif
+
+/* Nesting levels of xf_shell_emit_*() structured output, 0 to disable. */
+#ifndef XF_SHELL_EMIT_DEPTH
+#if XF_SHELL_PROFILE_MIN_SIZE
+#define XF_SHELL_EMIT_DEPTH 0
+#else
+#define XF_SHELL_EMIT_DEPTH 8
+#endif
+#endif
+
+/* Key column width of the text rendering of structured output. */
+#ifndef XF_SHELL_EMIT_KEY_WIDTH
+#define XF_SHELL_EMIT_KEY_WIDTH 12
+#endif
+
+/* Slots of the xf_shell_submit() queue fed by other tasks, power of two, 0 to disable. */
+#ifndef XF_SHELL_SUBMIT_SLOTS
+#define XF_SHELL_SUBMIT_SLOTS 0
+#endif
+
+/* Captured output bytes handed to a submitted command's callback. */
+#ifndef XF_SHELL_SUBMIT_OUT_SIZE
+#define XF_SHELL_SUBMIT_OUT_SIZE 256
+#endif
+
+/*
+ * Submission queue index access, as for the input ring. Other compilers
+ * must define all three hooks; the compare-and-swap returns true on success
+ * and otherwise stores the current value in *expected:
+ *   #define XF_SHELL_SUBMIT_CAS(p, expected, desired) my_cas32((p), (expected), (desired))
+ */
+
+/* xf_shell_exec_file(): run a script through mmap(2), POSIX hosts only. */
+#ifndef XF_SHELL_SCRIPT_MMAP
+#if defined(__unix__) || defined(__APPLE__)
+#define XF_SHELL_SCRIPT_MMAP 1
+#else
+#define XF_SHELL_SCRIPT_MMAP 0
+#endif
+#endif
+
+/* Use VT102 insert/delete-character sequences for mid-line edits. */
+#ifndef XF_CLI_VT_EDIT
+#define XF_CLI_VT_EDIT 1
+#endif
+
 /* ANSI color output for prompt/command line. */
 #ifndef XF_CLI_COLORFUL
 #if XF_SHELL_PROFILE_MIN_SIZE
@@ -196,6 +369,21 @@
 #endif
 #endif
 
+/* Helper to check whether xf_shell_tick() and the deadlines it drives are needed. */
+#ifndef XF_SHELL_TIMERS
+#define XF_SHELL_TIMERS (XF_SHELL_WATCH_SIZE > 0 || XF_SHELL_SCHED_ENTRIES > 0)
+#endif
+
+/* Let the CLI divert its output to a buffer or callback: xf_shell_cmd_run_capture(), watch, xf_shell_submit(), frames. */
+#ifndef XF_CLI_CAPTURE
+#define XF_CLI_CAPTURE                                                                  \
+    (!XF_SHELL_PROFILE_MIN_SIZE || XF_SHELL_WATCH_SIZE > 0 || XF_SHELL_SUBMIT_SLOTS > 0 || \
+     XF_SHELL_FRAME_SIZE > 0)
+#endif
+#if !XF_CLI_CAPTURE && (XF_SHELL_WATCH_SIZE > 0 || XF_SHELL_SUBMIT_SLOTS > 0 || XF_SHELL_FRAME_SIZE > 0)
+#error "watch, xf_shell_submit() and frame mode need XF_CLI_CAPTURE"
+#endif
+
 /* Helper to check whether XF_SHELL_NEWLINE is "\r\n". */
 #ifndef XF_SHELL_NEWLINE_IS_CRLF
 #define XF_SHELL_NEWLINE_IS_CRLF \
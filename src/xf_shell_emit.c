@@ -0,0 +1,415 @@
+/**
+ * @file xf_shell_emit.c
+ * @brief Structured key/value output rendered as text, JSON or CBOR.
+ *
+ * Handlers describe their output as keys, values, objects and arrays; the
+ * session format picks the rendering, so the same handler serves a person
+ * at a terminal and a host script. Everything is streamed as it is emitted:
+ * no document is built in memory, only one bit per nesting level is kept.
+ *
+ * - Text: `key: value` lines, keys padded to XF_SHELL_EMIT_KEY_WIDTH and
+ *   nested levels indented, array elements as `- value`.
+ * - JSON: one compact object per command, on one line.
+ * - CBOR (RFC 8949): one map per command. Maps and arrays use the
+ *   indefinite-length encoding, so no counts are needed up front.
+ */
+
+/* ==================== [Includes] ========================================== */
+#include "xf_shell_emit.h"
+#include <stdio.h>
+#include <string.h>
+
+#if XF_SHELL_EMIT_DEPTH
+
+#if XF_SHELL_EMIT_DEPTH > 31
+#error "XF_SHELL_EMIT_DEPTH must not exceed 31"
+#endif
+
+/* ==================== [Defines] =========================================== */
+
+#define LEVEL_BIT(level) (1UL << (level))
+
+#define CBOR_UINT 0U
+#define CBOR_NEGINT 1U
+#define CBOR_TEXT 3U
+#define CBOR_FALSE 0xF4U
+#define CBOR_TRUE 0xF5U
+#define CBOR_NULL 0xF6U
+#define CBOR_MAP_START 0xBFU
+#define CBOR_ARRAY_START 0x9FU
+#define CBOR_BREAK 0xFFU
+
+/* ==================== [Static Prototypes] ================================= */
+
+static bool emit_item(xf_shell_emit_t* e, const char* key, bool container);
+static void emit_open(const char* key, bool array);
+static void emit_close(xf_shell_emit_t* e);
+static void emit_text_key(const xf_shell_emit_t* e, const char* key, bool container);
+static void emit_json_string(const char* s);
+static void emit_cbor_head(uint8_t major, uint32_t value);
+static void emit_cbor_string(const char* s);
+static void emit_byte(uint8_t byte);
+static void emit_puts(const char* s);
+static void emit_spaces(size_t n);
+
+/* ==================== [Static Variables] ================================== */
+
+static uint8_t s_format = XF_SHELL_FORMAT_TEXT;
+
+/* ==================== [Global Functions] ================================== */
+
+void xf_shell_set_format(xf_shell_format_t format)
+{
+    s_format = (uint8_t)format;
+}
+
+xf_shell_format_t xf_shell_get_format(void)
+{
+    return (xf_shell_format_t)s_format;
+}
+
+void xf_shell_emit_reset(xf_shell_emit_t* e, uint8_t format)
+{
+    memset(e, 0, sizeof(*e));
+    e->format = format;
+}
+
+void xf_shell_emit_finish(xf_shell_emit_t* e)
+{
+    if (e->depth == 0) {
+        return;
+    }
+    while (e->depth > 0) {
+        emit_close(e);
+    }
+    if (e->format == XF_SHELL_FORMAT_JSON) {
+        emit_puts(XF_SHELL_NEWLINE);
+    }
+    e->skipped = 0;
+}
+
+void xf_shell_emit_kv_int(const char* key, int32_t value)
+{
+    xf_shell_emit_t* e = xf_shell_emit_state();
+    char text[12];
+
+    if (!emit_item(e, key, false)) {
+        return;
+    }
+    if (e->format == XF_SHELL_FORMAT_CBOR) {
+        // -1 - value without overflowing INT32_MIN
+        emit_cbor_head(value < 0 ? CBOR_NEGINT : CBOR_UINT,
+                       value < 0 ? (uint32_t)(-(value + 1)) : (uint32_t)value);
+        return;
+    }
+    snprintf(text, sizeof(text), "%ld", (long)value);
+    emit_puts(text);
+    if (e->format == XF_SHELL_FORMAT_TEXT) {
+        emit_puts(XF_SHELL_NEWLINE);
+    }
+}
+
+void xf_shell_emit_kv_uint(const char* key, uint32_t value)
+{
+    xf_shell_emit_t* e = xf_shell_emit_state();
+    char text[12];
+
+    if (!emit_item(e, key, false)) {
+        return;
+    }
+    if (e->format == XF_SHELL_FORMAT_CBOR) {
+        emit_cbor_head(CBOR_UINT, value);
+        return;
+    }
+    snprintf(text, sizeof(text), "%lu", (unsigned long)value);
+    emit_puts(text);
+    if (e->format == XF_SHELL_FORMAT_TEXT) {
+        emit_puts(XF_SHELL_NEWLINE);
+    }
+}
+
+void xf_shell_emit_kv_str(const char* key, const char* value)
+{
+    xf_shell_emit_t* e = xf_shell_emit_state();
+
+    if (!emit_item(e, key, false)) {
+        return;
+    }
+    switch (e->format) {
+    case XF_SHELL_FORMAT_JSON:
+        if (value == NULL) {
+            emit_puts("null");
+        } else {
+            emit_json_string(value);
+        }
+        break;
+    case XF_SHELL_FORMAT_CBOR:
+        if (value == NULL) {
+            emit_byte(CBOR_NULL);
+        } else {
+            emit_cbor_string(value);
+        }
+        break;
+    default:
+        emit_puts(value == NULL ? "-" : value);
+        emit_puts(XF_SHELL_NEWLINE);
+        break;
+    }
+}
+
+void xf_shell_emit_kv_bool(const char* key, bool value)
+{
+    xf_shell_emit_t* e = xf_shell_emit_state();
+
+    if (!emit_item(e, key, false)) {
+        return;
+    }
+    if (e->format == XF_SHELL_FORMAT_CBOR) {
+        emit_byte(value ? CBOR_TRUE : CBOR_FALSE);
+        return;
+    }
+    emit_puts(value ? "true" : "false");
+    if (e->format == XF_SHELL_FORMAT_TEXT) {
+        emit_puts(XF_SHELL_NEWLINE);
+    }
+}
+
+void xf_shell_emit_object(const char* key)
+{
+    emit_open(key, false);
+}
+
+void xf_shell_emit_array(const char* key)
+{
+    emit_open(key, true);
+}
+
+void xf_shell_emit_end(void)
+{
+    xf_shell_emit_t* e = xf_shell_emit_state();
+
+    if (e->skipped > 0) {
+        e->skipped--;
+        return;
+    }
+    // The top-level object belongs to the shell, see xf_shell_emit_finish()
+    if (e->depth > 1) {
+        emit_close(e);
+    }
+}
+
+/* ==================== [Static Functions] ================================== */
+
+/*
+ * Start an element of the current level: open the top-level object on first
+ * use, then write the separator and key. False inside a dropped level.
+ */
+static bool emit_item(xf_shell_emit_t* e, const char* key, bool container)
+{
+    bool in_array;
+
+    if (e->skipped > 0) {
+        return false;
+    }
+    if (e->depth == 0) {
+        e->depth = 1;
+        if (e->format == XF_SHELL_FORMAT_JSON) {
+            emit_puts("{");
+        } else if (e->format == XF_SHELL_FORMAT_CBOR) {
+            emit_byte(CBOR_MAP_START);
+        }
+    }
+    in_array = (e->arrays & LEVEL_BIT(e->depth)) != 0;
+    if (key == NULL) {
+        key = "";
+    }
+    switch (e->format) {
+    case XF_SHELL_FORMAT_JSON:
+        if (e->items & LEVEL_BIT(e->depth)) {
+            emit_puts(",");
+        }
+        if (!in_array) {
+            emit_json_string(key);
+            emit_puts(":");
+        }
+        break;
+    case XF_SHELL_FORMAT_CBOR:
+        if (!in_array) {
+            emit_cbor_string(key);
+        }
+        break;
+    default:
+        emit_text_key(e, in_array ? NULL : key, container);
+        break;
+    }
+    e->items |= LEVEL_BIT(e->depth);
+    return true;
+}
+
+static void emit_open(const char* key, bool array)
+{
+    xf_shell_emit_t* e = xf_shell_emit_state();
+    uint8_t depth = e->depth > 0 ? e->depth : 1U;
+
+    // Too deep: the level and everything in it is dropped, its end still counts
+    if (e->skipped > 0 || depth >= XF_SHELL_EMIT_DEPTH) {
+        e->skipped++;
+        return;
+    }
+    (void)emit_item(e, key, true);
+    e->depth++;
+    e->items &= ~LEVEL_BIT(e->depth);
+    if (array) {
+        e->arrays |= LEVEL_BIT(e->depth);
+    } else {
+        e->arrays &= ~LEVEL_BIT(e->depth);
+    }
+    switch (e->format) {
+    case XF_SHELL_FORMAT_JSON:
+        emit_puts(array ? "[" : "{");
+        break;
+    case XF_SHELL_FORMAT_CBOR:
+        emit_byte(array ? CBOR_ARRAY_START : CBOR_MAP_START);
+        break;
+    default:
+        break;
+    }
+}
+
+static void emit_close(xf_shell_emit_t* e)
+{
+    if (e->format == XF_SHELL_FORMAT_JSON) {
+        emit_puts(e->arrays & LEVEL_BIT(e->depth) ? "]" : "}");
+    } else if (e->format == XF_SHELL_FORMAT_CBOR) {
+        emit_byte(CBOR_BREAK);
+    }
+    e->depth--;
+}
+
+/* "key       : " in an object, "- " in an array; a container gets a line of its own */
+static void emit_text_key(const xf_shell_emit_t* e, const char* key, bool container)
+{
+    size_t len;
+
+    emit_spaces(2U * (size_t)(e->depth - 1U));
+    if (key == NULL) {
+        emit_puts(container ? "-" XF_SHELL_NEWLINE : "- ");
+        return;
+    }
+    emit_puts(key);
+    if (container) {
+        emit_puts(":" XF_SHELL_NEWLINE);
+        return;
+    }
+    len = strlen(key);
+    emit_spaces(len < XF_SHELL_EMIT_KEY_WIDTH ? XF_SHELL_EMIT_KEY_WIDTH - len : 0U);
+    emit_puts(": ");
+}
+
+static void emit_json_string(const char* s)
+{
+    static const char hex[] = "0123456789abcdef";
+    const char* run = s;
+    char esc[6];
+
+    emit_puts("\"");
+    for (; *s != '\0'; s++) {
+        unsigned char ch = (unsigned char)*s;
+        size_t n = 2;
+
+        if (ch >= 0x20U && ch != '"' && ch != '\\') {
+            continue;
+        }
+        // Plain characters go out as one run, only the escape is built here
+        xf_shell_emit_write(run, (size_t)(s - run));
+        run = s + 1;
+        esc[0] = '\\';
+        switch (ch) {
+        case '"':
+        case '\\':
+            esc[1] = (char)ch;
+            break;
+        case '\n':
+            esc[1] = 'n';
+            break;
+        case '\r':
+            esc[1] = 'r';
+            break;
+        case '\t':
+            esc[1] = 't';
+            break;
+        default:
+            memcpy(&esc[1], "u00", 3);
+            esc[4] = hex[ch >> 4];
+            esc[5] = hex[ch & 0x0FU];
+            n = 6;
+            break;
+        }
+        xf_shell_emit_write(esc, n);
+    }
+    xf_shell_emit_write(run, (size_t)(s - run));
+    emit_puts("\"");
+}
+
+/* Major type and argument, the argument in the shortest form */
+static void emit_cbor_head(uint8_t major, uint32_t value)
+{
+    uint8_t head[5];
+    size_t n;
+
+    if (value < 24U) {
+        head[0] = (uint8_t)((major << 5) | value);
+        n = 1;
+    } else if (value <= 0xFFU) {
+        head[0] = (uint8_t)((major << 5) | 24U);
+        head[1] = (uint8_t)value;
+        n = 2;
+    } else if (value <= 0xFFFFU) {
+        head[0] = (uint8_t)((major << 5) | 25U);
+        head[1] = (uint8_t)(value >> 8);
+        head[2] = (uint8_t)value;
+        n = 3;
+    } else {
+        head[0] = (uint8_t)((major << 5) | 26U);
+        head[1] = (uint8_t)(value >> 24);
+        head[2] = (uint8_t)(value >> 16);
+        head[3] = (uint8_t)(value >> 8);
+        head[4] = (uint8_t)value;
+        n = 5;
+    }
+    xf_shell_emit_write((const char*)head, n);
+}
+
+static void emit_cbor_string(const char* s)
+{
+    size_t len = strlen(s);
+
+    emit_cbor_head(CBOR_TEXT, (uint32_t)len);
+    xf_shell_emit_write(s, len);
+}
+
+static void emit_byte(uint8_t byte)
+{
+    char ch = (char)byte;
+
+    xf_shell_emit_write(&ch, 1);
+}
+
+static void emit_puts(const char* s)
+{
+    xf_shell_emit_write(s, strlen(s));
+}
+
+static void emit_spaces(size_t n)
+{
+    static const char spaces[] = "                ";
+
+    while (n > 0) {
+        size_t k = n < sizeof(spaces) - 1 ? n : sizeof(spaces) - 1;
+
+        xf_shell_emit_write(spaces, k);
+        n -= k;
+    }
+}
+
+#endif
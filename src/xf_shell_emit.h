@@ -0,0 +1,78 @@
+/**
+ * @file xf_shell_emit.h
+ * @brief Structured key/value output rendered as text, JSON or CBOR.
+ */
+
+#ifndef __XF_SHELL_EMIT_H__
+#define __XF_SHELL_EMIT_H__
+
+/* ==================== [Includes] ========================================== */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "xf_shell.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if XF_SHELL_EMIT_DEPTH
+
+/* ==================== [Typedefs] ========================================== */
+
+/**
+ * @brief 一条命令的输出状态。
+ *
+ * @details
+ * 第 1 层是第一次输出时隐式打开的顶层对象，由 `xf_shell_emit_finish()` 关闭。
+ */
+typedef struct {
+    uint8_t format;   /* xf_shell_format_t */
+    uint8_t depth;    /* 已打开的层数，含顶层对象 */
+    uint8_t skipped;  /* 超过 XF_SHELL_EMIT_DEPTH 而被丢弃的层数 */
+    uint32_t arrays;  /* 第 n 位：第 n 层是数组 */
+    uint32_t items;   /* 第 n 位：第 n 层已有元素，JSON 需要逗号 */
+} xf_shell_emit_t;
+
+/* ==================== [Global Prototypes] ================================= */
+
+/**
+ * @brief 开始一条命令的输出。
+ *
+ * @param[out] e 输出状态。
+ * @param[in] format 渲染格式，`xf_shell_format_t`。
+ */
+void xf_shell_emit_reset(xf_shell_emit_t* e, uint8_t format);
+
+/**
+ * @brief 结束一条命令的输出，关闭仍打开的各层（含顶层对象）。
+ *
+ * @details
+ * JSON 以换行结尾，一条命令一行。命令没有使用结构化输出时不输出任何内容。
+ *
+ * @param[in,out] e 输出状态。
+ */
+void xf_shell_emit_finish(xf_shell_emit_t* e);
+
+/**
+ * @brief 当前命令的输出状态（由 xf_shell.c 提供）。
+ *
+ * @return 后台任务中为该任务自己的状态，否则为 shell 任务的状态。
+ */
+xf_shell_emit_t* xf_shell_emit_state(void);
+
+/**
+ * @brief 原样输出，不做换行转换（由 xf_shell.c 提供）。
+ *
+ * @param[in] data 数据。
+ * @param[in] len 数据长度（字节）。
+ */
+void xf_shell_emit_write(const char* data, size_t len);
+
+#endif
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif  // __XF_SHELL_EMIT_H__
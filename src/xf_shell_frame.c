@@ -0,0 +1,202 @@
+/**
+ * @file xf_shell_frame.c
+ * @brief Length-prefixed, CRC-checked frames of XF_SHELL_MODE_FRAME.
+ *
+ * The receiver copies bytes straight into the frame buffer, header first so
+ * the length is known, then the payload and CRC in as few copies as the
+ * input allows. A frame with a bad length or CRC is dropped up to the next
+ * start byte inside it, so one corrupted byte costs one frame, not the
+ * ones that follow. The sender writes a frame in pieces, the payload
+ * straight from the caller's buffers, and computes the CRC on the way.
+ */
+
+/* ==================== [Includes] ========================================== */
+#include "xf_shell_frame.h"
+#include <string.h>
+
+#if XF_SHELL_FRAME_SIZE
+
+#if XF_SHELL_FRAME_SIZE > 65535 || XF_SHELL_FRAME_SIZE < 16
+#error "XF_SHELL_FRAME_SIZE must be in [16, 65535]"
+#endif
+
+/* ==================== [Defines] =========================================== */
+
+#define CRC_INIT 0xFFFFU
+
+/* ==================== [Typedefs] ========================================== */
+
+typedef enum {
+    FRAME_MORE,  /* the frame is not complete yet */
+    FRAME_READY, /* a complete frame with a good CRC */
+    FRAME_BAD,   /* length past XF_SHELL_FRAME_SIZE or a bad CRC */
+} frame_state_t;
+
+/* ==================== [Static Prototypes] ================================= */
+
+static frame_state_t frame_check(const xf_shell_frame_rx_t* rx);
+static size_t frame_wanted(const xf_shell_frame_rx_t* rx);
+static void frame_drop(xf_shell_frame_rx_t* rx, size_t n);
+static uint16_t frame_crc(uint16_t crc, const char* data, size_t len);
+
+/* ==================== [Static Variables] ================================== */
+
+/* CRC-16/CCITT-FALSE a nibble at a time, 32 bytes of table instead of 512 */
+static const uint16_t s_crc_table[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+};
+
+/* ==================== [Global Functions] ================================== */
+
+size_t xf_shell_frame_feed(xf_shell_frame_rx_t* rx, const char* data, size_t len)
+{
+    size_t i = 0;
+
+    if (rx->ready) {
+        rx->ready = false;
+        frame_drop(rx, frame_wanted(rx));
+    }
+    for (;;) {
+        frame_state_t state;
+        const char* sof;
+        size_t k;
+
+        // Bytes left over from a dropped frame may already hold the next one
+        while ((state = frame_check(rx)) == FRAME_BAD) {
+            rx->dropped++;
+            frame_drop(rx, 1);
+        }
+        if (state == FRAME_READY) {
+            rx->ready = true;
+            return i;
+        }
+        if (i == len) {
+            return i;
+        }
+        if (rx->fill == 0) {
+            sof = (const char*)memchr(&data[i], (int)XF_SHELL_FRAME_SOF, len - i);
+            if (sof == NULL) {
+                return len;
+            }
+            i = (size_t)(sof - data);
+        }
+        k = frame_wanted(rx) - rx->fill;
+        if (k > len - i) {
+            k = len - i;
+        }
+        memcpy(&rx->buf[rx->fill], &data[i], k);
+        rx->fill += k;
+        i += k;
+    }
+}
+
+uint8_t xf_shell_frame_type(const xf_shell_frame_rx_t* rx)
+{
+    return (uint8_t)rx->buf[1];
+}
+
+uint8_t xf_shell_frame_seq(const xf_shell_frame_rx_t* rx)
+{
+    return (uint8_t)rx->buf[2];
+}
+
+char* xf_shell_frame_payload(xf_shell_frame_rx_t* rx, size_t* len)
+{
+    *len = frame_wanted(rx) - XF_SHELL_FRAME_HEADER - XF_SHELL_FRAME_CRC;
+    return &rx->buf[XF_SHELL_FRAME_HEADER];
+}
+
+void xf_shell_frame_send(xf_write_t write, void* user_data, uint8_t type, uint8_t seq,
+                         const char* head, size_t head_len, const char* body, size_t body_len)
+{
+    size_t len = head_len + body_len;
+    char header[XF_SHELL_FRAME_HEADER];
+    char crc_le[XF_SHELL_FRAME_CRC];
+    uint16_t crc;
+
+    header[0] = (char)XF_SHELL_FRAME_SOF;
+    header[1] = (char)type;
+    header[2] = (char)seq;
+    header[3] = (char)(len & 0xFFU);
+    header[4] = (char)(len >> 8);
+    crc = frame_crc(CRC_INIT, &header[1], sizeof(header) - 1);
+    crc = frame_crc(crc, head, head_len);
+    crc = frame_crc(crc, body, body_len);
+    crc_le[0] = (char)(crc & 0xFFU);
+    crc_le[1] = (char)(crc >> 8);
+
+    write(user_data, header, sizeof(header));
+    if (head_len > 0) {
+        write(user_data, head, head_len);
+    }
+    if (body_len > 0) {
+        write(user_data, body, body_len);
+    }
+    write(user_data, crc_le, sizeof(crc_le));
+}
+
+/* ==================== [Static Functions] ================================== */
+
+static frame_state_t frame_check(const xf_shell_frame_rx_t* rx)
+{
+    size_t end;
+    uint16_t crc;
+
+    if (rx->fill < XF_SHELL_FRAME_HEADER) {
+        return FRAME_MORE;
+    }
+    end = frame_wanted(rx);
+    if (end > sizeof(rx->buf)) {
+        return FRAME_BAD;
+    }
+    if (rx->fill < end) {
+        return FRAME_MORE;
+    }
+    crc = frame_crc(CRC_INIT, &rx->buf[1], end - XF_SHELL_FRAME_CRC - 1);
+    if ((uint8_t)rx->buf[end - 2] != (crc & 0xFFU) || (uint8_t)rx->buf[end - 1] != (crc >> 8)) {
+        return FRAME_BAD;
+    }
+    return FRAME_READY;
+}
+
+/* Bytes up to the end of the current part: the header, or the whole frame */
+static size_t frame_wanted(const xf_shell_frame_rx_t* rx)
+{
+    if (rx->fill < XF_SHELL_FRAME_HEADER) {
+        return XF_SHELL_FRAME_HEADER;
+    }
+    return XF_SHELL_FRAME_HEADER + XF_SHELL_FRAME_CRC +
+           ((size_t)(uint8_t)rx->buf[3] | ((size_t)(uint8_t)rx->buf[4] << 8));
+}
+
+/* Discard the first n buffered bytes and whatever follows up to a start byte */
+static void frame_drop(xf_shell_frame_rx_t* rx, size_t n)
+{
+    const char* sof = NULL;
+    size_t skip = rx->fill;
+
+    if (n < rx->fill) {
+        sof = (const char*)memchr(&rx->buf[n], (int)XF_SHELL_FRAME_SOF, rx->fill - n);
+    }
+    if (sof != NULL) {
+        skip = (size_t)(sof - rx->buf);
+    }
+    rx->fill -= skip;
+    memmove(rx->buf, &rx->buf[skip], rx->fill);
+}
+
+static uint16_t frame_crc(uint16_t crc, const char* data, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        uint8_t byte = (uint8_t)data[i];
+
+        crc = (uint16_t)((crc << 4) ^ s_crc_table[((crc >> 12) ^ (byte >> 4)) & 0x0FU]);
+        crc = (uint16_t)((crc << 4) ^ s_crc_table[((crc >> 12) ^ byte) & 0x0FU]);
+    }
+    return crc;
+}
+
+#endif
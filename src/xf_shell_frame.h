@@ -0,0 +1,125 @@
+/**
+ * @file xf_shell_frame.h
+ * @brief Length-prefixed, CRC-checked frames of XF_SHELL_MODE_FRAME.
+ */
+
+#ifndef __XF_SHELL_FRAME_H__
+#define __XF_SHELL_FRAME_H__
+
+/* ==================== [Includes] ========================================== */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "xf_shell.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if XF_SHELL_FRAME_SIZE
+
+/* ==================== [Defines] =========================================== */
+
+/*
+ * 帧格式（两个方向相同，多字节字段均为小端）：
+ *
+ *   0xA5 | type | seq | len (2) | payload (len) | crc (2)
+ *
+ * crc 为 CRC-16/CCITT-FALSE（多项式 0x1021，初值 0xFFFF），覆盖 type 到 payload 末尾。
+ * 主机选择 seq，响应原样带回，可以连发多个请求而不必逐个等待。
+ *
+ * - CALL：payload 为命令的各个词，每个以 `\0` 结尾，不经过分词。
+ * - DATA：命令输出的一段，之后还有。
+ * - END：payload 为 4 字节有符号返回值，后接输出的最后一段。
+ */
+#define XF_SHELL_FRAME_SOF 0xA5U
+#define XF_SHELL_FRAME_HEADER 5U   /* 起始字节、type、seq、len */
+#define XF_SHELL_FRAME_CRC 2U
+#define XF_SHELL_FRAME_STATUS 4U   /* END 负载开头的返回值 */
+
+#define XF_SHELL_FRAME_CALL 0x01U  /* 主机 -> shell */
+#define XF_SHELL_FRAME_DATA 0x81U  /* shell -> 主机 */
+#define XF_SHELL_FRAME_END 0x82U   /* shell -> 主机 */
+
+/* ==================== [Typedefs] ========================================== */
+
+/**
+ * @brief 帧接收状态。
+ *
+ * @details
+ * 逐字节寻找起始字节，长度超限或 CRC 错误的帧被丢弃，从下一个起始字节重新同步。
+ */
+typedef struct {
+    size_t fill;      /* 当前帧已收到的字节数，0 表示在寻找起始字节 */
+    bool ready;       /* buf 中是一个完整、校验正确的帧 */
+    uint32_t dropped; /* 被丢弃的帧数 */
+    char buf[XF_SHELL_FRAME_HEADER + XF_SHELL_FRAME_SIZE + XF_SHELL_FRAME_CRC];
+} xf_shell_frame_rx_t;
+
+/* ==================== [Global Prototypes] ================================= */
+
+/**
+ * @brief 接收一段数据，收到一个完整的帧时停下。
+ *
+ * @details
+ * 返回后若 `rx->ready` 为真，用 `xf_shell_frame_type()` 等取出该帧，
+ * 再以剩余数据继续调用；下一次调用会先丢弃这个帧。
+ *
+ * @param[in,out] rx 接收状态。
+ * @param[in] data 数据。
+ * @param[in] len 数据长度。
+ *
+ * @return 消耗的字节数。
+ */
+size_t xf_shell_frame_feed(xf_shell_frame_rx_t* rx, const char* data, size_t len);
+
+/**
+ * @brief 已收到帧的类型。
+ *
+ * @param[in] rx 接收状态，`rx->ready` 为真。
+ *
+ * @return 帧类型。
+ */
+uint8_t xf_shell_frame_type(const xf_shell_frame_rx_t* rx);
+
+/**
+ * @brief 已收到帧的序号。
+ *
+ * @param[in] rx 接收状态，`rx->ready` 为真。
+ *
+ * @return 序号。
+ */
+uint8_t xf_shell_frame_seq(const xf_shell_frame_rx_t* rx);
+
+/**
+ * @brief 已收到帧的负载，就地返回，可以修改。
+ *
+ * @param[in] rx 接收状态，`rx->ready` 为真。
+ * @param[out] len 负载长度。
+ *
+ * @return 负载。
+ */
+char* xf_shell_frame_payload(xf_shell_frame_rx_t* rx, size_t* len);
+
+/**
+ * @brief 编码并发送一个帧，负载分两段给出。
+ *
+ * @param[in] write 输出回调，一个帧分几次调用。
+ * @param[in] user_data 回调透传上下文。
+ * @param[in] type 帧类型。
+ * @param[in] seq 序号。
+ * @param[in] head 负载第一段，可为 `NULL`。
+ * @param[in] head_len 第一段长度。
+ * @param[in] body 负载第二段，可为 `NULL`。
+ * @param[in] body_len 第二段长度，两段合计不超过 `XF_SHELL_FRAME_SIZE`。
+ */
+void xf_shell_frame_send(xf_write_t write, void* user_data, uint8_t type, uint8_t seq,
+                         const char* head, size_t head_len, const char* body, size_t body_len);
+
+#endif
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif  // __XF_SHELL_FRAME_H__
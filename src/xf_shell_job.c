@@ -0,0 +1,596 @@
+/**
+ * @file xf_shell_job.c
+ * @brief Background jobs (`cmd &`) on a pthread worker pool.
+ *
+ * The shell task parses a background command itself, so errors still show
+ * up right away, then copies the command descriptor, the line and every
+ * parsed string into the job's own arena: argv points into the line buffer,
+ * which the next line overwrites. A worker runs the handler on that copy.
+ *
+ * Handler output is collected a line at a time and queued, tagged with the
+ * job id, for the shell task to print; only the shell task ever touches the
+ * CLI. One mutex guards the job table and the output queue.
+ */
+
+/* ==================== [Includes] ========================================== */
+#include "xf_shell_job.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#if XF_SHELL_BG_JOBS
+
+#if XF_SHELL_BG_JOBS > 99
+#error "XF_SHELL_BG_JOBS must not exceed 99"
+#endif
+
+#if XF_SHELL_BG_OUT_SIZE < XF_CLI_MAX_LINE + 8
+#error "XF_SHELL_BG_OUT_SIZE must hold a whole tagged line"
+#endif
+
+/* ==================== [Defines] =========================================== */
+
+#define OUT_SIZE ((uint32_t)XF_SHELL_BG_OUT_SIZE)
+#define ARENA_UNITS ((XF_SHELL_BG_ARENA_SIZE + sizeof(job_align_t) - 1) / sizeof(job_align_t))
+
+/* ==================== [Typedefs] ========================================== */
+
+/* Arena allocation unit, aligned for anything a descriptor holds */
+typedef union {
+    void* p;
+    long long l;
+    double d;
+} job_align_t;
+
+typedef struct {
+    xf_shell_cmd_t cmd;         /* the descriptor, options and values in the arena */
+    const char* text;           /* the command line, in the arena */
+    uint32_t seq;               /* queue order */
+    uint32_t out_end;           /* output position after the job's last line */
+    int ret;
+    uint8_t state;              /* XF_SHELL_JOB_* */
+    bool killed;
+    bool resumed;               /* worker only */
+    size_t used;                /* arena units taken */
+    size_t line_len;            /* worker only */
+    char line[XF_CLI_MAX_LINE]; /* worker only, the output line being written */
+#if XF_SHELL_EMIT_DEPTH
+    xf_shell_emit_t emit;       /* worker only, structured output */
+#endif
+    job_align_t arena[ARENA_UNITS];
+} job_t;
+
+/* ==================== [Static Prototypes] ================================= */
+
+static bool job_pool_start(void);
+static void* job_worker(void* arg);
+static job_t* job_next(void);
+static int job_run(job_t* job);
+static void job_push_line(job_t* job);
+static bool job_snapshot(job_t* job, const xf_shell_cmd_t* cmd, int argc, const char** argv);
+static bool job_value(job_t* job, xf_options_t* value);
+static void* job_alloc(job_t* job, size_t size);
+static char* job_strdup(job_t* job, const char* s);
+static job_t* job_by_id(int id);
+static bool job_reapable(const job_t* job);
+static void job_info(const job_t* job, xf_shell_job_info_t* info);
+
+/* ==================== [Static Variables] ================================== */
+
+static job_t s_jobs[XF_SHELL_BG_JOBS];
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_work = PTHREAD_COND_INITIALIZER;  /* a job was queued */
+static pthread_cond_t s_room = PTHREAD_COND_INITIALIZER;  /* output was read */
+static pthread_cond_t s_event = PTHREAD_COND_INITIALIZER; /* a line was queued or a job ended */
+static pthread_key_t s_self;                              /* the worker's job_t */
+static bool s_started = false;                            /* s_self exists */
+static int s_workers = 0;                                 /* shell task only */
+static uint32_t s_seq = 0;
+static char s_out[XF_SHELL_BG_OUT_SIZE];
+static uint32_t s_out_head = 0; /* free running, bytes queued so far */
+static uint32_t s_out_tail = 0; /* free running, bytes read so far */
+
+/* ==================== [Global Functions] ================================== */
+
+int xf_shell_job_start(xf_shell_cmd_t* cmd, int argc, const char** argv, int* id)
+{
+    job_t* job = NULL;
+    int i;
+
+    if (cmd == NULL || argc <= 0 || argv == NULL || id == NULL) {
+        return XF_CMD_NO_INVALID_ARG;
+    }
+    if (s_workers == 0 && !job_pool_start()) {
+        return XF_CMD_NO_MEM;
+    }
+
+    // Only this task frees and takes slots, workers skip free ones
+    pthread_mutex_lock(&s_lock);
+    for (i = 0; i < XF_SHELL_BG_JOBS && job == NULL; i++) {
+        if (s_jobs[i].state == XF_SHELL_JOB_FREE) {
+            job = &s_jobs[i];
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    if (job == NULL || !job_snapshot(job, cmd, argc, argv)) {
+        return XF_CMD_NO_MEM;
+    }
+
+    job->killed = false;
+    job->ret = XF_CMD_OK;
+    job->line_len = 0;
+    pthread_mutex_lock(&s_lock);
+    job->seq = s_seq++;
+    job->state = XF_SHELL_JOB_QUEUED;
+    pthread_cond_signal(&s_work);
+    pthread_mutex_unlock(&s_lock);
+
+    *id = (int)(job - s_jobs) + 1;
+    return XF_CMD_OK;
+}
+
+size_t xf_shell_job_read(char* buf, size_t size)
+{
+    uint32_t n;
+    uint32_t at;
+    uint32_t first;
+
+    pthread_mutex_lock(&s_lock);
+    n = s_out_head - s_out_tail;
+    if (n > size) {
+        n = (uint32_t)size;
+    }
+    at = s_out_tail % OUT_SIZE;
+    first = OUT_SIZE - at < n ? OUT_SIZE - at : n;
+    memcpy(buf, &s_out[at], first);
+    memcpy(buf + first, s_out, n - first);
+    s_out_tail += n;
+    if (n > 0) {
+        pthread_cond_broadcast(&s_room);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return n;
+}
+
+int xf_shell_job_reap(int id, xf_shell_job_info_t* info)
+{
+    int found = 0;
+    int i;
+
+    pthread_mutex_lock(&s_lock);
+    for (i = 0; i < XF_SHELL_BG_JOBS && found == 0; i++) {
+        job_t* job = &s_jobs[i];
+
+        // The done notice must not overtake the job's own last lines
+        if ((id == 0 || id == i + 1) && job_reapable(job)) {
+            job_info(job, info);
+            job->state = XF_SHELL_JOB_FREE;
+            found = i + 1;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return found;
+}
+
+bool xf_shell_job_get(int id, xf_shell_job_info_t* info)
+{
+    job_t* job = job_by_id(id);
+    bool found;
+
+    if (job == NULL) {
+        return false;
+    }
+    pthread_mutex_lock(&s_lock);
+    found = job->state != XF_SHELL_JOB_FREE;
+    if (found) {
+        job_info(job, info);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return found;
+}
+
+int xf_shell_job_kill(int id)
+{
+    job_t* job = job_by_id(id);
+    int ret = XF_CMD_OK;
+
+    if (job == NULL) {
+        return XF_CMD_NO_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    if (job->state == XF_SHELL_JOB_FREE) {
+        ret = XF_CMD_NO_INVALID_ARG;
+    } else if (job->state == XF_SHELL_JOB_QUEUED) {
+        // Never started, so there is nothing to stop
+        job->killed = true;
+        job->ret = XF_CMD_INTERRUPTED;
+        job->out_end = s_out_head;
+        job->state = XF_SHELL_JOB_DONE;
+        pthread_cond_broadcast(&s_event);
+    } else if (job->state == XF_SHELL_JOB_RUNNING) {
+        job->killed = true;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ret;
+}
+
+bool xf_shell_job_busy(void)
+{
+    bool busy = false;
+    int i;
+
+    pthread_mutex_lock(&s_lock);
+    for (i = 0; i < XF_SHELL_BG_JOBS && !busy; i++) {
+        busy = s_jobs[i].state == XF_SHELL_JOB_QUEUED || s_jobs[i].state == XF_SHELL_JOB_RUNNING;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return busy;
+}
+
+bool xf_shell_job_pending(void)
+{
+    bool pending;
+    int i;
+
+    if (!s_started) {
+        return false;
+    }
+    pthread_mutex_lock(&s_lock);
+    pending = s_out_head != s_out_tail;
+    for (i = 0; i < XF_SHELL_BG_JOBS && !pending; i++) {
+        pending = s_jobs[i].state == XF_SHELL_JOB_DONE;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return pending;
+}
+
+void xf_shell_job_wait(uint32_t ms)
+{
+    struct timespec until;
+
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += (time_t)(ms / 1000U);
+    until.tv_nsec += (long)(ms % 1000U) * 1000000L;
+    if (until.tv_nsec >= 1000000000L) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&s_lock);
+    if (s_out_head == s_out_tail) {
+        (void)pthread_cond_timedwait(&s_event, &s_lock, &until);
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+bool xf_shell_job_self(void)
+{
+    // The key exists once the first job started, and only workers set it
+    return s_started && pthread_getspecific(s_self) != NULL;
+}
+
+bool xf_shell_job_write(const char* data, size_t len)
+{
+    job_t* job;
+    size_t i;
+
+    if (!s_started || (job = (job_t*)pthread_getspecific(s_self)) == NULL) {
+        return false;
+    }
+    for (i = 0; i < len; i++) {
+        job->line[job->line_len++] = data[i];
+        if (data[i] == '\n') {
+            job_push_line(job);
+        } else if (job->line_len + sizeof(XF_SHELL_NEWLINE) > sizeof(job->line)) {
+            // Wrap an overlong line, every output line carries its tag
+            memcpy(&job->line[job->line_len], XF_SHELL_NEWLINE, sizeof(XF_SHELL_NEWLINE) - 1);
+            job->line_len += sizeof(XF_SHELL_NEWLINE) - 1;
+            job_push_line(job);
+        }
+    }
+    return true;
+}
+
+bool xf_shell_job_killed(void)
+{
+    job_t* job = s_started ? (job_t*)pthread_getspecific(s_self) : NULL;
+    bool killed;
+
+    if (job == NULL) {
+        return false;
+    }
+    pthread_mutex_lock(&s_lock);
+    killed = job->killed;
+    pthread_mutex_unlock(&s_lock);
+    return killed;
+}
+
+bool xf_shell_job_resumed(void)
+{
+    job_t* job = s_started ? (job_t*)pthread_getspecific(s_self) : NULL;
+
+    return job != NULL && job->resumed;
+}
+
+#if XF_SHELL_EMIT_DEPTH
+xf_shell_emit_t* xf_shell_job_emit(void)
+{
+    job_t* job = s_started ? (job_t*)pthread_getspecific(s_self) : NULL;
+
+    return job != NULL ? &job->emit : NULL;
+}
+#endif
+
+/* ==================== [Static Functions] ================================== */
+
+/* Create the key and the workers, one is enough to go on with */
+static bool job_pool_start(void)
+{
+    pthread_attr_t attr;
+    pthread_t thread;
+    int i;
+
+    if (!s_started) {
+        if (pthread_key_create(&s_self, NULL) != 0) {
+            return false;
+        }
+        s_started = true;
+    }
+    if (pthread_attr_init(&attr) != 0) {
+        return false;
+    }
+    (void)pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (i = 0; i < XF_SHELL_BG_WORKERS; i++) {
+        if (pthread_create(&thread, &attr, job_worker, NULL) == 0) {
+            s_workers++;
+        }
+    }
+    (void)pthread_attr_destroy(&attr);
+    return s_workers > 0;
+}
+
+static void* job_worker(void* arg)
+{
+    job_t* job;
+    int ret;
+
+    (void)arg;
+    pthread_mutex_lock(&s_lock);
+    for (;;) {
+        while ((job = job_next()) == NULL) {
+            pthread_cond_wait(&s_work, &s_lock);
+        }
+        job->state = XF_SHELL_JOB_RUNNING;
+        pthread_mutex_unlock(&s_lock);
+
+        (void)pthread_setspecific(s_self, job);
+        ret = job_run(job);
+        if (job->line_len > 0) {
+            (void)xf_shell_job_write(XF_SHELL_NEWLINE, sizeof(XF_SHELL_NEWLINE) - 1);
+        }
+        (void)pthread_setspecific(s_self, NULL);
+
+        pthread_mutex_lock(&s_lock);
+        job->ret = job->killed ? XF_CMD_INTERRUPTED : ret;
+        job->out_end = s_out_head;
+        job->state = XF_SHELL_JOB_DONE;
+        pthread_cond_broadcast(&s_event);
+        pthread_mutex_unlock(&s_lock);
+        xf_shell_wakeup();
+        pthread_mutex_lock(&s_lock);
+    }
+    return NULL;
+}
+
+/* The job queued first, called with the lock held */
+static job_t* job_next(void)
+{
+    job_t* next = NULL;
+    int i;
+
+    for (i = 0; i < XF_SHELL_BG_JOBS; i++) {
+        job_t* job = &s_jobs[i];
+
+        if (job->state == XF_SHELL_JOB_QUEUED &&
+            (next == NULL || (int32_t)(job->seq - next->seq) < 0)) {
+            next = job;
+        }
+    }
+    return next;
+}
+
+/*
+ * Call the handler on the job's copy of the descriptor. A handler that
+ * returns XF_CMD_PENDING is stepped here every millisecond, as a superloop
+ * would; after a kill it gets one last call, like a cancelled command.
+ */
+static int job_run(job_t* job)
+{
+    const struct timespec tick = { 0, 1000000L };
+    int ret;
+
+    job->resumed = false;
+#if XF_SHELL_EMIT_DEPTH
+    // Tagged output lines are for reading, whatever the session renders
+    xf_shell_emit_reset(&job->emit, XF_SHELL_FORMAT_TEXT);
+#endif
+    ret = job->cmd.func((const xf_cmd_args_t*)&job->cmd);
+    while (ret == XF_CMD_PENDING) {
+        bool last = xf_shell_job_killed();
+
+        if (!last) {
+            (void)nanosleep(&tick, NULL);
+        }
+        job->resumed = true;
+        ret = job->cmd.func((const xf_cmd_args_t*)&job->cmd);
+        if (last) {
+            ret = XF_CMD_INTERRUPTED;
+        }
+    }
+#if XF_SHELL_EMIT_DEPTH
+    xf_shell_emit_finish(&job->emit);
+#endif
+    return ret;
+}
+
+/* Queue the worker's finished line behind its tag, waiting for room if needed */
+static void job_push_line(job_t* job)
+{
+    char tag[8];
+    uint32_t tag_len;
+    uint32_t len;
+    uint32_t i;
+
+    tag_len = (uint32_t)snprintf(tag, sizeof(tag), "[%d] ", (int)(job - s_jobs) + 1);
+    len = tag_len + (uint32_t)job->line_len;
+
+    pthread_mutex_lock(&s_lock);
+    while (OUT_SIZE - (s_out_head - s_out_tail) < len) {
+        pthread_cond_wait(&s_room, &s_lock);
+    }
+    for (i = 0; i < len; i++) {
+        s_out[(s_out_head + i) % OUT_SIZE] = i < tag_len ? tag[i] : job->line[i - tag_len];
+    }
+    s_out_head += len;
+    pthread_cond_broadcast(&s_event);
+    pthread_mutex_unlock(&s_lock);
+
+    job->line_len = 0;
+    xf_shell_wakeup();
+}
+
+/* Copy the descriptor, its options and every parsed string into the arena */
+static bool job_snapshot(job_t* job, const xf_shell_cmd_t* cmd, int argc, const char** argv)
+{
+    xf_opt_arg_t** opts = NULL;
+    xf_arg_t** args = NULL;
+    size_t len = 0;
+    char* text;
+    uint16_t i;
+    int k;
+
+    job->used = 0;
+    job->cmd = *cmd;
+
+    for (k = 0; k < argc; k++) {
+        len += strlen(argv[k]) + 1;
+    }
+    text = (char*)job_alloc(job, len);
+    if (text == NULL) {
+        return false;
+    }
+    job->text = text;
+    for (k = 0; k < argc; k++) {
+        size_t n = strlen(argv[k]);
+
+        memcpy(text, argv[k], n);
+        text[n] = (k + 1 < argc) ? ' ' : '\0';
+        text += n + 1;
+    }
+
+    if (cmd->_opt_count > 0U) {
+        opts = (xf_opt_arg_t**)job_alloc(job, cmd->_opt_count * sizeof(*opts));
+        if (opts == NULL) {
+            return false;
+        }
+    }
+    for (i = 0; i < cmd->_opt_count; i++) {
+        opts[i] = NULL;
+        if (cmd->_opts[i] == NULL) {
+            continue;
+        }
+        opts[i] = (xf_opt_arg_t*)job_alloc(job, sizeof(xf_opt_arg_t));
+        if (opts[i] == NULL) {
+            return false;
+        }
+        *opts[i] = *cmd->_opts[i];
+        if (!job_value(job, &opts[i]->_opt)) {
+            return false;
+        }
+    }
+
+    if (cmd->_arg_count > 0U) {
+        args = (xf_arg_t**)job_alloc(job, cmd->_arg_count * sizeof(*args));
+        if (args == NULL) {
+            return false;
+        }
+    }
+    for (i = 0; i < cmd->_arg_count; i++) {
+        args[i] = NULL;
+        if (cmd->_args[i] == NULL) {
+            continue;
+        }
+        args[i] = (xf_arg_t*)job_alloc(job, sizeof(xf_arg_t));
+        if (args[i] == NULL) {
+            return false;
+        }
+        *args[i] = *cmd->_args[i];
+        if (!job_value(job, &args[i]->_opt)) {
+            return false;
+        }
+    }
+
+    job->cmd._opts = opts;
+    job->cmd._args = args;
+    return true;
+}
+
+/* A string value may point into the line, keep a copy */
+static bool job_value(job_t* job, xf_options_t* value)
+{
+    if (value->type != XF_OPTION_TYPE_STRING || value->string == NULL) {
+        return true;
+    }
+    value->string = job_strdup(job, value->string);
+    return value->string != NULL;
+}
+
+static void* job_alloc(job_t* job, size_t size)
+{
+    size_t units = (size + sizeof(job_align_t) - 1) / sizeof(job_align_t);
+    void* p;
+
+    if (units > ARENA_UNITS - job->used) {
+        return NULL;
+    }
+    p = &job->arena[job->used];
+    job->used += units;
+    return p;
+}
+
+static char* job_strdup(job_t* job, const char* s)
+{
+    size_t n = strlen(s) + 1;
+    char* copy = (char*)job_alloc(job, n);
+
+    if (copy != NULL) {
+        memcpy(copy, s, n);
+    }
+    return copy;
+}
+
+static job_t* job_by_id(int id)
+{
+    if (id < 1 || id > XF_SHELL_BG_JOBS) {
+        return NULL;
+    }
+    return &s_jobs[id - 1];
+}
+
+/* Called with the lock held */
+static bool job_reapable(const job_t* job)
+{
+    return job->state == XF_SHELL_JOB_DONE && (int32_t)(s_out_tail - job->out_end) >= 0;
+}
+
+/* Called with the lock held */
+static void job_info(const job_t* job, xf_shell_job_info_t* info)
+{
+    info->state = job->state;
+    info->killed = job->killed;
+    info->ret = job->ret;
+    // The text is written before the job is queued and never changes
+    snprintf(info->text, sizeof(info->text), "%s", job->text);
+}
+
+#endif
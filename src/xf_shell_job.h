@@ -0,0 +1,177 @@
+/**
+ * @file xf_shell_job.h
+ * @brief Background jobs (`cmd &`) on a pthread worker pool.
+ */
+
+#ifndef __XF_SHELL_JOB_H__
+#define __XF_SHELL_JOB_H__
+
+/* ==================== [Includes] ========================================== */
+#include <stddef.h>
+#include <stdint.h>
+#include "xf_shell.h"
+#include "xf_shell_emit.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if XF_SHELL_BG_JOBS
+
+/* ==================== [Defines] =========================================== */
+
+/* Job states, see xf_shell_job_info_t. */
+#define XF_SHELL_JOB_FREE 0U
+#define XF_SHELL_JOB_QUEUED 1U  /* waiting for a worker */
+#define XF_SHELL_JOB_RUNNING 2U
+#define XF_SHELL_JOB_DONE 3U    /* finished, not reaped yet */
+
+/* ==================== [Typedefs] ========================================== */
+
+/**
+ * @brief 后台任务状态快照。
+ */
+typedef struct {
+    uint8_t state;              /* XF_SHELL_JOB_* */
+    bool killed;                /* 已被 kill */
+    int ret;                    /* 命令返回值，仅 XF_SHELL_JOB_DONE 时有效 */
+    char text[XF_CLI_MAX_LINE]; /* 命令行，参数以空格连接 */
+} xf_shell_job_info_t;
+
+/* ==================== [Global Prototypes] ================================= */
+
+/**
+ * @brief 把已解析的命令交给工作线程执行（shell 任务侧）。
+ *
+ * @details
+ * 调用前须已用 `xf_shell_parser_parse()` 解析 `argv`。命令行与解析结果（含字符串参数值）
+ * 会拷贝到该任务独占的 `XF_SHELL_BG_ARENA_SIZE` 字节内存区，此后 `argv` 所在的
+ * 行缓冲区可以被下一行覆盖。首次调用时创建 `XF_SHELL_BG_WORKERS` 个工作线程。
+ *
+ * @param[in] cmd 命令对象，其 `_opt` 中为本次解析结果。
+ * @param[in] argc 参数个数（含命令名）。
+ * @param[in] argv 参数数组。
+ * @param[out] id 任务编号，从 1 开始。
+ *
+ * @return `XF_CMD_OK`；没有空闲任务槽、内存区放不下或无法创建线程时返回 `XF_CMD_NO_MEM`。
+ */
+int xf_shell_job_start(xf_shell_cmd_t* cmd, int argc, const char** argv, int* id);
+
+/**
+ * @brief 读取后台任务的输出（shell 任务侧）。
+ *
+ * @details
+ * 每行以 `[编号] ` 开头，按各任务写完一行的先后排列。读出后等待输出空间的工作线程被唤醒。
+ *
+ * @param[out] buf 输出缓冲区。
+ * @param[in] size 缓冲区大小（字节）。
+ *
+ * @return 读出的字节数，没有待输出数据时为 0。
+ */
+size_t xf_shell_job_read(char* buf, size_t size);
+
+/**
+ * @brief 回收一个已结束且输出已全部读出的任务（shell 任务侧）。
+ *
+ * @param[in] id 任务编号，`0` 表示任意一个。
+ * @param[out] info 被回收任务的最终状态。
+ *
+ * @return 被回收的任务编号，没有可回收的任务时为 0。
+ */
+int xf_shell_job_reap(int id, xf_shell_job_info_t* info);
+
+/**
+ * @brief 获取任务的当前状态（shell 任务侧）。
+ *
+ * @param[in] id 任务编号。
+ * @param[out] info 状态快照。
+ *
+ * @return `false` 没有该任务。
+ */
+bool xf_shell_job_get(int id, xf_shell_job_info_t* info);
+
+/**
+ * @brief 请求停止任务（shell 任务侧）。
+ *
+ * @details
+ * 尚未开始的任务直接结束；运行中的任务只做标记，命令回调通过
+ * `xf_shell_interrupted()` 或 `xf_shell_cmd_cancelled()` 得知并尽快返回。
+ *
+ * @param[in] id 任务编号。
+ *
+ * @return `XF_CMD_OK`；没有该任务时返回 `XF_CMD_NO_INVALID_ARG`。
+ */
+int xf_shell_job_kill(int id);
+
+/**
+ * @brief 是否还有排队或运行中的任务。
+ *
+ * @return `true` 有任务未结束。
+ */
+bool xf_shell_job_busy(void);
+
+/**
+ * @brief 是否有待读出的输出或待回收的任务，见 `xf_shell_has_pending_work()`。
+ *
+ * @return `true` 有待处理的工作。
+ */
+bool xf_shell_job_pending(void);
+
+/**
+ * @brief 等待任务输出新的一行或结束，最多 `ms` 毫秒（shell 任务侧）。
+ *
+ * @param[in] ms 最长等待时间（毫秒）。
+ */
+void xf_shell_job_wait(uint32_t ms);
+
+/**
+ * @brief 当前线程是否为正在执行后台任务的工作线程。
+ *
+ * @return `true` 在后台任务中。
+ */
+bool xf_shell_job_self(void);
+
+/**
+ * @brief 后台任务的输出接口（工作线程侧）。
+ *
+ * @details
+ * 数据按行收集，每满一行加上任务编号交给 shell 任务输出；过长的行会被折行。
+ * 待输出数据已满 `XF_SHELL_BG_OUT_SIZE` 时等待 shell 任务读出。
+ *
+ * @param[in] data 数据。
+ * @param[in] len 数据长度（字节）。
+ *
+ * @return `false` 当前线程不在后台任务中，数据未处理。
+ */
+bool xf_shell_job_write(const char* data, size_t len);
+
+/**
+ * @brief 当前后台任务是否已被 kill（工作线程侧）。
+ *
+ * @return `true` 已请求停止。
+ */
+bool xf_shell_job_killed(void);
+
+/**
+ * @brief 当前后台任务的回调是否为 `XF_CMD_PENDING` 之后的再次调用（工作线程侧）。
+ *
+ * @return `true` 为再次调用。
+ */
+bool xf_shell_job_resumed(void);
+
+#if XF_SHELL_EMIT_DEPTH
+/**
+ * @brief 当前后台任务的结构化输出状态（工作线程侧）。
+ *
+ * @return 状态；当前线程不在后台任务中时返回 `NULL`。
+ */
+xf_shell_emit_t* xf_shell_job_emit(void);
+#endif
+
+#endif
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif  // __XF_SHELL_JOB_H__
@@ -110,6 +110,18 @@ void xf_shell_parser_sync_arg_runtime(xf_arg_t* arg) {
 }
 
 int xf_shell_parser_run(xf_shell_cmd_t* cmd, int argc, const char** argv, xf_shell_parser_puts_t puts_fn, void* puts_ctx) {
+    int ret = xf_shell_parser_parse(cmd, argc, argv, puts_fn, puts_ctx);
+
+    if (ret == XF_SHELL_PARSER_HANDLED) {
+        return XF_CMD_OK;
+    }
+    if (ret != XF_CMD_OK) {
+        return ret;
+    }
+    return cmd->func((const xf_cmd_args_t*)cmd);
+}
+
+int xf_shell_parser_parse(xf_shell_cmd_t* cmd, int argc, const char** argv, xf_shell_parser_puts_t puts_fn, void* puts_ctx) {
     const char* bad_token = NULL;
     const char* positional_values[XF_CLI_MAX_ARGC];
     int positional_count = 0;
@@ -126,7 +138,7 @@ int xf_shell_parser_run(xf_shell_cmd_t* cmd, int argc, const char** argv, xf_she
 
 #if XF_SHELL_PARSER_HELP_ENABLE
     if (handle_builtin_help(cmd, argc, argv, &out)) {
-        return XF_CMD_OK;
+        return XF_SHELL_PARSER_HANDLED;
     }
 #endif
 
@@ -154,7 +166,7 @@ int xf_shell_parser_run(xf_shell_cmd_t* cmd, int argc, const char** argv, xf_she
 #else
                 print_option_error(it, "help is disabled", false, &out);
 #endif
-                return XF_CMD_OK;
+                return XF_SHELL_PARSER_HANDLED;
             }
             if (arg_ret == XF_OPTION_ERR_INVALID_ARG) {
                 print_option_error(it, NULL, XF_SHELL_PARSER_HELP_ENABLE, &out);
@@ -219,7 +231,7 @@ int xf_shell_parser_run(xf_shell_cmd_t* cmd, int argc, const char** argv, xf_she
         return XF_CMD_NO_INVALID_ARG;
     }
 
-    return cmd->func((const xf_cmd_args_t*)cmd);
+    return XF_CMD_OK;
 }
 
 int xf_shell_parser_get_int(const xf_cmd_args_t* cmd, const char* long_opt, int32_t* value) {
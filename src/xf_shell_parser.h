@@ -22,6 +22,9 @@ extern "C" {
 
 /* ==================== [Defines] =========================================== */
 
+/* xf_shell_parser_parse(): help was printed instead, there is nothing to run */
+#define XF_SHELL_PARSER_HANDLED (-1)
+
 /* ==================== [Typedefs] ========================================== */
 
 /**
@@ -79,6 +82,25 @@ void xf_shell_parser_sync_arg_runtime(xf_arg_t* arg);
  */
 int xf_shell_parser_run(xf_shell_cmd_t* cmd, int argc, const char** argv, xf_shell_parser_puts_t puts_fn, void* puts_ctx);
 
+/**
+ * @brief 只解析与校验参数，不调用命令回调。
+ *
+ * @details
+ * 与 `xf_shell_parser_run()` 的前三步相同，解析结果写入 `cmd` 各选项与位置参数的 `_opt`。
+ * 用于回调不在当前上下文中调用的场景，如后台任务先在 shell 线程中解析、报错，
+ * 再把结果快照交给工作线程。
+ *
+ * @param[in,out] cmd 目标命令对象。
+ * @param[in] argc 参数个数（含命令名）。
+ * @param[in] argv 参数数组（`argv[0]` 为命令名）。
+ * @param[in] puts_fn 输出回调，可为 `NULL`（此时不输出文本）。
+ * @param[in] puts_ctx 输出回调上下文指针。
+ *
+ * @return `XF_CMD_OK` 可以调用回调；`XF_SHELL_PARSER_HANDLED` 已输出帮助，无需调用；
+ *         其他为 `xf_cmd_return_t` 错误码。
+ */
+int xf_shell_parser_parse(xf_shell_cmd_t* cmd, int argc, const char** argv, xf_shell_parser_puts_t puts_fn, void* puts_ctx);
+
 /**
  * @brief 按名称读取 `int32_t` 类型参数值（支持选项与位置参数）。
  *
@@ -0,0 +1,202 @@
+/**
+ * @file xf_shell_rx.c
+ * @brief Lock-free single-producer/single-consumer input ring.
+ *
+ * The producer (UART RX ISR, reader thread) only writes `head`, the consumer
+ * (shell task) only writes `tail`. Both are free running counters; each side
+ * publishes its index with release semantics after touching the data and
+ * reads the other side's index with acquire semantics, so no lock or
+ * interrupt masking is needed. Neither side ever waits.
+ *
+ * The ring doubles as the type-ahead queue while a command runs. A Ctrl-C
+ * that arrives meanwhile is also reported out of band: the producer counts
+ * it and records where it landed, so the command can stop early and the
+ * consumer can drop the type-ahead in front of it.
+ */
+
+/* ==================== [Includes] ========================================== */
+#include "xf_shell_rx.h"
+#include "xf_shell_job.h"
+#include <stdint.h>
+#include <string.h>
+
+#if XF_SHELL_RX_RING_SIZE
+
+#if (XF_SHELL_RX_RING_SIZE & (XF_SHELL_RX_RING_SIZE - 1)) != 0
+#error "XF_SHELL_RX_RING_SIZE must be a power of two"
+#endif
+
+/* ==================== [Defines] =========================================== */
+
+#if defined(XF_SHELL_RX_LOAD_ACQUIRE) && defined(XF_SHELL_RX_STORE_RELEASE)
+typedef volatile uint32_t rx_index_t;
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+typedef _Atomic uint32_t rx_index_t;
+#define XF_SHELL_RX_LOAD_ACQUIRE(p) atomic_load_explicit((p), memory_order_acquire)
+#define XF_SHELL_RX_STORE_RELEASE(p, v) atomic_store_explicit((p), (v), memory_order_release)
+#elif defined(__GNUC__)
+typedef uint32_t rx_index_t;
+#define XF_SHELL_RX_LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define XF_SHELL_RX_STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else
+#error "Define XF_SHELL_RX_LOAD_ACQUIRE and XF_SHELL_RX_STORE_RELEASE for this compiler"
+#endif
+
+#define RING_SIZE ((uint32_t)XF_SHELL_RX_RING_SIZE)
+#define RING_MASK (RING_SIZE - 1U)
+
+#define CTRL_C '\x03'
+
+/* ==================== [Static Variables] ================================== */
+
+static char s_ring[XF_SHELL_RX_RING_SIZE];
+static rx_index_t s_head;     /* written by the producer only */
+static rx_index_t s_tail;     /* written by the consumer only */
+static rx_index_t s_overflow; /* written by the producer only */
+static rx_index_t s_busy;       /* written by the consumer only, a command is running */
+static rx_index_t s_intr_count; /* written by the producer only, Ctrl-C seen while busy */
+static rx_index_t s_intr_at;    /* written by the producer only, ring index after it */
+static uint32_t s_intr_seen;    /* consumer's copy of s_intr_count */
+static uint32_t s_depth;        /* consumer only, nested command runs */
+static bool s_binary;           /* consumer only, the input is binary frames */
+
+/* ==================== [Static Functions] ================================== */
+
+/* Producer side, after head is published: note the last Ctrl-C of this write */
+static void rx_note_interrupt(uint32_t head, const char* data, size_t len, uint32_t n)
+{
+    size_t i = len;
+
+    if (XF_SHELL_RX_LOAD_ACQUIRE(&s_busy) == 0U) {
+        return;
+    }
+    while (i > 0 && data[i - 1] != CTRL_C) {
+        i--;
+    }
+    if (i == 0) {
+        return;
+    }
+    // A Ctrl-C that no longer fit still interrupts, it just drops everything stored
+    XF_SHELL_RX_STORE_RELEASE(&s_intr_at, head + (i < n ? (uint32_t)i : n));
+    XF_SHELL_RX_STORE_RELEASE(&s_intr_count, XF_SHELL_RX_LOAD_ACQUIRE(&s_intr_count) + 1U);
+}
+
+/* ==================== [Global Functions] ================================== */
+
+size_t xf_shell_rx_write(const char* data, size_t len)
+{
+    uint32_t head;
+    uint32_t room;
+    uint32_t n;
+    uint32_t first;
+
+    if (data == NULL) {
+        return 0;
+    }
+
+    head = XF_SHELL_RX_LOAD_ACQUIRE(&s_head);
+    room = RING_SIZE - (head - XF_SHELL_RX_LOAD_ACQUIRE(&s_tail));
+    n = len < room ? (uint32_t)len : room;
+    first = RING_SIZE - (head & RING_MASK);
+    if (n < len) {
+        XF_SHELL_RX_STORE_RELEASE(&s_overflow, XF_SHELL_RX_LOAD_ACQUIRE(&s_overflow) +
+                                                   (uint32_t)(len - n));
+    }
+    if (first > n) {
+        first = n;
+    }
+    memcpy(&s_ring[head & RING_MASK], data, first);
+    memcpy(s_ring, data + first, n - first);
+    XF_SHELL_RX_STORE_RELEASE(&s_head, head + n);
+    rx_note_interrupt(head, data, len, n);
+    xf_shell_wakeup();
+    return n;
+}
+
+bool xf_shell_rx_push(char ch)
+{
+    uint32_t head = XF_SHELL_RX_LOAD_ACQUIRE(&s_head);
+
+    if (head - XF_SHELL_RX_LOAD_ACQUIRE(&s_tail) >= RING_SIZE) {
+        XF_SHELL_RX_STORE_RELEASE(&s_overflow, XF_SHELL_RX_LOAD_ACQUIRE(&s_overflow) + 1U);
+        rx_note_interrupt(head, &ch, 1, 0);
+        return false;
+    }
+    s_ring[head & RING_MASK] = ch;
+    XF_SHELL_RX_STORE_RELEASE(&s_head, head + 1U);
+    rx_note_interrupt(head, &ch, 1, 1);
+    xf_shell_wakeup();
+    return true;
+}
+
+uint32_t xf_shell_rx_overflow(void)
+{
+    return XF_SHELL_RX_LOAD_ACQUIRE(&s_overflow);
+}
+
+size_t xf_shell_rx_peek(const char** data)
+{
+    uint32_t tail = XF_SHELL_RX_LOAD_ACQUIRE(&s_tail);
+    uint32_t avail = XF_SHELL_RX_LOAD_ACQUIRE(&s_head) - tail;
+    uint32_t first = RING_SIZE - (tail & RING_MASK);
+
+    *data = &s_ring[tail & RING_MASK];
+    return avail < first ? avail : first;
+}
+
+void xf_shell_rx_consume(size_t len)
+{
+    XF_SHELL_RX_STORE_RELEASE(&s_tail, XF_SHELL_RX_LOAD_ACQUIRE(&s_tail) + (uint32_t)len);
+}
+
+bool xf_shell_rx_available(void)
+{
+    return XF_SHELL_RX_LOAD_ACQUIRE(&s_head) != XF_SHELL_RX_LOAD_ACQUIRE(&s_tail);
+}
+
+void xf_shell_rx_command_begin(void)
+{
+    // In a binary stream a Ctrl-C byte is data and interrupts nothing
+    if (s_depth++ == 0U && !s_binary) {
+        XF_SHELL_RX_STORE_RELEASE(&s_busy, 1U);
+    }
+}
+
+void xf_shell_rx_command_end(void)
+{
+    if (--s_depth == 0U) {
+        XF_SHELL_RX_STORE_RELEASE(&s_busy, 0U);
+    }
+}
+
+void xf_shell_rx_set_binary(bool binary)
+{
+    s_binary = binary;
+}
+
+bool xf_shell_interrupted(void)
+{
+#if XF_SHELL_BG_JOBS
+    // The Ctrl-C belongs to the foreground, a background job answers to kill
+    if (xf_shell_job_self()) {
+        return xf_shell_job_killed();
+    }
+#endif
+    return XF_SHELL_RX_LOAD_ACQUIRE(&s_intr_count) != s_intr_seen;
+}
+
+bool xf_shell_rx_discard_interrupted(void)
+{
+    uint32_t count = XF_SHELL_RX_LOAD_ACQUIRE(&s_intr_count);
+
+    if (count == s_intr_seen) {
+        return false;
+    }
+    s_intr_seen = count;
+    // The Ctrl-C came after everything that was queued when the command started
+    XF_SHELL_RX_STORE_RELEASE(&s_tail, XF_SHELL_RX_LOAD_ACQUIRE(&s_intr_at));
+    return true;
+}
+
+#endif
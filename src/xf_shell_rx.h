@@ -0,0 +1,88 @@
+/**
+ * @file xf_shell_rx.h
+ * @brief Lock-free single-producer/single-consumer input ring.
+ */
+
+#ifndef __XF_SHELL_RX_H__
+#define __XF_SHELL_RX_H__
+
+/* ==================== [Includes] ========================================== */
+#include <stddef.h>
+#include "xf_shell.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if XF_SHELL_RX_RING_SIZE
+
+/* ==================== [Global Prototypes] ================================= */
+
+/**
+ * @brief 获取输入环形缓冲区中连续可读的数据（消费者侧）。
+ *
+ * @details
+ * 数据原地返回，处理完后调用 `xf_shell_rx_consume()` 释放空间。
+ * 跨越缓冲区末尾的数据需要两次读取。
+ *
+ * @param[out] data 数据起始地址。
+ *
+ * @return 连续可读字节数。
+ */
+size_t xf_shell_rx_peek(const char** data);
+
+/**
+ * @brief 释放已处理的输入数据（消费者侧）。
+ *
+ * @param[in] len 字节数，不能超过上次 `xf_shell_rx_peek()` 的返回值。
+ */
+void xf_shell_rx_consume(size_t len);
+
+/**
+ * @brief 输入环形缓冲区中是否有未处理的数据（消费者侧）。
+ *
+ * @return `true` 有数据待处理。
+ */
+bool xf_shell_rx_available(void);
+
+/**
+ * @brief 标记命令开始执行（消费者侧，可嵌套）。
+ *
+ * @details
+ * 执行期间生产者收到的 `Ctrl-C` 会被记录为带外中断，见 `xf_shell_interrupted()`。
+ */
+void xf_shell_rx_command_begin(void);
+
+/**
+ * @brief 标记命令执行结束（消费者侧）。
+ */
+void xf_shell_rx_command_end(void);
+
+/**
+ * @brief 设置输入是否为二进制数据（消费者侧）。
+ *
+ * @details
+ * 二进制输入（如帧模式）中的 `0x03` 是普通数据，不再作为 `Ctrl-C` 中断命令。
+ *
+ * @param[in] binary `true` 输入为二进制数据。
+ */
+void xf_shell_rx_set_binary(bool binary);
+
+/**
+ * @brief 处理命令执行期间收到的 `Ctrl-C`（消费者侧）。
+ *
+ * @details
+ * 丢弃该 `Ctrl-C` 及其之前的预输入数据，并清除中断标志。
+ * 调用后之前 `xf_shell_rx_peek()` 得到的数据失效，不能再调用 `xf_shell_rx_consume()`。
+ *
+ * @return `true` 有中断并已处理。
+ */
+bool xf_shell_rx_discard_interrupted(void);
+
+#endif
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif  // __XF_SHELL_RX_H__
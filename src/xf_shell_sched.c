@@ -0,0 +1,175 @@
+/**
+ * @file xf_shell_sched.c
+ * @brief Fixed-capacity min-heap of scheduled commands (`every`/`at`).
+ */
+
+/* ==================== [Includes] ========================================== */
+#include "xf_shell_sched.h"
+#include <string.h>
+
+#if XF_SHELL_SCHED_ENTRIES
+
+#if XF_SHELL_SCHED_ENTRIES > 255
+#error "XF_SHELL_SCHED_ENTRIES must fit the uint8_t heap indexes"
+#endif
+
+/* ==================== [Defines] =========================================== */
+
+/* a is before b on the wrapping millisecond clock */
+#define TIME_BEFORE(a, b) ((int32_t)((uint32_t)(a) - (uint32_t)(b)) < 0)
+
+/* ==================== [Static Prototypes] ================================= */
+
+static bool heap_less(const xf_shell_sched_t* sc, uint8_t a, uint8_t b);
+static void heap_swap(xf_shell_sched_t* sc, uint8_t a, uint8_t b);
+static void heap_up(xf_shell_sched_t* sc, uint8_t pos);
+static void heap_down(xf_shell_sched_t* sc, uint8_t pos);
+static void heap_delete(xf_shell_sched_t* sc, uint8_t pos);
+
+/* ==================== [Global Functions] ================================== */
+
+int xf_shell_sched_add(xf_shell_sched_t* sc, uint32_t due, uint32_t period, const char* line, int* id)
+{
+    size_t len = strlen(line);
+    uint8_t i;
+
+    if (len >= sizeof(sc->entry[0].line)) {
+        return XF_CMD_NO_INVALID_ARG;
+    }
+    for (i = 0; i < XF_SHELL_SCHED_ENTRIES && sc->entry[i].used; i++) {
+    }
+    if (i == XF_SHELL_SCHED_ENTRIES) {
+        return XF_CMD_NO_MEM;
+    }
+    memset(&sc->entry[i], 0, sizeof(sc->entry[i]));
+    sc->entry[i].used = true;
+    sc->entry[i].due = due;
+    sc->entry[i].period = period;
+    memcpy(sc->entry[i].line, line, len + 1);
+    sc->heap[sc->count] = i;
+    heap_up(sc, sc->count++);
+    *id = i + 1;
+    return XF_CMD_OK;
+}
+
+bool xf_shell_sched_remove(xf_shell_sched_t* sc, int id)
+{
+    uint8_t pos;
+
+    if (xf_shell_sched_get(sc, id) == NULL) {
+        return false;
+    }
+    for (pos = 0; sc->heap[pos] != (uint8_t)(id - 1); pos++) {
+    }
+    heap_delete(sc, pos);
+    return true;
+}
+
+bool xf_shell_sched_next(const xf_shell_sched_t* sc, uint32_t* due)
+{
+    if (sc->count == 0) {
+        return false;
+    }
+    *due = sc->entry[sc->heap[0]].due;
+    return true;
+}
+
+int xf_shell_sched_take(xf_shell_sched_t* sc, uint32_t now, char line[XF_CLI_MAX_LINE])
+{
+    xf_shell_sched_entry_t* e;
+    uint32_t late;
+
+    if (sc->count == 0 || TIME_BEFORE(now, sc->entry[sc->heap[0]].due)) {
+        return 0;
+    }
+    e = &sc->entry[sc->heap[0]];
+    memcpy(line, e->line, sizeof(e->line));
+    e->runs++;
+    if (e->period == 0) {
+        uint8_t index = sc->heap[0];
+
+        heap_delete(sc, 0);
+        return index + 1;
+    }
+    // The next period point after now; the ones in between are skipped
+    late = now - e->due;
+    e->overruns += late / e->period;
+    e->due = now + (e->period - late % e->period);
+    heap_down(sc, 0);
+    return (int)(e - sc->entry) + 1;
+}
+
+void xf_shell_sched_done(xf_shell_sched_t* sc, int id, int ret)
+{
+    if (xf_shell_sched_get(sc, id) != NULL) {
+        sc->entry[id - 1].ret = ret;
+    }
+}
+
+const xf_shell_sched_entry_t* xf_shell_sched_get(const xf_shell_sched_t* sc, int id)
+{
+    if (id < 1 || id > XF_SHELL_SCHED_ENTRIES || !sc->entry[id - 1].used) {
+        return NULL;
+    }
+    return &sc->entry[id - 1];
+}
+
+/* ==================== [Static Functions] ================================== */
+
+static bool heap_less(const xf_shell_sched_t* sc, uint8_t a, uint8_t b)
+{
+    return TIME_BEFORE(sc->entry[sc->heap[a]].due, sc->entry[sc->heap[b]].due);
+}
+
+static void heap_swap(xf_shell_sched_t* sc, uint8_t a, uint8_t b)
+{
+    uint8_t t = sc->heap[a];
+
+    sc->heap[a] = sc->heap[b];
+    sc->heap[b] = t;
+}
+
+static void heap_up(xf_shell_sched_t* sc, uint8_t pos)
+{
+    while (pos > 0) {
+        uint8_t parent = (uint8_t)((pos - 1) / 2);
+
+        if (!heap_less(sc, pos, parent)) {
+            break;
+        }
+        heap_swap(sc, pos, parent);
+        pos = parent;
+    }
+}
+
+static void heap_down(xf_shell_sched_t* sc, uint8_t pos)
+{
+    for (;;) {
+        unsigned child = 2U * pos + 1U;
+
+        if (child >= sc->count) {
+            break;
+        }
+        if (child + 1U < sc->count && heap_less(sc, (uint8_t)(child + 1U), (uint8_t)child)) {
+            child++;
+        }
+        if (!heap_less(sc, (uint8_t)child, pos)) {
+            break;
+        }
+        heap_swap(sc, pos, (uint8_t)child);
+        pos = (uint8_t)child;
+    }
+}
+
+/* Free the entry at heap position pos, the last one takes its place */
+static void heap_delete(xf_shell_sched_t* sc, uint8_t pos)
+{
+    sc->entry[sc->heap[pos]].used = false;
+    sc->heap[pos] = sc->heap[--sc->count];
+    if (pos < sc->count) {
+        heap_down(sc, pos);
+        heap_up(sc, pos);
+    }
+}
+
+#endif
@@ -0,0 +1,123 @@
+/**
+ * @file xf_shell_sched.h
+ * @brief Fixed-capacity min-heap of scheduled commands (`every`/`at`).
+ */
+
+#ifndef __XF_SHELL_SCHED_H__
+#define __XF_SHELL_SCHED_H__
+
+/* ==================== [Includes] ========================================== */
+#include <stdbool.h>
+#include <stdint.h>
+#include "xf_shell.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if XF_SHELL_SCHED_ENTRIES
+
+/* ==================== [Typedefs] ========================================== */
+
+/**
+ * @brief 一条定时执行的命令。
+ */
+typedef struct {
+    uint32_t due;               /* 下次执行时刻，`xf_shell_tick()` 时钟 */
+    uint32_t period;            /* 周期（毫秒），0 表示只执行一次 */
+    uint32_t runs;              /* 已执行次数 */
+    uint32_t overruns;          /* 因执行过晚而跳过的周期数 */
+    int ret;                    /* 最近一次执行的返回值 */
+    bool used;
+    char line[XF_CLI_MAX_LINE]; /* 命令行，每次执行时重新拆分 */
+} xf_shell_sched_entry_t;
+
+/**
+ * @brief 定时命令表。
+ *
+ * @details
+ * 条目按下次执行时刻组成最小堆，取最早到期的条目为 O(1)，增删与重新排期为 O(log n)。
+ * 时刻按 32 位回绕比较，周期与延时须小于 2^31 毫秒。只在 shell 任务上下文中访问，不需要加锁。
+ */
+typedef struct {
+    uint8_t count;                               /* heap[] 中的条目数 */
+    uint8_t heap[XF_SHELL_SCHED_ENTRIES];        /* entry[] 下标，按 due 排列的最小堆 */
+    xf_shell_sched_entry_t entry[XF_SHELL_SCHED_ENTRIES];
+} xf_shell_sched_t;
+
+/* ==================== [Global Prototypes] ================================= */
+
+/**
+ * @brief 添加一条定时命令。
+ *
+ * @param[in,out] sc 定时命令表。
+ * @param[in] due 首次执行时刻。
+ * @param[in] period 周期（毫秒），0 表示只执行一次。
+ * @param[in] line 命令行，长度须小于 `XF_CLI_MAX_LINE`。
+ * @param[out] id 条目编号，从 1 开始。
+ *
+ * @return `XF_CMD_OK`；表已满时返回 `XF_CMD_NO_MEM`，命令行过长时返回 `XF_CMD_NO_INVALID_ARG`。
+ */
+int xf_shell_sched_add(xf_shell_sched_t* sc, uint32_t due, uint32_t period, const char* line, int* id);
+
+/**
+ * @brief 删除一条定时命令。
+ *
+ * @param[in,out] sc 定时命令表。
+ * @param[in] id 条目编号。
+ *
+ * @return `false` 没有该条目。
+ */
+bool xf_shell_sched_remove(xf_shell_sched_t* sc, int id);
+
+/**
+ * @brief 获取最早的执行时刻。
+ *
+ * @param[in] sc 定时命令表。
+ * @param[out] due 最早的执行时刻。
+ *
+ * @return `false` 表为空。
+ */
+bool xf_shell_sched_next(const xf_shell_sched_t* sc, uint32_t* due);
+
+/**
+ * @brief 取出一条已到期的命令并重新排期。
+ *
+ * @details
+ * 周期命令排到 `now` 之后的下一个周期点，其间错过的周期计入 `overruns`，不补执行；
+ * 单次命令从表中删除。命令行拷贝到 `line`，执行期间条目被删除也不受影响。
+ *
+ * @param[in,out] sc 定时命令表。
+ * @param[in] now 当前时刻。
+ * @param[out] line 命令行。
+ *
+ * @return 条目编号；没有到期的命令时返回 0。
+ */
+int xf_shell_sched_take(xf_shell_sched_t* sc, uint32_t now, char line[XF_CLI_MAX_LINE]);
+
+/**
+ * @brief 记录一次执行的返回值（条目仍存在时）。
+ *
+ * @param[in,out] sc 定时命令表。
+ * @param[in] id 条目编号。
+ * @param[in] ret 返回值。
+ */
+void xf_shell_sched_done(xf_shell_sched_t* sc, int id, int ret);
+
+/**
+ * @brief 按编号获取条目。
+ *
+ * @param[in] sc 定时命令表。
+ * @param[in] id 条目编号。
+ *
+ * @return 条目；没有该条目时返回 `NULL`。
+ */
+const xf_shell_sched_entry_t* xf_shell_sched_get(const xf_shell_sched_t* sc, int id);
+
+#endif
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif  // __XF_SHELL_SCHED_H__
@@ -0,0 +1,158 @@
+/**
+ * @file xf_shell_script.c
+ * @brief Line-by-line script executor, straight to xf_shell_exec_line().
+ *
+ * Scripts skip the line editor entirely: lines are found with memchr() in
+ * the caller's buffer, comments and blank lines are skipped in place, and
+ * only command lines are handed on to be copied and split into argv.
+ */
+
+/* mmap(2) and friends are POSIX, not C99 */
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+/* ==================== [Includes] ========================================== */
+#include "xf_shell.h"
+#include "xf_shell_rx.h"
+#include <stdint.h>
+#include <string.h>
+#if XF_SHELL_SCRIPT_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* ==================== [Defines] =========================================== */
+
+#if XF_SHELL_RX_RING_SIZE
+#define SCRIPT_INTERRUPTED() xf_shell_interrupted()
+#else
+#define SCRIPT_INTERRUPTED() false
+#endif
+
+/* ==================== [Static Prototypes] ================================= */
+
+static int script_run_line(const char *p, const char *end);
+
+/* ==================== [Global Functions] ================================== */
+
+int xf_shell_exec_script(const char *buf, size_t len, bool stop_on_error, uint32_t *line)
+{
+    const char *p = buf;
+    const char *end = buf + len;
+    uint32_t n = 0;
+    uint32_t failed_at = 0;
+    int ret = XF_CMD_OK;
+
+    if (buf == NULL && len > 0) {
+        if (line != NULL) {
+            *line = 0;
+        }
+        return XF_CMD_NO_INVALID_ARG;
+    }
+
+#if XF_SHELL_RX_RING_SIZE
+    // The whole script is one command, so a Ctrl-C stops it between lines
+    xf_shell_rx_command_begin();
+#endif
+    while (p < end) {
+        const char *eol = memchr(p, '\n', (size_t)(end - p));
+        const char *next = (eol != NULL) ? eol + 1 : end;
+        int rc;
+
+        n++;
+        rc = script_run_line(p, (eol != NULL) ? eol : end);
+        p = next;
+        if (SCRIPT_INTERRUPTED()) {
+            ret = XF_CMD_INTERRUPTED;
+            failed_at = n;
+            break;
+        }
+        if (rc == XF_CMD_OK) {
+            continue;
+        }
+        if (ret == XF_CMD_OK) {
+            ret = rc;
+            failed_at = n;
+        }
+        if (stop_on_error) {
+            break;
+        }
+    }
+#if XF_SHELL_RX_RING_SIZE
+    xf_shell_rx_command_end();
+#endif
+
+    if (line != NULL) {
+        *line = failed_at;
+    }
+    return ret;
+}
+
+#if XF_SHELL_SCRIPT_MMAP
+int xf_shell_exec_file(const char *path, bool stop_on_error, uint32_t *line)
+{
+    struct stat st;
+    size_t size;
+    void *map;
+    int fd;
+    int ret;
+
+    if (line != NULL) {
+        *line = 0;
+    }
+    if (path == NULL) {
+        return XF_CMD_NO_INVALID_ARG;
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return XF_CMD_NO_INVALID_ARG;
+    }
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        (void)close(fd);
+        return XF_CMD_NO_INVALID_ARG;
+    }
+    if ((uintmax_t)st.st_size > SIZE_MAX) {
+        (void)close(fd);
+        return XF_CMD_NO_MEM;
+    }
+    size = (size_t)st.st_size;
+    // An empty mapping is an error, an empty script is not
+    if (size == 0) {
+        (void)close(fd);
+        return XF_CMD_OK;
+    }
+
+    map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file
+    (void)close(fd);
+    if (map == MAP_FAILED) {
+        return XF_CMD_NO_MEM;
+    }
+    (void)posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+
+    ret = xf_shell_exec_script((const char *)map, size, stop_on_error, line);
+    (void)munmap(map, size);
+    return ret;
+}
+#endif
+
+/* ==================== [Static Functions] ================================== */
+
+/* Run the script line [p, end), blank and comment lines succeed */
+static int script_run_line(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    if (p < end && end[-1] == '\r') {
+        end--;
+    }
+    if (p == end || *p == '#') {
+        return XF_CMD_OK;
+    }
+    return xf_shell_exec_line(p, (size_t)(end - p));
+}
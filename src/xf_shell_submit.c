@@ -0,0 +1,130 @@
+/**
+ * @file xf_shell_submit.c
+ * @brief Lock-free multi-producer/single-consumer command submission queue.
+ *
+ * A bounded ring of slots, each with its own sequence word. A producer
+ * claims the next position with a compare-and-swap on `s_enqueue`, copies
+ * its request into the slot and then publishes the slot's sequence with
+ * release semantics. The consumer (shell task) reads the sequence with
+ * acquire semantics, so it only ever sees complete requests, and hands the
+ * slot back by advancing the sequence by a lap. Producers never wait on a
+ * lock or on each other beyond retrying a lost compare-and-swap, so any
+ * task, and an interrupt on a core with compare-and-swap, may submit.
+ *
+ * The sequence of slot i is kept relative to i: `pos & ~MASK` when the
+ * slot is free for position pos, one more once the request is in. Zeroed
+ * statics are thus a valid empty queue and no init call is needed.
+ */
+
+/* ==================== [Includes] ========================================== */
+#include "xf_shell_submit.h"
+#include <stdint.h>
+#include <string.h>
+
+#if XF_SHELL_SUBMIT_SLOTS
+
+#if (XF_SHELL_SUBMIT_SLOTS & (XF_SHELL_SUBMIT_SLOTS - 1)) != 0 || XF_SHELL_SUBMIT_SLOTS < 2
+#error "XF_SHELL_SUBMIT_SLOTS must be a power of two, at least 2"
+#endif
+
+/* ==================== [Defines] =========================================== */
+
+#if defined(XF_SHELL_SUBMIT_LOAD_ACQUIRE) && defined(XF_SHELL_SUBMIT_STORE_RELEASE) && \
+    defined(XF_SHELL_SUBMIT_CAS)
+typedef volatile uint32_t submit_index_t;
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+typedef _Atomic uint32_t submit_index_t;
+#define XF_SHELL_SUBMIT_LOAD_ACQUIRE(p) atomic_load_explicit((p), memory_order_acquire)
+#define XF_SHELL_SUBMIT_STORE_RELEASE(p, v) atomic_store_explicit((p), (v), memory_order_release)
+#define XF_SHELL_SUBMIT_CAS(p, expected, desired)                                           \
+    atomic_compare_exchange_weak_explicit((p), (expected), (desired), memory_order_relaxed, \
+                                          memory_order_relaxed)
+#elif defined(__GNUC__)
+typedef uint32_t submit_index_t;
+#define XF_SHELL_SUBMIT_LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define XF_SHELL_SUBMIT_STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define XF_SHELL_SUBMIT_CAS(p, expected, desired) \
+    __atomic_compare_exchange_n((p), (expected), (desired), true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#else
+#error "Define XF_SHELL_SUBMIT_LOAD_ACQUIRE, XF_SHELL_SUBMIT_STORE_RELEASE and XF_SHELL_SUBMIT_CAS for this compiler"
+#endif
+
+#define QUEUE_SIZE ((uint32_t)XF_SHELL_SUBMIT_SLOTS)
+#define QUEUE_MASK (QUEUE_SIZE - 1U)
+
+/* ==================== [Typedefs] ========================================== */
+
+typedef struct {
+    submit_index_t seq; /* relative to the slot index, see the file comment */
+    xf_shell_submit_req_t req;
+} submit_slot_t;
+
+/* ==================== [Static Variables] ================================== */
+
+static submit_slot_t s_slot[XF_SHELL_SUBMIT_SLOTS];
+static submit_index_t s_enqueue; /* next position to claim, producers only */
+static uint32_t s_dequeue;       /* next position to run, consumer only */
+
+/* ==================== [Global Functions] ================================== */
+
+int xf_shell_submit(const char* line, xf_shell_done_t done, void* ctx)
+{
+    submit_slot_t* slot;
+    uint32_t pos;
+    uint32_t lap;
+    uint32_t seq;
+    size_t len;
+
+    if (line == NULL) {
+        return XF_CMD_NO_INVALID_ARG;
+    }
+    len = strlen(line);
+    if (len >= sizeof(s_slot[0].req.line)) {
+        return XF_CMD_NO_INVALID_ARG;
+    }
+
+    pos = XF_SHELL_SUBMIT_LOAD_ACQUIRE(&s_enqueue);
+    for (;;) {
+        slot = &s_slot[pos & QUEUE_MASK];
+        lap = pos & ~QUEUE_MASK;
+        seq = XF_SHELL_SUBMIT_LOAD_ACQUIRE(&slot->seq);
+        if (seq == lap) {
+            // A failed swap leaves the position another producer moved on to in pos
+            if (XF_SHELL_SUBMIT_CAS(&s_enqueue, &pos, pos + 1U)) {
+                break;
+            }
+        } else if ((int32_t)(seq - lap) < 0) {
+            // Still holds the request from a lap ago
+            return XF_CMD_NO_MEM;
+        } else {
+            pos = XF_SHELL_SUBMIT_LOAD_ACQUIRE(&s_enqueue);
+        }
+    }
+    slot->req.done = done;
+    slot->req.ctx = ctx;
+    memcpy(slot->req.line, line, len + 1);
+    XF_SHELL_SUBMIT_STORE_RELEASE(&slot->seq, lap + 1U);
+    xf_shell_wakeup();
+    return XF_CMD_OK;
+}
+
+const xf_shell_submit_req_t* xf_shell_submit_peek(void)
+{
+    submit_slot_t* slot = &s_slot[s_dequeue & QUEUE_MASK];
+
+    if (XF_SHELL_SUBMIT_LOAD_ACQUIRE(&slot->seq) != (s_dequeue & ~QUEUE_MASK) + 1U) {
+        return NULL;
+    }
+    return &slot->req;
+}
+
+void xf_shell_submit_pop(void)
+{
+    submit_slot_t* slot = &s_slot[s_dequeue & QUEUE_MASK];
+
+    XF_SHELL_SUBMIT_STORE_RELEASE(&slot->seq, (s_dequeue & ~QUEUE_MASK) + QUEUE_SIZE);
+    s_dequeue++;
+}
+
+#endif
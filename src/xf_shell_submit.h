@@ -0,0 +1,54 @@
+/**
+ * @file xf_shell_submit.h
+ * @brief Lock-free multi-producer/single-consumer command submission queue.
+ */
+
+#ifndef __XF_SHELL_SUBMIT_H__
+#define __XF_SHELL_SUBMIT_H__
+
+/* ==================== [Includes] ========================================== */
+#include <stdbool.h>
+#include "xf_shell.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if XF_SHELL_SUBMIT_SLOTS
+
+/* ==================== [Typedefs] ========================================== */
+
+/**
+ * @brief 一条提交的命令（消费者侧只读）。
+ */
+typedef struct {
+    xf_shell_done_t done;
+    void* ctx;
+    char line[XF_CLI_MAX_LINE];
+} xf_shell_submit_req_t;
+
+/* ==================== [Global Prototypes] ================================= */
+
+/**
+ * @brief 获取队首已写入完成的请求（消费者侧）。
+ *
+ * @details
+ * 请求原地返回，处理完后调用 `xf_shell_submit_pop()` 释放槽位。
+ * 生产者已占用但尚未写完的槽位视为空，后面的请求也要等它写完。
+ *
+ * @return 请求；队列为空时返回 `NULL`。
+ */
+const xf_shell_submit_req_t* xf_shell_submit_peek(void);
+
+/**
+ * @brief 释放 `xf_shell_submit_peek()` 返回的请求（消费者侧）。
+ */
+void xf_shell_submit_pop(void);
+
+#endif
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif  // __XF_SHELL_SUBMIT_H__
@@ -0,0 +1,92 @@
+/**
+ * @file xf_shell_tokenizer.c
+ * @brief Single-pass command line tokenizer shared by dispatch and completion.
+ */
+
+/* ==================== [Includes] ========================================== */
+#include "xf_shell_tokenizer.h"
+#include <stddef.h>
+
+/* ==================== [Global Variables] ================================== */
+
+const char xf_shell_chain_words[5][3] = { "", ";", "&&", "||", "&" };
+
+/* ==================== [Static Prototypes] ================================= */
+
+static char* chain_word(const xf_shell_lexer_t* lx, char* value);
+
+/* ==================== [Global Functions] ================================== */
+
+int xf_shell_tokenize(char* line, int len, char** argv, int max_argc) {
+    xf_shell_lexer_t lx;
+    int argc = 0;
+    int w = 0;
+    int r;
+
+    if (line == NULL || argv == NULL || max_argc <= 0) {
+        return 0;
+    }
+
+    xf_shell_lexer_init(&lx);
+    for (r = 0; r < len && line[r] != '\0'; ++r) {
+        uint8_t ev = xf_shell_lexer_step(&lx, line[r]);
+
+        if (ev & XF_SHELL_LEX_END) {
+            line[w++] = '\0';
+            argv[argc - 1] = chain_word(&lx, argv[argc - 1]);
+            continue;
+        }
+        if (ev & XF_SHELL_LEX_BEGIN) {
+            // Traditionally, there is a NULL entry at argv[argc]
+            // A chained line cut short would silently lose commands
+            if (argc >= max_argc - 1) {
+                argv[0] = NULL;
+                return -1;
+            }
+            argv[argc++] = &line[w];
+        }
+        if (ev & XF_SHELL_LEX_KEEP) {
+            line[w++] = line[r];
+        }
+    }
+    // The write pointer never passes the read pointer, so this is in bounds
+    if (lx.in_token) {
+        line[w] = '\0';
+        argv[argc - 1] = chain_word(&lx, argv[argc - 1]);
+    }
+
+    argv[argc] = NULL;
+    return argc;
+}
+
+int xf_shell_token_copy(const char* line, int start, int end, char* out, int out_size) {
+    xf_shell_lexer_t lx;
+    int n = 0;
+    int r;
+
+    if (out == NULL || out_size <= 0) {
+        return 0;
+    }
+
+    if (line != NULL) {
+        xf_shell_lexer_init(&lx);
+        for (r = start; r < end && n < out_size - 1; ++r) {
+            if (xf_shell_lexer_step(&lx, line[r]) & XF_SHELL_LEX_KEEP) {
+                out[n++] = line[r];
+            }
+        }
+    }
+
+    out[n] = '\0';
+    return n;
+}
+
+/* ==================== [Static Functions] ================================== */
+
+/* Operators leave the line, so a quoted "&&" stays an ordinary argument */
+static char* chain_word(const xf_shell_lexer_t* lx, char* value) {
+    if ((xf_shell_lexer_kind(lx) & XF_SHELL_TOKEN_KIND_MASK) != XF_SHELL_TOKEN_OPERATOR) {
+        return value;
+    }
+    return xf_shell_chain_word(value);
+}
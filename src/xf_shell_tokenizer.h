@@ -0,0 +1,292 @@
+/**
+ * @file xf_shell_tokenizer.h
+ * @brief Single-pass command line tokenizer shared by dispatch and completion.
+ */
+
+#ifndef __XF_SHELL_TOKENIZER_H__
+#define __XF_SHELL_TOKENIZER_H__
+
+/* ==================== [Includes] ========================================== */
+#include <stdbool.h>
+#include <stdint.h>
+#include "xf_shell_config_internal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ==================== [Defines] =========================================== */
+
+/* Events reported by xf_shell_lexer_step(). */
+#define XF_SHELL_LEX_BEGIN 0x01U /* the character opens a new token */
+#define XF_SHELL_LEX_KEEP 0x02U  /* the character is part of the token value */
+#define XF_SHELL_LEX_END 0x04U   /* the character is the separator after a token */
+
+/* Lexical token kinds, low bits of xf_shell_token_t.flags. */
+#define XF_SHELL_TOKEN_WORD 0U            /* command name, value or positional */
+#define XF_SHELL_TOKEN_SHORT_OPT 1U       /* -x */
+#define XF_SHELL_TOKEN_SHORT_OPT_VALUE 2U /* -x=value */
+#define XF_SHELL_TOKEN_LONG_OPT 3U        /* --name */
+#define XF_SHELL_TOKEN_LONG_OPT_VALUE 4U  /* --name=value */
+#define XF_SHELL_TOKEN_END_OPTS 5U        /* -- */
+#define XF_SHELL_TOKEN_OPT_OTHER 6U       /* -xyz, never takes a value */
+#define XF_SHELL_TOKEN_OPERATOR 7U        /* ; && || & between chained commands */
+#define XF_SHELL_TOKEN_KIND_MASK 0x07U
+#define XF_SHELL_TOKEN_QUOTED 0x08U       /* value differs from the raw text */
+
+#define XF_SHELL_LEX_NO_EQ 0xFFU
+
+/* Chaining operators, see xf_shell_chain_op(). */
+#define XF_SHELL_CHAIN_NONE 0U
+#define XF_SHELL_CHAIN_SEQ 1U /* ; */
+#define XF_SHELL_CHAIN_AND 2U /* && */
+#define XF_SHELL_CHAIN_OR 3U  /* || */
+#define XF_SHELL_CHAIN_BG 4U  /* &, the command before it runs in the background */
+
+/* ==================== [Typedefs] ========================================== */
+
+/* Offset into a command line, no wider than XF_CLI_MAX_LINE requires. */
+#if XF_CLI_MAX_LINE <= 256
+typedef uint8_t xf_shell_pos_t;
+#elif XF_CLI_MAX_LINE <= 65536
+typedef uint16_t xf_shell_pos_t;
+#else
+typedef uint32_t xf_shell_pos_t;
+#endif
+
+/**
+ * @brief 逐字符词法状态。
+ *
+ * @details
+ * 规则：空白分隔 token；`'...'` 与 `"..."` 内的内容按字面保留（引号本身去掉）；
+ * 引号外的 `\` 会转义紧随的一个字符。
+ */
+typedef struct {
+    char quote;
+    bool escape;
+    bool in_token;
+    bool quoted;   /* current token contains quotes or escapes */
+    uint8_t kept;  /* value characters so far, saturating */
+    uint8_t eq_at; /* value index of the first '=' or XF_SHELL_LEX_NO_EQ */
+    char head[2];  /* first two value characters */
+} xf_shell_lexer_t;
+
+/**
+ * @brief token 在原始行中的位置 `[start, end)`（包含引号与转义符）及其词法类别。
+ *
+ * @details
+ * `end` 为 token 之后分隔符所在位置；未结束的 token（如未闭合引号）延伸到行尾。
+ * `flags` 低位为 `XF_SHELL_TOKEN_*` 类别，另含 `XF_SHELL_TOKEN_QUOTED` 标志。
+ */
+typedef struct {
+    xf_shell_pos_t start;
+    xf_shell_pos_t end;
+    uint8_t flags;
+} xf_shell_token_t;
+
+/* ==================== [Global Variables] ================================== */
+
+/**
+ * @brief 连接运算符在 argv 中的表示，按 `XF_SHELL_CHAIN_*` 编号。
+ * @details
+ * 未加引号、单独成词的 `;`、`&&`、`||`、`&` 拆分到 argv 时指向这里的常量字符串，
+ * 而带引号的同名参数仍指向命令行缓冲区，因此按指针即可区分二者。
+ */
+extern const char xf_shell_chain_words[5][3];
+
+/* ==================== [Global Prototypes] ================================= */
+
+/**
+ * @brief 将一行命令文本就地拆分为 `argc/argv`。
+ *
+ * @details
+ * 单次遍历，读指针扫描原始字符、写指针回写去掉引号与转义符后的值，
+ * 每个 token 以 `\0` 结尾。时间复杂度 O(n)，`line` 内容会被修改。
+ * 连接运算符输出为 `xf_shell_chain_words` 中的常量，见 `xf_shell_chain_op()`。
+ * 最多输出 `max_argc - 1` 个参数，`argv[argc]` 固定为 `NULL`；
+ * 参数更多时整行作废（不截断），返回 `-1`。
+ *
+ * @param[in,out] line 命令行缓冲区。
+ * @param[in] len `line` 的最大扫描长度，遇到 `\0` 提前结束。
+ * @param[out] argv 输出参数数组。
+ * @param[in] max_argc `argv` 容量（含结尾 `NULL`）。
+ *
+ * @return 参数个数，参数过多时为 `-1`。
+ */
+int xf_shell_tokenize(char* line, int len, char** argv, int max_argc);
+
+/**
+ * @brief 拷贝 token 原始区间 `[start, end)` 去掉引号与转义符后的值。
+ *
+ * @param[in] line 命令行文本。
+ * @param[in] start token 起始位置（必须是 token 开头）。
+ * @param[in] end 拷贝截止位置，可小于 token 结尾（如光标位置）。
+ * @param[out] out 输出缓冲区，总是以 `\0` 结尾。
+ * @param[in] out_size 输出缓冲区大小。
+ *
+ * @return 写入的字符数（不含 `\0`）。
+ */
+int xf_shell_token_copy(const char* line, int start, int end, char* out, int out_size);
+
+/**
+ * @brief 初始化词法状态。
+ *
+ * @param[out] lx 词法状态。
+ */
+static inline void xf_shell_lexer_init(xf_shell_lexer_t* lx)
+{
+    lx->quote = '\0';
+    lx->escape = false;
+    lx->in_token = false;
+    lx->quoted = false;
+    lx->kept = 0U;
+    lx->eq_at = XF_SHELL_LEX_NO_EQ;
+}
+
+/* Record one value character of the current token for kind detection. */
+static inline uint8_t xf_shell_lexer_keep(xf_shell_lexer_t* lx, char ch)
+{
+    if (lx->kept < 2U) {
+        lx->head[lx->kept] = ch;
+    }
+    if (ch == '=' && lx->eq_at == XF_SHELL_LEX_NO_EQ) {
+        lx->eq_at = lx->kept;
+    }
+    if (lx->kept < 0xFFU) {
+        lx->kept++;
+    }
+    return XF_SHELL_LEX_KEEP;
+}
+
+/**
+ * @brief 向词法状态输入一个字符。
+ *
+ * @param[in,out] lx 词法状态。
+ * @param[in] ch 输入字符。
+ *
+ * @return `XF_SHELL_LEX_*` 事件位组合。
+ */
+static inline uint8_t xf_shell_lexer_step(xf_shell_lexer_t* lx, char ch)
+{
+    uint8_t ev = 0U;
+
+    if (lx->escape) {
+        lx->escape = false;
+        return xf_shell_lexer_keep(lx, ch);
+    }
+    if (lx->quote != '\0') {
+        if (ch == lx->quote) {
+            lx->quote = '\0';
+            return 0U;
+        }
+        return xf_shell_lexer_keep(lx, ch);
+    }
+    if (ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r') {
+        if (lx->in_token) {
+            lx->in_token = false;
+            return XF_SHELL_LEX_END;
+        }
+        return 0U;
+    }
+    if (!lx->in_token) {
+        lx->in_token = true;
+        lx->quoted = false;
+        lx->kept = 0U;
+        lx->eq_at = XF_SHELL_LEX_NO_EQ;
+        ev = XF_SHELL_LEX_BEGIN;
+    }
+    if (ch == '\\') {
+        lx->escape = true;
+        lx->quoted = true;
+        return ev;
+    }
+    if (ch == '\'' || ch == '"') {
+        lx->quote = ch;
+        lx->quoted = true;
+        return ev;
+    }
+    return ev | xf_shell_lexer_keep(lx, ch);
+}
+
+/**
+ * @brief 判断 argv 中的一个参数是否为连接运算符。
+ *
+ * @param[in] arg `xf_shell_tokenize()` 或 `xf_cli_argc()` 输出的参数。
+ *
+ * @return `XF_SHELL_CHAIN_*`，普通参数返回 `XF_SHELL_CHAIN_NONE`。
+ */
+static inline uint8_t xf_shell_chain_op(const char* arg)
+{
+    uint8_t op;
+
+    for (op = XF_SHELL_CHAIN_SEQ; op <= XF_SHELL_CHAIN_BG; ++op) {
+        if (arg == xf_shell_chain_words[op]) {
+            return op;
+        }
+    }
+    return XF_SHELL_CHAIN_NONE;
+}
+
+/**
+ * @brief 取得运算符 token 在 argv 中的表示。
+ *
+ * @param[in] text 类别为 `XF_SHELL_TOKEN_OPERATOR` 的 token 文本。
+ *
+ * @return `xf_shell_chain_words` 中对应的常量字符串。
+ */
+static inline char* xf_shell_chain_word(const char* text)
+{
+    uint8_t op = (text[0] == ';') ? XF_SHELL_CHAIN_SEQ :
+                 (text[0] == '|') ? XF_SHELL_CHAIN_OR :
+                 (text[1] == '\0') ? XF_SHELL_CHAIN_BG : XF_SHELL_CHAIN_AND;
+
+    // Read-only for consumers, argv is char * for the parser's sake
+    return (char*)xf_shell_chain_words[op];
+}
+
+/**
+ * @brief 获取当前（或刚结束的）token 的词法类别，规则与参数解析器一致。
+ *
+ * @param[in] lx 词法状态。
+ *
+ * @return `XF_SHELL_TOKEN_*` 类别，必要时带 `XF_SHELL_TOKEN_QUOTED`。
+ */
+static inline uint8_t xf_shell_lexer_kind(const xf_shell_lexer_t* lx)
+{
+    uint8_t kind;
+
+    // Only a bare word can be an operator, "&&" or \; stay arguments
+    if (!lx->quoted &&
+        ((lx->kept == 1U && (lx->head[0] == ';' || lx->head[0] == '&')) ||
+         (lx->kept == 2U && lx->head[0] == lx->head[1] &&
+          (lx->head[0] == '&' || lx->head[0] == '|')))) {
+        return XF_SHELL_TOKEN_OPERATOR;
+    }
+    if (lx->kept < 2U || lx->head[0] != '-') {
+        kind = XF_SHELL_TOKEN_WORD;
+    } else if (lx->head[1] == '-') {
+        if (lx->kept == 2U) {
+            kind = XF_SHELL_TOKEN_END_OPTS;
+        } else if (lx->eq_at != XF_SHELL_LEX_NO_EQ) {
+            kind = XF_SHELL_TOKEN_LONG_OPT_VALUE;
+        } else {
+            kind = XF_SHELL_TOKEN_LONG_OPT;
+        }
+    } else if (lx->kept == 2U) {
+        kind = XF_SHELL_TOKEN_SHORT_OPT;
+    } else if (lx->eq_at == 2U) {
+        kind = XF_SHELL_TOKEN_SHORT_OPT_VALUE;
+    } else {
+        kind = XF_SHELL_TOKEN_OPT_OTHER;
+    }
+
+    return (uint8_t)(kind | (lx->quoted ? XF_SHELL_TOKEN_QUOTED : 0U));
+}
+
+/* ==================== [Macros] ============================================ */
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif  // __XF_SHELL_TOKENIZER_H__
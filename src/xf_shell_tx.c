@@ -0,0 +1,135 @@
+/**
+ * @file xf_shell_tx.c
+ * @brief Non-blocking output ring between the shell and the port.
+ */
+
+/* ==================== [Includes] ========================================== */
+#include "xf_shell_tx.h"
+#include <string.h>
+
+#if XF_SHELL_TX_RING_SIZE
+
+/* ==================== [Defines] =========================================== */
+
+#define RING_SIZE ((size_t)XF_SHELL_TX_RING_SIZE)
+
+/* ==================== [Static Prototypes] ================================= */
+
+static void ring_push(xf_shell_tx_t* tx, const char* data, size_t len);
+static void ring_discard(xf_shell_tx_t* tx, size_t len);
+
+/* ==================== [Global Functions] ================================== */
+
+void xf_shell_tx_init(xf_shell_tx_t* tx, xf_tx_write_t write, void* user_data,
+                      xf_shell_tx_policy_t policy)
+{
+    memset(tx, 0, sizeof(*tx));
+    tx->write = write;
+    tx->user_data = user_data;
+    tx->policy = policy;
+}
+
+size_t xf_shell_tx_drain(xf_shell_tx_t* tx)
+{
+    while (tx->count > 0 && tx->write != NULL) {
+        size_t chunk = RING_SIZE - tx->head;
+        size_t sent;
+
+        if (chunk > tx->count) {
+            chunk = tx->count;
+        }
+        sent = tx->write(tx->user_data, &tx->ring[tx->head], chunk);
+        if (sent > chunk) {
+            sent = chunk;
+        }
+        ring_discard(tx, sent);
+        if (sent < chunk) {
+            break;
+        }
+    }
+    return tx->count;
+}
+
+void xf_shell_tx_write(void* ctx, const char* data, size_t len)
+{
+    xf_shell_tx_t* tx = (xf_shell_tx_t*)ctx;
+    size_t room;
+
+    if (tx == NULL || tx->write == NULL) {
+        return;
+    }
+
+    /* Nothing queued: hand the data straight to the port, keep only the rest. */
+    if (tx->count == 0) {
+        size_t sent = tx->write(tx->user_data, data, len);
+        if (sent > len) {
+            sent = len;
+        }
+        data += sent;
+        len -= sent;
+    }
+
+    room = RING_SIZE - tx->count;
+    if (len > room) {
+        switch (tx->policy) {
+        case XF_SHELL_TX_DROP_NEWEST:
+            tx->dropped += (uint32_t)(len - room);
+            len = room;
+            break;
+        case XF_SHELL_TX_DROP_OLDEST:
+            if (len > RING_SIZE) {
+                /* Only the newest RING_SIZE bytes can survive. */
+                tx->dropped += (uint32_t)(len - RING_SIZE);
+                data += len - RING_SIZE;
+                len = RING_SIZE;
+            }
+            tx->dropped += (uint32_t)(len - room);
+            ring_discard(tx, len - room);
+            break;
+        case XF_SHELL_TX_BLOCK:
+        default:
+            while (len > 0) {
+                size_t k;
+
+                if (xf_shell_tx_drain(tx) == RING_SIZE) {
+                    XF_SHELL_TX_WAIT();
+                    continue;
+                }
+                k = RING_SIZE - tx->count;
+                if (k > len) {
+                    k = len;
+                }
+                ring_push(tx, data, k);
+                data += k;
+                len -= k;
+            }
+            break;
+        }
+    }
+
+    ring_push(tx, data, len);
+    (void)xf_shell_tx_drain(tx);
+}
+
+/* ==================== [Static Functions] ================================== */
+
+static void ring_push(xf_shell_tx_t* tx, const char* data, size_t len)
+{
+    size_t tail = (tx->head + tx->count) % RING_SIZE;
+    size_t first = RING_SIZE - tail;
+
+    if (first > len) {
+        first = len;
+    }
+    memcpy(&tx->ring[tail], data, first);
+    memcpy(tx->ring, data + first, len - first);
+    tx->count += len;
+}
+
+static void ring_discard(xf_shell_tx_t* tx, size_t len)
+{
+    tx->head = (tx->head + len) % RING_SIZE;
+    tx->count -= len;
+}
+
+#endif
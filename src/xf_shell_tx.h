@@ -0,0 +1,79 @@
+/**
+ * @file xf_shell_tx.h
+ * @brief Non-blocking output ring between the shell and the port.
+ */
+
+#ifndef __XF_SHELL_TX_H__
+#define __XF_SHELL_TX_H__
+
+/* ==================== [Includes] ========================================== */
+#include <stddef.h>
+#include <stdint.h>
+#include "xf_shell.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if XF_SHELL_TX_RING_SIZE
+
+/* ==================== [Typedefs] ========================================== */
+
+/**
+ * @brief 发送环形缓冲区。
+ *
+ * @details
+ * 只在 shell 任务上下文中访问，不需要加锁。
+ */
+typedef struct {
+    xf_tx_write_t write;
+    void* user_data;
+    xf_shell_tx_policy_t policy;
+    size_t head;      /* oldest queued byte */
+    size_t count;     /* queued bytes */
+    uint32_t dropped; /* bytes discarded by the drop policies */
+    char ring[XF_SHELL_TX_RING_SIZE];
+} xf_shell_tx_t;
+
+/* ==================== [Global Prototypes] ================================= */
+
+/**
+ * @brief 初始化发送环形缓冲区。
+ *
+ * @param[out] tx 发送缓冲区。
+ * @param[in] write 非阻塞写回调。
+ * @param[in] user_data 回调透传上下文。
+ * @param[in] policy 缓冲区满时的处理策略。
+ */
+void xf_shell_tx_init(xf_shell_tx_t* tx, xf_tx_write_t write, void* user_data,
+                      xf_shell_tx_policy_t policy);
+
+/**
+ * @brief 写入一段输出数据，可直接作为 CLI 的块输出回调。
+ *
+ * @details
+ * 缓冲区为空时先尝试直接交给端口，剩余部分入队；
+ * 放不下时按策略阻塞等待、丢弃最旧数据或丢弃新数据。
+ *
+ * @param[in,out] ctx `xf_shell_tx_t` 指针。
+ * @param[in] data 数据。
+ * @param[in] len 数据长度。
+ */
+void xf_shell_tx_write(void* ctx, const char* data, size_t len);
+
+/**
+ * @brief 尽可能多地把已排队数据交给端口，不会阻塞。
+ *
+ * @param[in,out] tx 发送缓冲区。
+ *
+ * @return 仍在排队的字节数。
+ */
+size_t xf_shell_tx_drain(xf_shell_tx_t* tx);
+
+#endif
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif  // __XF_SHELL_TX_H__
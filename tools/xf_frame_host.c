@@ -0,0 +1,428 @@
+/**
+ * @file xf_frame_host.c
+ * @brief Host side of XF_SHELL_MODE_FRAME: call commands, or measure calls per second.
+ *
+ * Talks to a shell started with `--frame` through a pair of pipes, or to a
+ * board over a serial device (USB CDC, UART). The frame format is the one
+ * in src/xf_shell_frame.h; this file has its own copy of the codec so it
+ * builds without the shell sources.
+ *
+ *   xf_frame_host -e ./shell -- test beta -n 5
+ *   xf_frame_host -d /dev/ttyACM0 -n 10000 -w 8 -- test
+ *
+ * A single call prints the command's output and exits with its status.
+ * With -n the call is repeated, up to -w requests in flight, and the rate
+ * is printed instead of the output.
+ */
+
+/* ==================== [Includes] ========================================== */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/* ==================== [Defines] =========================================== */
+
+#define FRAME_SOF 0xA5U
+#define FRAME_HEADER 5U
+#define FRAME_CRC 2U
+#define FRAME_STATUS 4U
+#define FRAME_MAX 65535U
+
+#define FRAME_CALL 0x01U
+#define FRAME_DATA 0x81U
+#define FRAME_END 0x82U
+
+#define RX_SIZE (2U * (FRAME_HEADER + FRAME_MAX + FRAME_CRC))
+
+/* ==================== [Typedefs] ========================================== */
+
+typedef struct {
+    uint8_t type;
+    uint8_t seq;
+    const uint8_t *payload;
+    size_t len;
+} frame_t;
+
+/* ==================== [Static Prototypes] ================================= */
+
+static uint16_t frame_crc(uint16_t crc, const uint8_t *data, size_t len);
+static size_t frame_encode(uint8_t *out, uint8_t type, uint8_t seq, const uint8_t *payload,
+                           size_t len);
+static int frame_next(frame_t *frame, int timeout_ms);
+static bool write_all(const uint8_t *data, size_t len);
+static bool open_device(const char *path);
+static bool spawn_shell(const char *path);
+static void close_link(void);
+static int32_t end_status(const frame_t *frame);
+static double now_seconds(void);
+static void usage(const char *prog);
+
+/* ==================== [Static Variables] ================================== */
+
+static int s_rd = -1;
+static int s_wr = -1;
+static pid_t s_child = -1;
+static uint8_t s_rx[RX_SIZE];
+static size_t s_rx_head; /* first byte not parsed yet */
+static size_t s_rx_len;  /* bytes in s_rx */
+static uint32_t s_bad;   /* bytes skipped looking for a frame */
+
+/* ==================== [Global Functions] ================================== */
+
+int main(int argc, char **argv)
+{
+    const char *device = NULL;
+    const char *shell = NULL;
+    long count = 0;
+    long window = 1;
+    int timeout_ms = 1000;
+    uint8_t payload[FRAME_MAX];
+    uint8_t request[FRAME_HEADER + FRAME_MAX + FRAME_CRC];
+    size_t len = 0;
+    size_t req_len;
+    long sent = 0;
+    long done = 0;
+    long failed = 0;
+    uint8_t seq = 0;
+    uint8_t expect = 0;
+    uint64_t out_bytes = 0;
+    int32_t status = 0;
+    double start;
+    double elapsed;
+    frame_t frame;
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "d:e:n:w:t:h")) != -1) {
+        switch (opt) {
+        case 'd':
+            device = optarg;
+            break;
+        case 'e':
+            shell = optarg;
+            break;
+        case 'n':
+            count = strtol(optarg, NULL, 0);
+            break;
+        case 'w':
+            window = strtol(optarg, NULL, 0);
+            break;
+        case 't':
+            timeout_ms = (int)strtol(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (optind >= argc || (device == NULL) == (shell == NULL) || count < 0 || window < 1 ||
+        window > 128) {
+        usage(argv[0]);
+        return 2;
+    }
+    // The words go as they are, each with its nul, no quoting or splitting
+    for (i = optind; i < argc; i++) {
+        size_t n = strlen(argv[i]) + 1;
+
+        if (len + n > sizeof(payload)) {
+            fprintf(stderr, "command too long\n");
+            return 2;
+        }
+        memcpy(&payload[len], argv[i], n);
+        len += n;
+    }
+
+    (void)signal(SIGPIPE, SIG_IGN);
+    if (device != NULL ? !open_device(device) : !spawn_shell(shell)) {
+        return 1;
+    }
+    atexit(close_link);
+
+    if (count == 0) {
+        req_len = frame_encode(request, FRAME_CALL, seq, payload, len);
+        if (!write_all(request, req_len)) {
+            return 1;
+        }
+        for (;;) {
+            if (frame_next(&frame, timeout_ms) != 0) {
+                fprintf(stderr, "no answer\n");
+                return 1;
+            }
+            if (frame.seq != seq) {
+                continue;
+            }
+            if (frame.type == FRAME_DATA) {
+                fwrite(frame.payload, 1, frame.len, stdout);
+            } else if (frame.type == FRAME_END && frame.len >= FRAME_STATUS) {
+                fwrite(frame.payload + FRAME_STATUS, 1, frame.len - FRAME_STATUS, stdout);
+                fflush(stdout);
+                return (int)(end_status(&frame) & 0xFF);
+            }
+        }
+    }
+
+    start = now_seconds();
+    while (done < count) {
+        // Keep the pipe full, the shell answers in order
+        while (sent < count && sent - done < window) {
+            req_len = frame_encode(request, FRAME_CALL, seq++, payload, len);
+            if (!write_all(request, req_len)) {
+                return 1;
+            }
+            sent++;
+        }
+        if (frame_next(&frame, timeout_ms) != 0) {
+            fprintf(stderr, "no answer after %ld calls\n", done);
+            return 1;
+        }
+        if (frame.seq != expect) {
+            fprintf(stderr, "call %ld: sequence %u, expected %u\n", done, frame.seq, expect);
+            return 1;
+        }
+        if (frame.type != FRAME_END || frame.len < FRAME_STATUS) {
+            out_bytes += frame.len;
+            continue;
+        }
+        out_bytes += frame.len - FRAME_STATUS;
+        status = end_status(&frame);
+        if (status != 0) {
+            failed++;
+        }
+        expect++;
+        done++;
+    }
+    elapsed = now_seconds() - start;
+
+    printf("calls      : %ld (%ld failed, last status %ld)\n", done, failed, (long)status);
+    printf("window     : %ld\n", window);
+    printf("elapsed    : %.3f s\n", elapsed);
+    printf("calls/s    : %.0f\n", (double)done / elapsed);
+    printf("latency    : %.1f us\n", elapsed * 1e6 / (double)done * (double)window);
+    printf("request    : %zu bytes\n", frame_encode(request, FRAME_CALL, 0, payload, len));
+    printf("output     : %.1f bytes per call\n", (double)out_bytes / (double)done);
+    printf("skipped    : %lu bytes\n", (unsigned long)s_bad);
+    return failed > 0 ? 1 : 0;
+}
+
+/* ==================== [Static Functions] ================================== */
+
+/* CRC-16/CCITT-FALSE, bit by bit: the host has cycles to spare */
+static uint16_t frame_crc(uint16_t crc, const uint8_t *data, size_t len)
+{
+    size_t i;
+    int bit;
+
+    for (i = 0; i < len; i++) {
+        crc ^= (uint16_t)(data[i] << 8);
+        for (bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000U) ? (uint16_t)((crc << 1) ^ 0x1021U) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static size_t frame_encode(uint8_t *out, uint8_t type, uint8_t seq, const uint8_t *payload,
+                           size_t len)
+{
+    uint16_t crc;
+
+    out[0] = FRAME_SOF;
+    out[1] = type;
+    out[2] = seq;
+    out[3] = (uint8_t)(len & 0xFFU);
+    out[4] = (uint8_t)(len >> 8);
+    memcpy(&out[FRAME_HEADER], payload, len);
+    crc = frame_crc(0xFFFFU, &out[1], FRAME_HEADER - 1 + len);
+    out[FRAME_HEADER + len] = (uint8_t)(crc & 0xFFU);
+    out[FRAME_HEADER + len + 1] = (uint8_t)(crc >> 8);
+    return FRAME_HEADER + len + FRAME_CRC;
+}
+
+/*
+ * The next good frame from the shell. Bytes outside of frames, such as
+ * text from a background job, are skipped, as are frames with a bad CRC.
+ * Returns 0, or -1 on a timeout or a closed connection.
+ */
+static int frame_next(frame_t *frame, int timeout_ms)
+{
+    for (;;) {
+        size_t avail = s_rx_len - s_rx_head;
+        const uint8_t *p = &s_rx[s_rx_head];
+        struct pollfd pfd;
+        int ready;
+        ssize_t n;
+
+        if (avail > 0 && p[0] != FRAME_SOF) {
+            s_rx_head++;
+            s_bad++;
+            continue;
+        }
+        if (avail >= FRAME_HEADER) {
+            size_t len = (size_t)p[3] | ((size_t)p[4] << 8);
+            size_t total = FRAME_HEADER + len + FRAME_CRC;
+
+            if (avail >= total) {
+                uint16_t crc = frame_crc(0xFFFFU, &p[1], FRAME_HEADER - 1 + len);
+
+                if (p[FRAME_HEADER + len] != (crc & 0xFFU) ||
+                    p[FRAME_HEADER + len + 1] != (crc >> 8)) {
+                    s_rx_head++;
+                    s_bad++;
+                    continue;
+                }
+                frame->type = p[1];
+                frame->seq = p[2];
+                frame->payload = &p[FRAME_HEADER];
+                frame->len = len;
+                s_rx_head += total;
+                return 0;
+            }
+        }
+
+        // Not a whole frame yet: move it to the front and read more
+        if (s_rx_head > 0) {
+            memmove(s_rx, &s_rx[s_rx_head], avail);
+            s_rx_len = avail;
+            s_rx_head = 0;
+        }
+        pfd.fd = s_rd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        ready = poll(&pfd, 1, timeout_ms);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0) {
+            return -1;
+        }
+        n = read(s_rd, &s_rx[s_rx_len], sizeof(s_rx) - s_rx_len);
+        if (n <= 0) {
+            return -1;
+        }
+        s_rx_len += (size_t)n;
+    }
+}
+
+static bool write_all(const uint8_t *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(s_wr, data, len);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("write");
+            return false;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+/* A serial line carrying binary: raw, 8 data bits, no flow control characters */
+static bool open_device(const char *path)
+{
+    struct termios tio;
+    int fd = open(path, O_RDWR | O_NOCTTY);
+
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+    if (tcgetattr(fd, &tio) == 0) {
+        tio.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON | IXOFF);
+        tio.c_oflag &= ~OPOST;
+        tio.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+        tio.c_cflag &= ~(CSIZE | PARENB);
+        tio.c_cflag |= CS8 | CLOCAL | CREAD;
+        tio.c_cc[VMIN] = 1;
+        tio.c_cc[VTIME] = 0;
+        (void)tcsetattr(fd, TCSANOW, &tio);
+    }
+    s_rd = fd;
+    s_wr = fd;
+    return true;
+}
+
+static bool spawn_shell(const char *path)
+{
+    int to_shell[2];
+    int from_shell[2];
+
+    if (pipe(to_shell) != 0 || pipe(from_shell) != 0) {
+        perror("pipe");
+        return false;
+    }
+    s_child = fork();
+    if (s_child < 0) {
+        perror("fork");
+        return false;
+    }
+    if (s_child == 0) {
+        (void)dup2(to_shell[0], STDIN_FILENO);
+        (void)dup2(from_shell[1], STDOUT_FILENO);
+        (void)close(to_shell[0]);
+        (void)close(to_shell[1]);
+        (void)close(from_shell[0]);
+        (void)close(from_shell[1]);
+        (void)execl(path, path, "--frame", (char *)NULL);
+        perror(path);
+        _exit(127);
+    }
+    (void)close(to_shell[0]);
+    (void)close(from_shell[1]);
+    s_wr = to_shell[1];
+    s_rd = from_shell[0];
+    return true;
+}
+
+/* End of input lets a spawned shell exit, it is reaped before we go */
+static void close_link(void)
+{
+    (void)close(s_wr);
+    if (s_child > 0) {
+        (void)waitpid(s_child, NULL, 0);
+    }
+}
+
+static int32_t end_status(const frame_t *frame)
+{
+    const uint8_t *p = frame->payload;
+
+    return (int32_t)((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+                     ((uint32_t)p[3] << 24));
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s (-e <shell> | -d <device>) [-n <calls>] [-w <window>] [-t <ms>] -- "
+            "<command> [words...]\n"
+            "  -e <shell>   start <shell> --frame and talk to it through pipes\n"
+            "  -d <device>  talk to a board on a serial device, already in frame mode\n"
+            "  -n <calls>   repeat the call and print the rate instead of the output\n"
+            "  -w <window>  requests in flight during -n, 1 to 128 (default 1)\n"
+            "  -t <ms>      answer timeout (default 1000)\n",
+            prog);
+}
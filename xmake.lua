@@ -6,11 +6,20 @@ target("shell")
     set_kind("binary")
     if is_plat("linux", "macosx", "bsd") then
         add_defines("_POSIX_C_SOURCE=200809L")
+        add_syslinks("pthread")
     end
     add_files("src/*.c")
     add_files("example/*.c")
     add_includedirs("src", "example")
 
+-- Host client and benchmark for the frame mode: xmake run xf_frame_host -e <shell> -- help
+target("xf_frame_host")
+    set_kind("binary")
+    if is_plat("linux", "macosx", "bsd") then
+        add_defines("_POSIX_C_SOURCE=200809L")
+    end
+    add_files("tools/xf_frame_host.c")
+
 --
 -- If you want to known more usage about xmake, please see https://xmake.io
 --